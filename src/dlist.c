@@ -6,6 +6,17 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <stdatomic.h>
+#include <time.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#ifndef DLIST_NOTHREADS
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 #include <dlist.h>
 
@@ -16,357 +27,3957 @@
 #define DLIST_ASSERT(expr)
 #endif
 
+/* Back off while spinning on another thread */
+#ifndef DLIST_NOTHREADS
+#define DLIST_CPU_RELAX()             sched_yield()
+#else
+#define DLIST_CPU_RELAX()
+#endif
+
+
+/* Stripes of a dlist_sharded when the caller passes 0, and the cap */
+#ifndef DLIST_SHARDED_STRIPES
+#define DLIST_SHARDED_STRIPES         16
+#endif
+
+#ifndef DLIST_SHARDED_MAX_STRIPES
+#define DLIST_SHARDED_MAX_STRIPES     4096
+#endif
+
+#ifndef DLIST_POOL_CHUNK_NODES
+#define DLIST_POOL_CHUNK_NODES        1024
+#endif
+
+/* Size and alignment of a bulk insert batch block, a power of two */
+#ifndef DLIST_BATCH_BYTES
+#define DLIST_BATCH_BYTES             1024
+#endif
+
+/* Size and alignment of an unrolled node, a power of two */
+#ifndef DLIST_UNROLLED_BYTES
+#define DLIST_UNROLLED_BYTES          128
+#endif
+
+#define DLIST_UNROLLED_SLOTS                                            \
+    ((DLIST_UNROLLED_BYTES - 3 * sizeof(void *)) / sizeof(void *))
+
+
+/*
+ * data comes first so that an iterator, which points at the data slot,
+ * is the node itself.
+ */
+struct dlist_node
+{
+    void *data;
+    struct dlist_node *prev, *next;
+    uint32_t hits : 31;                 /* DLIST_SEARCH_COUNT policy */
+    uint32_t batched : 1;               /* lives in a dlist_batch */
+    uint32_t key_sig;                   /* DLIST_F_STRKEYS signature */
+};
+
+#define DLIST_HITS_MAX                0x7fffffff
+
+/*
+ * Node of the unrolled backend.  Slots [0, count) are in use; a node is
+ * never left empty.  Nodes are aligned to their size so the node of an
+ * iterator (a slot pointer) is found by masking.
+ */
+struct dlist_unode
+{
+    struct dlist_unode *prev, *next;
+    size_t count;
+    void *slots[DLIST_UNROLLED_SLOTS];
+};
+
+/* Threads of a parallel operation, counting the caller */
+#ifndef DLIST_MAX_THREADS
+#define DLIST_MAX_THREADS             64
+#endif
+
+/* Parallel sort: the least nodes worth a thread */
+#ifndef DLIST_SORT_PARALLEL_MIN_NODES
+#define DLIST_SORT_PARALLEL_MIN_NODES 4096
+#endif
+
+/* RCU lists: retirements between reclaim passes */
+#ifndef DLIST_RCU_RECLAIM_EVERY
+#define DLIST_RCU_RECLAIM_EVERY       64
+#endif
+
+/* Lock-free set: retirements between reclaim passes */
+#ifndef DLIST_LFSET_RECLAIM_EVERY
+#define DLIST_LFSET_RECLAIM_EVERY     64
+#endif
+
+/* Parallel foreach: chunks per thread, for stealing to balance */
+#ifndef DLIST_FOREACH_CHUNKS_PER_THREAD
+#define DLIST_FOREACH_CHUNKS_PER_THREAD 16
+#endif
+
+/* Smallest hash index table, a power of two */
+#ifndef DLIST_INDEX_MIN_SLOTS
+#define DLIST_INDEX_MIN_SLOTS         16
+#endif
+
+struct dlist_index_slot
+{
+    uint64_t hash;
+    struct dlist_node *node;            /* NULL when the slot is free */
+};
+
+/* Open-addressing (linear probing) index from key hash to node */
+struct dlist_index
+{
+    uint64_t (*key_hash)(const void *);
+    size_t threshold;                   /* entries before building */
+    size_t mask;                        /* table size - 1, 0 if unbuilt */
+    size_t num_entries;
+    struct dlist_index_slot *slots;
+};
+
+/* Skip list towers; level 0 is the list's own prev/next chain */
+#ifndef DLIST_SKIP_MAX_LEVEL
+#define DLIST_SKIP_MAX_LEVEL          24
+#endif
+
+struct dlist_skip_node
+{
+    struct dlist_node *node;
+    unsigned level;                     /* forward pointers in next[] */
+    struct dlist_skip_node *next[];
+};
+
+struct dlist_skip
+{
+    unsigned level;                     /* highest level in use */
+    uint64_t rng;
+    struct dlist_skip_node *head[DLIST_SKIP_MAX_LEVEL];
+};
+
+/* Nodes unlinked from a DLIST_F_RCU list, chained through prev */
+struct dlist_rcu
+{
+    struct dlist_node *open;            /* retired since the last pass */
+    struct dlist_node *closed;          /* waiting for older readers */
+    uint64_t closed_epoch;
+    size_t num_open;
+};
+
+/*
+ * Links readers of a DLIST_F_RCU list follow without locks: the writer
+ * publishes them with release stores, readers use acquire loads.
+ */
+#define DLIST_RCU_LOAD(link)          __atomic_load_n(&(link), __ATOMIC_ACQUIRE)
+
+#define DLIST_LINK_STORE(list, link, node)                              \
+    do {                                                                \
+        if ((list)->rcu) {                                              \
+            __atomic_store_n(&(link), (node), __ATOMIC_RELEASE);        \
+        } else {                                                        \
+            (link) = (node);                                            \
+        }                                                               \
+    } while (0)
+
+#define DLIST_UHEAD(list)       ((struct dlist_unode *) (list)->head)
+#define DLIST_UTAIL(list)       ((struct dlist_unode *) (list)->tail)
+#define DLIST_UNODE_OF(slot)                                            \
+    ((struct dlist_unode *) ((uintptr_t) (slot) &                       \
+        ~((uintptr_t) DLIST_UNROLLED_BYTES - 1)))
+
+/* Slab of nodes handed out by the node pool */
+struct dlist_pool_chunk
+{
+    struct dlist_pool_chunk *next;
+    size_t num_nodes;
+    struct dlist_node nodes[];
+};
+
+struct dlist_pool
+{
+    struct dlist_pool_chunk *chunks;
+    struct dlist_node *free_list;       /* linked through node->next */
+    size_t chunk_nodes;
+    size_t bump;                        /* next unused node in chunks */
+    size_t refs;                        /* lists sharing the pool */
+    struct dlist_pool_stats stats;
+};
+
+/*
+ * Nodes of a bulk insert into a list without a pool: one allocation of
+ * DLIST_BATCH_BYTES aligned blocks, each starting with this header so a
+ * node finds its batch by masking.  The first block counts the nodes
+ * still in use and the batch is freed with the last of them; slots of
+ * removed nodes are not reused.
+ */
+struct dlist_batch
+{
+    struct dlist_batch *first;          /* first block of the batch */
+    size_t refs;                        /* nodes in use, first block only */
+    struct dlist_node nodes[];
+};
+
+#define DLIST_BATCH_NODES                                               \
+    ((DLIST_BATCH_BYTES - sizeof(struct dlist_batch)) /                 \
+        sizeof(struct dlist_node))
+#define DLIST_BATCH_OF(node)                                            \
+    (((struct dlist_batch *) ((uintptr_t) (node) &                      \
+        ~((uintptr_t) DLIST_BATCH_BYTES - 1)))->first)
+
+/* Smaller bulk inserts allocate each node on its own */
+#define DLIST_BATCH_MIN_NODES         (DLIST_BATCH_NODES / 2)
+
+/* Key arena block size; longer keys get a block of their own */
+#ifndef DLIST_ARENA_BLOCK_BYTES
+#define DLIST_ARENA_BLOCK_BYTES       65536
+#endif
+
+struct dlist_arena_block
+{
+    struct dlist_arena_block *next;
+    size_t used, size;
+    char bytes[];
+};
+
+/* Bump allocator for string keys, with an optional intern table */
+struct dlist_arena
+{
+    struct dlist_arena_block *blocks;   /* the first is being filled */
+    size_t block_size;
+    unsigned flags;
+    const char **intern;                /* linear probing, NULL free */
+    size_t intern_mask;                 /* table size - 1 */
+    struct dlist_arena_stats stats;
+};
+
+/**** Statistics ****/
+
+/* Compiled out without DLIST_STATS; finds update them on const lists */
+#ifdef DLIST_STATS
+static bool dlist_epoch_reading(void);
+
+/* RCU readers write nothing shared, so they leave the counters alone */
+#define DLIST_STAT_ON(list)                                             \
+    (!((list)->flags & DLIST_F_RCU) || !dlist_epoch_reading())
+#define DLIST_STAT(list)        (((struct dlist *) (list))->stats)
+#define DLIST_STAT_INC(list, field)                                     \
+    (DLIST_STAT_ON(list) ? (void) DLIST_STAT(list).field++ : (void) 0)
+#define DLIST_STAT_PEAK(list)                                           \
+    ((void) ((list)->num_entries > (list)->stats.peak_entries ?         \
+        (list)->stats.peak_entries = (list)->num_entries : 0))
+#else
+#define DLIST_STAT_INC(list, field)     ((void) 0)
+#define DLIST_STAT_PEAK(list)           ((void) 0)
+#endif
+
+static inline int dlist_key_compare(const struct dlist *list, const void *a,
+    const void *b)
+{
+    DLIST_STAT_INC(list, num_compares);
+    return list->key_compare(a, b);
+}
+
+#ifdef DLIST_STATS
+/* Close a find that started with nodes_visited at start */
+static void dlist_stats_find(const struct dlist *list, uint64_t start,
+    int hit)
+{
+    struct dlist_stats *stats = &DLIST_STAT(list);
+    uint64_t visited = stats->nodes_visited - start;
+
+    stats->num_finds++;
+    if (hit) {
+        stats->num_hits++;
+    } else {
+        stats->num_misses++;
+    }
+    if (visited > stats->max_visited) {
+        stats->max_visited = visited;
+    }
+}
+#endif
+
+
+/**** Key Arena ****/
+
+static char *dlist_arena_alloc(struct dlist_arena *arena, size_t len)
+{
+    struct dlist_arena_block *block = arena->blocks;
+    size_t size;
+    char *bytes;
+
+    if (!block || block->size - block->used < len) {
+        size = len > arena->block_size ? len : arena->block_size;
+        block = (struct dlist_arena_block *) malloc(sizeof(*block) + size);
+        if (!block) return NULL;
+        block->used = 0;
+        block->size = size;
+        if (size > arena->block_size && arena->blocks) {
+            /* Oversized: keep filling the current block */
+            block->next = arena->blocks->next;
+            arena->blocks->next = block;
+        } else {
+            block->next = arena->blocks;
+            arena->blocks = block;
+        }
+        arena->stats.num_blocks++;
+        arena->stats.bytes_reserved += size;
+    }
+    bytes = block->bytes + block->used;
+    block->used += len;
+    arena->stats.bytes_used += len;
+    return bytes;
+}
+
+static const char **dlist_arena_slot(const struct dlist_arena *arena,
+    const char *key)
+{
+    size_t i = dlist_hash_string(key) & arena->intern_mask;
+
+    while (arena->intern[i] && strcmp(arena->intern[i], key) != 0) {
+        i = (i + 1) & arena->intern_mask;
+    }
+    return &arena->intern[i];
+}
+
+/* Double the intern table, kept at most half full */
+static int dlist_arena_intern_grow(struct dlist_arena *arena)
+{
+    const char **old = arena->intern;
+    size_t i, old_slots = old ? arena->intern_mask + 1 : 0;
+    size_t num_slots = old_slots ? old_slots << 1 : DLIST_INDEX_MIN_SLOTS;
+
+    arena->intern = (const char **) calloc(num_slots, sizeof(*old));
+    if (!arena->intern) {
+        arena->intern = old;
+        return -ENOMEM;
+    }
+    arena->intern_mask = num_slots - 1;
+    for (i = 0; i < old_slots; ++i) {
+        if (old[i]) *dlist_arena_slot(arena, old[i]) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+/* Copy key into the arena, or find its interned copy */
+static char *dlist_arena_strdup(struct dlist_arena *arena, const char *key)
+{
+    const char **slot = NULL;
+    size_t len;
+    char *copy;
+
+    if (arena->flags & DLIST_ARENA_INTERN) {
+        if ((!arena->intern ||
+                (arena->stats.num_keys + 1) * 2 > arena->intern_mask + 1) &&
+            dlist_arena_intern_grow(arena) < 0) {
+            return NULL;
+        }
+        slot = dlist_arena_slot(arena, key);
+        if (*slot) {
+            arena->stats.num_shared++;
+            return (char *) *slot;
+        }
+    }
+    len = strlen(key) + 1;
+    copy = dlist_arena_alloc(arena, len);
+    if (!copy) return NULL;
+
+    memcpy(copy, key, len);
+    if (slot) *slot = copy;
+    arena->stats.num_keys++;
+    return copy;
+}
+
+/* Free every key at once: O(blocks) */
+static void dlist_arena_reset(struct dlist_arena *arena)
+{
+    struct dlist_arena_block *block, *next;
+
+    for (block = arena->blocks; block; block = next) {
+        next = block->next;
+        free(block);
+    }
+    free(arena->intern);
+    arena->blocks = NULL;
+    arena->intern = NULL;
+    arena->intern_mask = 0;
+    memset(&arena->stats, 0, sizeof(arena->stats));
+}
+
+/* The key a new entry holds: data, or a copy when the list owns keys */
+static void *dlist_key_store(struct dlist *list, void *data)
+{
+    if (list->arena) return dlist_arena_strdup(list->arena, data);
+    if (list->key_alloc) return list->key_alloc(data);
+    return data;
+}
+
+/* Undo dlist_key_store() for an entry that could not be inserted */
+static void dlist_key_unstore(struct dlist *list, void *key)
+{
+    if (!list->arena && list->key_alloc && list->key_free) {
+        list->key_free(key);
+    }
+}
+
+
+/**** Node Allocation ****/
+
+/*
+ * Start a new chunk of at least min_nodes nodes.  Whatever is left of
+ * the current chunk goes to the freelist first.
+ */
+static int dlist_pool_grow(struct dlist_pool *pool, size_t min_nodes)
+{
+    struct dlist_pool_chunk *chunk = pool->chunks;
+    size_t num_nodes = pool->chunk_nodes;
+
+    if (num_nodes < min_nodes) num_nodes = min_nodes;
+
+    chunk = (struct dlist_pool_chunk *) malloc(sizeof(*chunk) +
+        num_nodes * sizeof(struct dlist_node));
+    if (!chunk) return -ENOMEM;
+
+    if (pool->chunks) {
+        for (; pool->bump < pool->chunks->num_nodes; pool->bump++) {
+            struct dlist_node *node = &pool->chunks->nodes[pool->bump];
+            node->next = pool->free_list;
+            pool->free_list = node;
+            pool->stats.nodes_free++;
+        }
+    }
+    chunk->num_nodes = num_nodes;
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+    pool->bump = 0;
+    pool->stats.num_chunks++;
+    pool->stats.num_nodes += num_nodes;
+    return 0;
+}
+
+static struct dlist_node *dlist_pool_alloc(struct dlist_pool *pool)
+{
+    struct dlist_node *node;
+
+    if (pool->free_list) {
+        node = pool->free_list;
+        pool->free_list = node->next;
+        pool->stats.nodes_free--;
+        pool->stats.num_reuses++;
+        pool->stats.num_allocs++;
+        pool->stats.nodes_in_use++;
+        return node;
+    }
+
+    if ((!pool->chunks || pool->bump == pool->chunks->num_nodes) &&
+        dlist_pool_grow(pool, 1) < 0) {
+        return NULL;
+    }
+    pool->stats.num_allocs++;
+    pool->stats.nodes_in_use++;
+    return &pool->chunks->nodes[pool->bump++];
+}
+
+/* Make sure count nodes can be handed out with at most one malloc */
+static int dlist_pool_reserve(struct dlist_pool *pool, size_t count)
+{
+    size_t avail = pool->stats.nodes_free;
+
+    if (pool->chunks) avail += pool->chunks->num_nodes - pool->bump;
+    if (avail >= count) return 0;
+
+    return dlist_pool_grow(pool, count - pool->stats.nodes_free);
+}
+
+static void dlist_pool_free(struct dlist_pool *pool,
+    struct dlist_node *node)
+{
+    node->next = pool->free_list;
+    pool->free_list = node;
+    pool->stats.nodes_free++;
+    pool->stats.nodes_in_use--;
+    pool->stats.num_frees++;
+}
+
+static struct dlist_pool *dlist_pool_create(size_t chunk_nodes)
+{
+    struct dlist_pool *pool;
+
+    pool = (struct dlist_pool *) calloc(1, sizeof(*pool));
+    if (!pool) return NULL;
+
+    pool->chunk_nodes = chunk_nodes ? chunk_nodes : DLIST_POOL_CHUNK_NODES;
+    pool->refs = 1;
+    return pool;
+}
+
+static void dlist_pool_release(struct dlist_pool *pool)
+{
+    struct dlist_pool_chunk *chunk, *next;
+
+    if (--pool->refs) return;
+
+    for (chunk = pool->chunks; chunk; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    free(pool);
+}
+
+/*
+ * DLIST_F_STRKEYS signature: key length, saturated at 255, in the top
+ * byte over 24 bits of FNV-1a, so it fits beside hits without growing
+ * the node.  Equal strings always have equal signatures.
+ */
+static uint32_t dlist_key_sig(const void *key)
+{
+    const unsigned char *c = (const unsigned char *) key;
+    uint32_t hash = 0x811c9dc5;
+    size_t len;
+
+    for (len = 0; c[len]; ++len) {
+        hash ^= c[len];
+        hash *= 0x01000193;
+    }
+    hash = (hash ^ (hash >> 24)) & 0x00ffffff;
+    return (uint32_t) (len < 255 ? len : 255) << 24 | hash;
+}
+
+/*
+ * Room for count nodes in as few DLIST_BATCH_BYTES blocks as fit them,
+ * allocated at once.
+ */
+static struct dlist_batch *dlist_batch_create(size_t count)
+{
+    size_t i, num_blocks;
+    struct dlist_batch *batch, *block;
+
+    num_blocks = (count + DLIST_BATCH_NODES - 1) / DLIST_BATCH_NODES;
+
+    batch = (struct dlist_batch *) aligned_alloc(DLIST_BATCH_BYTES,
+        num_blocks * DLIST_BATCH_BYTES);
+    if (!batch) return NULL;
+
+    for (i = 0; i < num_blocks; ++i) {
+        block = (struct dlist_batch *) ((char *) batch +
+            i * DLIST_BATCH_BYTES);
+        block->first = batch;
+    }
+    batch->refs = count;
+    return batch;
+}
+
+/* Spliced nodes may leave a batch spread over lists of other threads */
+static void dlist_batch_put(struct dlist_node *node)
+{
+    struct dlist_batch *batch = DLIST_BATCH_OF(node);
+
+    if (!__atomic_sub_fetch(&batch->refs, 1, __ATOMIC_ACQ_REL)) {
+        free(batch);
+    }
+}
+
+static void dlist_node_free(struct dlist *list, struct dlist_node *node)
+{
+    DLIST_STAT_INC(list, num_frees);
+    if (node->batched) {
+        dlist_batch_put(node);
+    } else if (list->pool) {
+        dlist_pool_free(list->pool, node);
+    } else {
+        free(node);
+    }
+}
+
+/* Set up a node just taken from the pool, the heap or a batch */
+static bool dlist_node_init(struct dlist *list, struct dlist_node *node,
+    void *data)
+{
+    DLIST_STAT_INC(list, num_allocs);
+    node->batched = 0;
+
+    data = dlist_key_store(list, data);
+    if (!data) return false;
+
+    node->prev = node->next = NULL;
+    node->data = data;
+    node->hits = 0;
+    if (list->flags & DLIST_F_STRKEYS) {
+        node->key_sig = dlist_key_sig(data);
+    }
+    return true;
+}
+
+static struct dlist_node *dlist_node_alloc(struct dlist *list,
+    void *data)
+{
+    struct dlist_node *node;
+
+    if (list->pool) {
+        node = dlist_pool_alloc(list->pool);
+    } else {
+        node = (struct dlist_node *) malloc(sizeof(struct dlist_node));
+    }
+    if (!node) return NULL;
+
+    if (!dlist_node_init(list, node, data)) {
+        dlist_node_free(list, node);
+        return NULL;
+    }
+    return node;
+}
+
+/*
+ * Allocate count nodes for data[] as a chain linked through prev/next,
+ * in one go: from the pool, else as one batch.  Returns the first node
+ * or NULL with nothing allocated.
+ */
+static struct dlist_node *dlist_node_alloc_chain(struct dlist *list,
+    void **data, size_t count, struct dlist_node **last)
+{
+    struct dlist_node *first = NULL, *prev = NULL, *node;
+    struct dlist_batch *batch = NULL, *block = NULL;
+    size_t i, slot = 0;
+
+    if (list->pool) {
+        if (dlist_pool_reserve(list->pool, count) < 0) return NULL;
+    } else if (count >= DLIST_BATCH_MIN_NODES) {
+        batch = block = dlist_batch_create(count);
+        if (!batch) return NULL;
+    }
+    for (i = 0; i < count; ++i) {
+        if (batch) {
+            if (slot == DLIST_BATCH_NODES) {
+                block = (struct dlist_batch *) ((char *) block +
+                    DLIST_BATCH_BYTES);
+                slot = 0;
+            }
+            node = &block->nodes[slot++];
+            if (!dlist_node_init(list, node, data[i])) {
+                DLIST_STAT_INC(list, num_frees);
+                node = NULL;
+            }
+        } else {
+            node = dlist_node_alloc(list, data[i]);
+        }
+        if (!node) {
+            /* A batch is freed whole rather than node by node */
+            for (; first; first = node) {
+                node = first->next;
+                dlist_key_unstore(list, first->data);
+                if (batch) {
+                    DLIST_STAT_INC(list, num_frees);
+                } else {
+                    dlist_node_free(list, first);
+                }
+            }
+            free(batch);
+            return NULL;
+        }
+        node->batched = batch != NULL;
+        node->prev = prev;
+        if (prev) {
+            prev->next = node;
+        } else {
+            first = node;
+        }
+        prev = node;
+    }
+    *last = prev;
+    return first;
+}
+
+
+/**** Hash Index ****/
+
+static void dlist_index_drop(struct dlist_index *index)
+{
+    free(index->slots);
+    index->slots = NULL;
+    index->mask = 0;
+    index->num_entries = 0;
+}
+
+static void dlist_index_place(struct dlist_index *index, uint64_t hash,
+    struct dlist_node *node)
+{
+    size_t i = hash & index->mask;
+
+    while (index->slots[i].node) {
+        i = (i + 1) & index->mask;
+    }
+    index->slots[i].hash = hash;
+    index->slots[i].node = node;
+    index->num_entries++;
+}
+
+static int dlist_index_resize(struct dlist_index *index, size_t num_slots)
+{
+    struct dlist_index_slot *old = index->slots;
+    size_t i, old_slots = index->mask + 1;
+
+    index->slots = (struct dlist_index_slot *) calloc(num_slots,
+        sizeof(struct dlist_index_slot));
+    if (!index->slots) {
+        index->slots = old;
+        return -ENOMEM;
+    }
+    index->mask = num_slots - 1;
+    index->num_entries = 0;
+    if (old) {
+        for (i = 0; i < old_slots; ++i) {
+            if (old[i].node) {
+                dlist_index_place(index, old[i].hash, old[i].node);
+            }
+        }
+        free(old);
+    }
+    return 0;
+}
+
+/* Size the table for num entries at no more than 70% load */
+static size_t dlist_index_slots_for(size_t num)
+{
+    size_t num_slots = DLIST_INDEX_MIN_SLOTS;
+
+    while (num_slots * 7 < num * 10) {
+        num_slots <<= 1;
+    }
+    return num_slots;
+}
+
+/* Build the index over the current entries once the threshold is met */
+static void dlist_index_build(struct dlist *list)
+{
+    struct dlist_index *index = list->index;
+    struct dlist_node *entry;
+
+    if (list->num_entries < index->threshold) return;
+
+    if (dlist_index_resize(index,
+            dlist_index_slots_for(list->num_entries)) < 0) return;
+
+    for (entry = list->head; entry; entry = entry->next) {
+        dlist_index_place(index, index->key_hash(entry->data), entry);
+    }
+}
+
+/*
+ * Track a newly linked node.  If the table cannot grow the index is
+ * dropped and lookups fall back to scanning until it can be rebuilt.
+ */
+static void dlist_index_insert(struct dlist *list, struct dlist_node *node)
+{
+    struct dlist_index *index = list->index;
+
+    if (!index->slots) {
+        dlist_index_build(list);
+        return;
+    }
+    if (dlist_index_slots_for(index->num_entries + 1) > index->mask + 1 &&
+        dlist_index_resize(index, (index->mask + 1) << 1) < 0) {
+        dlist_index_drop(index);
+        return;
+    }
+    dlist_index_place(index, index->key_hash(node->data), node);
+}
+
+/* Track a chain of count nodes that was just linked in one piece */
+static void dlist_index_insert_chain(struct dlist *list,
+    struct dlist_node *first, size_t count)
+{
+    struct dlist_index *index = list->index;
+    size_t num_slots;
+
+    if (!index->slots) {
+        dlist_index_build(list);
+        return;
+    }
+    num_slots = dlist_index_slots_for(index->num_entries + count);
+    if (num_slots > index->mask + 1 &&
+        dlist_index_resize(index, num_slots) < 0) {
+        dlist_index_drop(index);
+        return;
+    }
+    for (; count--; first = first->next) {
+        dlist_index_place(index, index->key_hash(first->data), first);
+    }
+}
+
+/* Backward-shift deletion keeps probe sequences intact */
+static void dlist_index_delete(struct dlist *list, struct dlist_node *node)
+{
+    struct dlist_index *index = list->index;
+    size_t i, j, home;
+
+    if (!index->slots) return;
+
+    i = index->key_hash(node->data) & index->mask;
+    while (index->slots[i].node != node) {
+        DLIST_ASSERT(index->slots[i].node != NULL);
+        i = (i + 1) & index->mask;
+    }
+    for (j = i; ; ) {
+        j = (j + 1) & index->mask;
+        if (!index->slots[j].node) break;
+
+        home = index->slots[j].hash & index->mask;
+        if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+            index->slots[i] = index->slots[j];
+            i = j;
+        }
+    }
+    index->slots[i].node = NULL;
+    index->num_entries--;
+}
+
+static struct dlist_node *dlist_index_find(const struct dlist *list,
+    const void *key)
+{
+    struct dlist_index *index = list->index;
+    uint64_t hash = index->key_hash(key);
+    size_t i = hash & index->mask;
+
+    for (; index->slots[i].node; i = (i + 1) & index->mask) {
+        DLIST_STAT_INC(list, nodes_visited);
+        if (index->slots[i].hash == hash &&
+            dlist_key_compare(list, key, index->slots[i].node->data) == 0) {
+            return index->slots[i].node;
+        }
+    }
+    return NULL;
+}
+
+static void dlist_index_clear(struct dlist_index *index)
+{
+    if (!index->slots) return;
+
+    memset(index->slots, 0,
+        (index->mask + 1) * sizeof(struct dlist_index_slot));
+    index->num_entries = 0;
+}
+
+
+/**** Skip List ****/
+
+#define DLIST_SKIP_NEXT(skip, tower, lvl)                               \
+    ((tower) ? (tower)->next[lvl] : (skip)->head[lvl])
+
+/*
+ * Locate key in a sorted list.  Returns the first node whose key is not
+ * less than key (lower bound) or, with upper, greater than key.  update[]
+ * receives the last tower before that position on every level, NULL
+ * standing for the list head.
+ */
+static struct dlist_node *dlist_skip_search(const struct dlist *list,
+    const void *key, bool upper, struct dlist_skip_node **update)
+{
+    struct dlist_skip *skip = list->skip;
+    struct dlist_skip_node *x = NULL, *next;
+    struct dlist_node *entry;
+    unsigned lvl;
+    int rc;
+
+    for (lvl = skip->level; lvl-- > 0; ) {
+        while ((next = DLIST_SKIP_NEXT(skip, x, lvl))) {
+            DLIST_STAT_INC(list, nodes_visited);
+            rc = dlist_key_compare(list, key, next->node->data);
+            if (rc < 0 || (rc == 0 && !upper)) break;
+            x = next;
+        }
+        if (update) update[lvl] = x;
+    }
+    entry = x ? x->node->next : list->head;
+    while (entry) {
+        DLIST_STAT_INC(list, nodes_visited);
+        rc = dlist_key_compare(list, key, entry->data);
+        if (rc < 0 || (rc == 0 && !upper)) break;
+        entry = entry->next;
+    }
+    return entry;
+}
+
+/* Each tower level is kept with probability 1/4 */
+static unsigned dlist_skip_random_level(struct dlist_skip *skip)
+{
+    unsigned level = 0;
+    uint64_t r;
+
+    /* xorshift64 */
+    skip->rng ^= skip->rng << 13;
+    skip->rng ^= skip->rng >> 7;
+    skip->rng ^= skip->rng << 17;
+
+    for (r = skip->rng; (r & 3) == 0 && level < DLIST_SKIP_MAX_LEVEL;
+        r >>= 2) {
+        ++level;
+    }
+    return level;
+}
+
+/* Give a freshly linked node a tower; update[] comes from the search */
+static void dlist_skip_insert(struct dlist *list, struct dlist_node *node,
+    struct dlist_skip_node **update)
+{
+    struct dlist_skip *skip = list->skip;
+    struct dlist_skip_node *tower;
+    unsigned i, level = dlist_skip_random_level(skip);
+
+    if (!level) return;
+
+    /* A node without a tower is still found through the base chain */
+    tower = (struct dlist_skip_node *) malloc(sizeof(*tower) +
+        level * sizeof(struct dlist_skip_node *));
+    if (!tower) return;
+
+    tower->node = node;
+    tower->level = level;
+    for (i = 0; i < level; ++i) {
+        if (i >= skip->level) update[i] = NULL;
+        tower->next[i] = DLIST_SKIP_NEXT(skip, update[i], i);
+        if (update[i]) {
+            update[i]->next[i] = tower;
+        } else {
+            skip->head[i] = tower;
+        }
+    }
+    if (level > skip->level) skip->level = level;
+}
+
+/* Drop the tower of a node about to be unlinked, if it has one */
+static void dlist_skip_unlink(struct dlist *list, struct dlist_node *node)
+{
+    struct dlist_skip *skip = list->skip;
+    struct dlist_skip_node *update[DLIST_SKIP_MAX_LEVEL], *tower, *x;
+    unsigned i;
+
+    if (!skip->level) return;
+
+    dlist_skip_search(list, node->data, false, update);
+
+    /* Towers of equal keys precede it in node order */
+    for (tower = DLIST_SKIP_NEXT(skip, update[0], 0);
+        tower && tower->node != node; tower = tower->next[0]) {
+        if (dlist_key_compare(list, node->data, tower->node->data) != 0) {
+            return;
+        }
+    }
+    if (!tower) return;
+
+    for (i = 0; i < tower->level; ++i) {
+        for (x = update[i]; DLIST_SKIP_NEXT(skip, x, i) != tower;
+            x = DLIST_SKIP_NEXT(skip, x, i));
+        if (x) {
+            x->next[i] = tower->next[i];
+        } else {
+            skip->head[i] = tower->next[i];
+        }
+    }
+    while (skip->level && !skip->head[skip->level - 1]) {
+        skip->level--;
+    }
+    free(tower);
+}
+
+static void dlist_skip_clear(struct dlist_skip *skip)
+{
+    struct dlist_skip_node *tower, *next;
+
+    for (tower = skip->level ? skip->head[0] : NULL; tower; tower = next) {
+        next = tower->next[0];
+        free(tower);
+    }
+    memset(skip->head, 0, sizeof(skip->head));
+    skip->level = 0;
+}
+
+
+/**** Worker Pool ****/
+
+#ifndef DLIST_NOTHREADS
+
+/*
+ * Threads shared by all parallel operations, started on first use and
+ * kept until dlist_workers_shutdown().  A job is ntasks calls of fn,
+ * claimed through next_task by the caller and the pool threads.
+ */
+struct dlist_workers
+{
+    pthread_mutex_t job_lock;           /* one job at a time */
+    pthread_mutex_t lock;
+    pthread_cond_t wake, done;
+    pthread_t threads[DLIST_MAX_THREADS - 1];
+    unsigned num_threads;
+    unsigned num_joining;               /* threads taking part in the job */
+    unsigned num_active;                /* of those, not yet finished */
+    unsigned long generation;
+    bool shutdown;
+
+    void (*fn)(void *, size_t);
+    void *arg;
+    size_t ntasks;
+    atomic_size_t next_task;
+};
+
+static struct dlist_workers dlist_workers = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER
+};
+
+static void dlist_workers_drain(struct dlist_workers *w)
+{
+    size_t task;
+
+    while ((task = atomic_fetch_add(&w->next_task, 1)) < w->ntasks) {
+        w->fn(w->arg, task);
+    }
+}
+
+static void *dlist_workers_main(void *arg)
+{
+    struct dlist_workers *w = &dlist_workers;
+    unsigned id = (unsigned) (uintptr_t) arg;
+    unsigned long seen = 0;             /* started for the next job */
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (!w->shutdown && w->generation == seen) {
+            pthread_cond_wait(&w->wake, &w->lock);
+        }
+        if (w->shutdown) break;
+        seen = w->generation;
+        if (id >= w->num_joining) continue;
+
+        pthread_mutex_unlock(&w->lock);
+        dlist_workers_drain(w);
+        pthread_mutex_lock(&w->lock);
+        if (--w->num_active == 0) {
+            pthread_cond_signal(&w->done);
+        }
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+/*
+ * Run fn(arg, 0..ntasks-1) on up to nthreads threads including the
+ * caller and wait for all of them.  Runs with fewer threads, down to the
+ * caller alone, when the pool cannot grow.
+ */
+static void dlist_workers_run(void (*fn)(void *, size_t), void *arg,
+    size_t ntasks, unsigned nthreads)
+{
+    struct dlist_workers *w = &dlist_workers;
+
+    if (nthreads > DLIST_MAX_THREADS) nthreads = DLIST_MAX_THREADS;
+
+    pthread_mutex_lock(&w->job_lock);
+    pthread_mutex_lock(&w->lock);
+    while (w->num_threads < nthreads - 1 &&
+        pthread_create(&w->threads[w->num_threads], NULL,
+            dlist_workers_main, (void *) (uintptr_t) w->num_threads) == 0) {
+        w->num_threads++;
+    }
+    w->fn = fn;
+    w->arg = arg;
+    w->ntasks = ntasks;
+    atomic_store(&w->next_task, 0);
+    w->num_joining = w->num_active =
+        nthreads - 1 < w->num_threads ? nthreads - 1 : w->num_threads;
+    w->generation++;
+    pthread_cond_broadcast(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+
+    dlist_workers_drain(w);
+
+    pthread_mutex_lock(&w->lock);
+    while (w->num_active) {
+        pthread_cond_wait(&w->done, &w->lock);
+    }
+    pthread_mutex_unlock(&w->lock);
+    pthread_mutex_unlock(&w->job_lock);
+}
+
+DLIST_API void dlist_workers_shutdown(void)
+{
+    struct dlist_workers *w = &dlist_workers;
+    unsigned i;
+
+    pthread_mutex_lock(&w->job_lock);
+    pthread_mutex_lock(&w->lock);
+    w->shutdown = true;
+    pthread_cond_broadcast(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+
+    for (i = 0; i < w->num_threads; ++i) {
+        pthread_join(w->threads[i], NULL);
+    }
+    w->num_threads = 0;
+    w->shutdown = false;
+    pthread_mutex_unlock(&w->job_lock);
+}
+
+#else
+
+DLIST_API void dlist_workers_shutdown(void)
+{
+}
+
+#endif
+
+
+/**** Epoch Reclamation ****/
+
+/*
+ * Readers publish the global epoch they entered in.  Memory unlinked
+ * and then stamped with epoch s is freed once every reader still inside
+ * entered after s; reclaimers bump the epoch so new stamps move on.
+ * Each thread owns one record, recycled by a new thread after exit.
+ */
+struct dlist_epoch_rec
+{
+    atomic_uint_fast64_t active;        /* entered epoch, 0 outside */
+    atomic_int in_use;                  /* owned by a live thread */
+    unsigned nesting;
+    struct dlist_epoch_rec *next;
+};
+
+/*
+ * Store a reader's epoch with a full barrier behind it, but no atomic
+ * read-modify-write.  ThreadSanitizer does not model fences.
+ */
+#ifdef __SANITIZE_THREAD__
+#define DLIST_EPOCH_PUBLISH(active, epoch)                              \
+    ((void) atomic_exchange((active), (epoch)))
+#else
+#define DLIST_EPOCH_PUBLISH(active, epoch)                              \
+    (atomic_store_explicit((active), (epoch), memory_order_relaxed),    \
+     atomic_thread_fence(memory_order_seq_cst))
+#endif
+
+static atomic_uint_fast64_t dlist_epoch = 1;
+static struct dlist_epoch_rec *_Atomic dlist_epoch_recs;
+static _Thread_local struct dlist_epoch_rec *dlist_epoch_self;
+
+#ifdef DLIST_STATS
+/* Inside a dlist_epoch_enter()/dlist_epoch_exit() section */
+static bool dlist_epoch_reading(void)
+{
+    return dlist_epoch_self && dlist_epoch_self->nesting;
+}
+#endif
+
+#ifndef DLIST_NOTHREADS
+static pthread_key_t dlist_epoch_key;
+static pthread_once_t dlist_epoch_once = PTHREAD_ONCE_INIT;
+
+static void dlist_epoch_thread_exit(void *arg)
+{
+    struct dlist_epoch_rec *rec = (struct dlist_epoch_rec *) arg;
+
+    rec->nesting = 0;
+    atomic_store(&rec->active, 0);
+    atomic_store(&rec->in_use, 0);
+}
+
+static void dlist_epoch_key_create(void)
+{
+    pthread_key_create(&dlist_epoch_key, dlist_epoch_thread_exit);
+}
+#endif
+
+static struct dlist_epoch_rec *dlist_epoch_rec_get(void)
+{
+    struct dlist_epoch_rec *rec;
+    int unused;
+
+    if (dlist_epoch_self) return dlist_epoch_self;
+
+    for (rec = atomic_load(&dlist_epoch_recs); rec; rec = rec->next) {
+        unused = 0;
+        if (atomic_compare_exchange_strong(&rec->in_use, &unused, 1)) break;
+    }
+    if (!rec) {
+        rec = (struct dlist_epoch_rec *) calloc(1, sizeof(*rec));
+        if (!rec) return NULL;
+
+        atomic_init(&rec->in_use, 1);
+        rec->next = atomic_load(&dlist_epoch_recs);
+        while (!atomic_compare_exchange_weak(&dlist_epoch_recs, &rec->next,
+                rec)) {
+        }
+    }
+#ifndef DLIST_NOTHREADS
+    pthread_once(&dlist_epoch_once, dlist_epoch_key_create);
+    pthread_setspecific(dlist_epoch_key, rec);
+#endif
+    dlist_epoch_self = rec;
+    return rec;
+}
+
+DLIST_API int dlist_epoch_enter(void)
+{
+    struct dlist_epoch_rec *rec = dlist_epoch_rec_get();
+
+    if (!rec) return -ENOMEM;
+
+    if (rec->nesting++ == 0) {
+        /* Published before any shared pointer is read */
+        DLIST_EPOCH_PUBLISH(&rec->active, atomic_load(&dlist_epoch));
+    }
+    return 0;
+}
+
+DLIST_API void dlist_epoch_exit(void)
+{
+    struct dlist_epoch_rec *rec = dlist_epoch_self;
+
+    DLIST_ASSERT(rec != NULL && rec->nesting > 0);
+
+    if (--rec->nesting == 0) {
+        atomic_store_explicit(&rec->active, 0, memory_order_release);
+    }
+}
+
+/* Stamp for memory just unlinked by a seq_cst CAS */
+static uint64_t dlist_epoch_now(void)
+{
+    return atomic_load(&dlist_epoch);
+}
+
+/*
+ * Start a new epoch and return the oldest one a reader is still in:
+ * memory stamped before it is unreachable.
+ */
+static uint64_t dlist_epoch_advance(void)
+{
+    struct dlist_epoch_rec *rec;
+    uint64_t oldest, active;
+
+    oldest = atomic_fetch_add(&dlist_epoch, 1) + 1;
+    for (rec = atomic_load(&dlist_epoch_recs); rec; rec = rec->next) {
+        active = atomic_load(&rec->active);
+        if (active && active < oldest) oldest = active;
+    }
+    return oldest;
+}
+
+
+/**** RCU Reclamation ****/
+
+static void dlist_rcu_free_chain(struct dlist *list, struct dlist_node *node)
+{
+    struct dlist_node *prev;
+
+    for (; node; node = prev) {
+        prev = node->prev;
+        if (list->key_free) {
+            list->key_free(node->data);
+        }
+        dlist_node_free(list, node);
+    }
+}
+
+/*
+ * Nodes retired since the last pass are closed with the current epoch;
+ * a later pass frees them once every reader inside entered after it.
+ */
+DLIST_API void dlist_rcu_reclaim(struct dlist *list)
+{
+    struct dlist_rcu *rcu;
+    uint64_t oldest;
+
+    DLIST_ASSERT(list != NULL);
+
+    rcu = list->rcu;
+    if (!rcu || (!rcu->open && !rcu->closed)) return;
+
+    oldest = dlist_epoch_advance();
+    if (rcu->closed && rcu->closed_epoch < oldest) {
+        dlist_rcu_free_chain(list, rcu->closed);
+        rcu->closed = NULL;
+    }
+    if (!rcu->closed && rcu->open) {
+        rcu->closed = rcu->open;
+        rcu->closed_epoch = dlist_epoch_now();
+        rcu->open = NULL;
+        rcu->num_open = 0;
+    }
+}
+
+DLIST_API void dlist_rcu_barrier(struct dlist *list)
+{
+    DLIST_ASSERT(list != NULL);
+
+    while (list->rcu && (list->rcu->open || list->rcu->closed)) {
+        dlist_rcu_reclaim(list);
+        if (list->rcu->closed) DLIST_CPU_RELAX();
+    }
+}
+
+/* Readers may still be on entry: keep it and its data for now */
+static void dlist_rcu_retire(struct dlist *list, struct dlist_node *entry)
+{
+    struct dlist_rcu *rcu = list->rcu;
+
+    entry->prev = rcu->open;
+    rcu->open = entry;
+    if (++rcu->num_open >= DLIST_RCU_RECLAIM_EVERY) {
+        dlist_rcu_reclaim(list);
+    }
+}
+
+
+/**** Utility Functions ****/
+
+/* Generic search func for a given key. 
+ * Returns NULL if key is invalid.
+*/
+static struct dlist_node *dlist_search_entry(const struct dlist *list,
+    const void *key)
+{
+    struct dlist_node *entry;
+    uint32_t sig = 0;
+
+    if (list->index && list->index->slots) {
+        return dlist_index_find(list, key);
+    }
+    if (list->skip) {
+        entry = dlist_skip_search(list, key, false, NULL);
+        return entry && dlist_key_compare(list, key, entry->data) == 0 ?
+            entry : NULL;
+    }
+
+    if (list->flags & DLIST_F_STRKEYS) {
+        sig = dlist_key_sig(key);
+    }
+
+    if (list->rcu) {
+        for (entry = DLIST_RCU_LOAD(list->head); entry;
+                entry = DLIST_RCU_LOAD(entry->next)) {
+            DLIST_STAT_INC(list, nodes_visited);
+            if ((!(list->flags & DLIST_F_STRKEYS) || entry->key_sig == sig) &&
+                dlist_key_compare(list, key, entry->data) == 0) {
+                return entry;
+            }
+        }
+        return NULL;
+    }
+
+    if (list->flags & DLIST_F_STRKEYS) {
+        for (entry = list->head; entry; entry = entry->next) {
+            DLIST_STAT_INC(list, nodes_visited);
+            if (entry->key_sig == sig &&
+                dlist_key_compare(list, key, entry->data) == 0) {
+                return entry;
+            }
+        }
+        return NULL;
+    }
+
+    for(entry = list->head; entry; ) 
+    {   
+        DLIST_STAT_INC(list, nodes_visited);
+        if (dlist_key_compare(list, key, entry->data) == 0) {
+            return entry;
+        }
+        entry = entry->next;
+    }
+    return NULL;
+}
+
+static struct dlist_node *dlist_find_entry(const struct dlist *list,
+    const void *key)
+{
+#ifdef DLIST_STATS
+    uint64_t start;
+    struct dlist_node *entry;
+
+    if (!DLIST_STAT_ON(list)) return dlist_search_entry(list, key);
+
+    start = DLIST_STAT(list).nodes_visited;
+    entry = dlist_search_entry(list, key);
+    dlist_stats_find(list, start, entry != NULL);
+    return entry;
+#else
+    return dlist_search_entry(list, key);
+#endif
+}
+
+static void dlist_link_tail(struct dlist *list, struct dlist_node *entry)
+{
+    if (list->tail) {
+        /* Join the two final nodes together. */
+        entry->prev = list->tail;
+        DLIST_LINK_STORE(list, list->tail->next, entry);
+        list->tail = entry;
+    } else {
+        DLIST_LINK_STORE(list, list->head, entry);
+        list->tail = entry;
+    }
+    list->num_entries++;
+    DLIST_STAT_PEAK(list);
+    if (list->index) {
+        dlist_index_insert(list, entry);
+    }
+}
+
+static void dlist_link_head(struct dlist *list, struct dlist_node *entry)
+{
+    if (list->head) {
+        entry->next = list->head;
+        list->head->prev = entry;
+        DLIST_LINK_STORE(list, list->head, entry);
+    } else {
+        DLIST_LINK_STORE(list, list->head, entry);
+        list->tail = entry;
+    }
+    list->num_entries++;
+    DLIST_STAT_PEAK(list);
+    if (list->index) {
+        dlist_index_insert(list, entry);
+    }
+}
+
+/* Link a prev/next chain of count nodes in one piece */
+static void dlist_link_chain(struct dlist *list, struct dlist_node *first,
+    struct dlist_node *last, size_t count, bool at_head)
+{
+    if (!list->head) {
+        DLIST_LINK_STORE(list, list->head, first);
+        list->tail = last;
+    } else if (at_head) {
+        last->next = list->head;
+        list->head->prev = last;
+        DLIST_LINK_STORE(list, list->head, first);
+    } else {
+        first->prev = list->tail;
+        DLIST_LINK_STORE(list, list->tail->next, first);
+        list->tail = last;
+    }
+    list->num_entries += count;
+    DLIST_STAT_PEAK(list);
+    if (list->index) {
+        dlist_index_insert_chain(list, first, count);
+    }
+}
+
+/* Link entry in front of pos, or at the tail if pos is NULL */
+static void dlist_link_before(struct dlist *list, struct dlist_node *pos,
+    struct dlist_node *entry)
+{
+    if (!pos) {
+        dlist_link_tail(list, entry);
+    } else if (!pos->prev) {
+        dlist_link_head(list, entry);
+    } else {
+        entry->prev = pos->prev;
+        entry->next = pos;
+        DLIST_LINK_STORE(list, pos->prev->next, entry);
+        pos->prev = entry;
+        list->num_entries++;
+        DLIST_STAT_PEAK(list);
+        if (list->index) {
+            dlist_index_insert(list, entry);
+        }
+    }
+}
+
+/* Sorted lists insert after any equal keys, keeping insertion order */
+static void dlist_link_sorted(struct dlist *list, struct dlist_node *entry)
+{
+    struct dlist_skip_node *update[DLIST_SKIP_MAX_LEVEL];
+
+    dlist_link_before(list,
+        dlist_skip_search(list, entry->data, true, update), entry);
+    dlist_skip_insert(list, entry, update);
+}
+
+/*
+ * Move entry in front of pos within the same list.  Only the chain
+ * changes; the hash index still maps to the same node.
+ */
+static void dlist_move_before(struct dlist *list, struct dlist_node *pos,
+    struct dlist_node *entry)
+{
+    if (entry == pos || entry->next == pos) return;
+
+    /* Detach */
+    entry->prev->next = entry->next;
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        list->tail = entry->prev;
+    }
+    /* Reattach */
+    entry->prev = pos->prev;
+    entry->next = pos;
+    if (pos->prev) {
+        pos->prev->next = entry;
+    } else {
+        list->head = entry;
+    }
+    pos->prev = entry;
+}
+
+static void dlist_reorganize(struct dlist *list, struct dlist_node *entry)
+{
+    struct dlist_node *pos;
+
+    if (list->search_policy == DLIST_SEARCH_COUNT &&
+        entry->hits < DLIST_HITS_MAX) {
+        entry->hits++;
+    }
+    if (!entry->prev) return;
+
+    switch (list->search_policy) {
+    case DLIST_SEARCH_MOVE_TO_FRONT:
+        dlist_move_before(list, list->head, entry);
+        break;
+    case DLIST_SEARCH_TRANSPOSE:
+        dlist_move_before(list, entry->prev, entry);
+        break;
+    case DLIST_SEARCH_COUNT:
+        for (pos = entry; pos->prev && pos->prev->hits < entry->hits;
+            pos = pos->prev);
+        dlist_move_before(list, pos, entry);
+        break;
+    default:
+        break;
+    }
+}
+
+static void dlist_unlink(struct dlist *list, struct dlist_node *entry)
+{
+    if (list->index) {
+        dlist_index_delete(list, entry);
+    }
+    if (list->skip) {
+        dlist_skip_unlink(list, entry);
+    }
+    /* entry->next stays intact for readers still on entry */
+    if (entry->prev) {
+        DLIST_LINK_STORE(list, entry->prev->next, entry->next);
+    } else {
+        DLIST_LINK_STORE(list, list->head, entry->next);
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        list->tail = entry->prev;
+    }
+    list->num_entries--;
+}
+
+static void dlist_remove_entry(struct dlist *list, 
+     struct dlist_node *del_entry)
+{
+    if (list->rcu) {
+        dlist_unlink(list, del_entry);
+        dlist_rcu_retire(list, del_entry);
+        return;
+    }
+    if (list->key_free)  {
+        list->key_free(del_entry->data);
+    } 
+    dlist_unlink(list, del_entry);
+    dlist_node_free(list, del_entry);
+}
+
+
+/**** Unrolled Backend ****/
+
+static struct dlist_unode *dlist_unode_alloc(void)
+{
+    struct dlist_unode *unode;
+
+    unode = (struct dlist_unode *) aligned_alloc(DLIST_UNROLLED_BYTES,
+        sizeof(struct dlist_unode));
+    if (!unode) return NULL;
+
+    unode->prev = unode->next = NULL;
+    unode->count = 0;
+    return unode;
+}
+
+static void dlist_unode_link_after(struct dlist *list,
+    struct dlist_unode *pos, struct dlist_unode *unode)
+{
+    unode->prev = pos;
+    unode->next = pos ? pos->next : DLIST_UHEAD(list);
+    if (unode->next) {
+        unode->next->prev = unode;
+    } else {
+        list->tail = (struct dlist_node *) unode;
+    }
+    if (pos) {
+        pos->next = unode;
+    } else {
+        list->head = (struct dlist_node *) unode;
+    }
+}
+
+static void dlist_unode_unlink(struct dlist *list,
+    struct dlist_unode *unode)
+{
+    if (unode->prev) {
+        unode->prev->next = unode->next;
+    } else {
+        list->head = (struct dlist_node *) unode->next;
+    }
+    if (unode->next) {
+        unode->next->prev = unode->prev;
+    } else {
+        list->tail = (struct dlist_node *) unode->prev;
+    }
+    DLIST_STAT_INC(list, num_frees);
+    free(unode);
+}
+
+static void **dlist_unrolled_append(struct dlist *list, void *data)
+{
+    struct dlist_unode *unode = DLIST_UTAIL(list);
+
+    data = dlist_key_store(list, data);
+    if (!data) return NULL;
+    if (!unode || unode->count == DLIST_UNROLLED_SLOTS) {
+        unode = dlist_unode_alloc();
+        if (!unode) {
+            dlist_key_unstore(list, data);
+            return NULL;
+        }
+        DLIST_STAT_INC(list, num_allocs);
+        dlist_unode_link_after(list, DLIST_UTAIL(list), unode);
+    }
+    unode->slots[unode->count] = data;
+    list->num_entries++;
+    DLIST_STAT_PEAK(list);
+    return &unode->slots[unode->count++];
+}
+
+static void **dlist_unrolled_add(struct dlist *list, void *data)
+{
+    struct dlist_unode *unode = DLIST_UHEAD(list);
+
+    data = dlist_key_store(list, data);
+    if (!data) return NULL;
+    if (!unode || unode->count == DLIST_UNROLLED_SLOTS) {
+        unode = dlist_unode_alloc();
+        if (!unode) {
+            dlist_key_unstore(list, data);
+            return NULL;
+        }
+        DLIST_STAT_INC(list, num_allocs);
+        dlist_unode_link_after(list, NULL, unode);
+    }
+    memmove(&unode->slots[1], &unode->slots[0],
+        unode->count * sizeof(void *));
+    unode->slots[0] = data;
+    unode->count++;
+    list->num_entries++;
+    DLIST_STAT_PEAK(list);
+    return &unode->slots[0];
+}
+
+static void **dlist_unrolled_search(const struct dlist *list,
+    const void *key)
+{
+    struct dlist_unode *unode;
+    size_t i;
+
+    for (unode = DLIST_UHEAD(list); unode; unode = unode->next) {
+        for (i = 0; i < unode->count; ++i) {
+            DLIST_STAT_INC(list, nodes_visited);
+            if (dlist_key_compare(list, key, unode->slots[i]) == 0) {
+                return &unode->slots[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+static void **dlist_unrolled_find(const struct dlist *list,
+    const void *key)
+{
+#ifdef DLIST_STATS
+    uint64_t start = DLIST_STAT(list).nodes_visited;
+    void **slot = dlist_unrolled_search(list, key);
+
+    dlist_stats_find(list, start, slot != NULL);
+    return slot;
+#else
+    return dlist_unrolled_search(list, key);
+#endif
+}
+
+/*
+ * Drop the entry in slot and return the slot of the entry that followed
+ * it.  A node that falls under half full absorbs its successor when
+ * both fit, which leaves the returned position unchanged.
+ */
+static void **dlist_unrolled_remove_slot(struct dlist *list, void **slot)
+{
+    struct dlist_unode *unode = DLIST_UNODE_OF(slot);
+    struct dlist_unode *next = unode->next;
+    size_t idx = slot - unode->slots;
+
+    if (list->key_free) {
+        list->key_free(*slot);
+    }
+    list->num_entries--;
+
+    if (--unode->count == 0) {
+        dlist_unode_unlink(list, unode);
+        return next ? &next->slots[0] : NULL;
+    }
+    memmove(&unode->slots[idx], &unode->slots[idx + 1],
+        (unode->count - idx) * sizeof(void *));
+
+    if (next && unode->count < DLIST_UNROLLED_SLOTS / 2 &&
+        unode->count + next->count <= DLIST_UNROLLED_SLOTS) {
+        memcpy(&unode->slots[unode->count], next->slots,
+            next->count * sizeof(void *));
+        unode->count += next->count;
+        dlist_unode_unlink(list, next);
+        next = unode->next;
+    }
+    if (idx < unode->count) return &unode->slots[idx];
+    return next ? &next->slots[0] : NULL;
+}
+
+static void dlist_unrolled_clear(struct dlist *list)
+{
+    struct dlist_unode *unode, *next;
+    size_t i;
+
+    for (unode = DLIST_UHEAD(list); unode; unode = next) {
+        next = unode->next;
+        if (list->key_free) {
+            for (i = 0; i < unode->count; ++i) {
+                list->key_free(unode->slots[i]);
+            }
+        }
+        DLIST_STAT_INC(list, num_frees);
+        free(unode);
+    }
+}
+
+static int dlist_unrolled_foreach(const struct dlist *list,
+    int (*func)(const void *, void *), void *arg)
+{
+    struct dlist_unode *unode = DLIST_UHEAD(list), *prev;
+    size_t idx = 0, num_entries;
+    int rc;
+
+    while (unode) {
+        if (idx == unode->count) {
+            unode = unode->next;
+            idx = 0;
+            continue;
+        }
+        num_entries = list->num_entries;
+        prev = unode->prev;
+        rc = func(unode->slots[idx], arg);
+        if (rc < 0) return rc;
+        if (rc > 0) return 0;
+
+        if (num_entries == list->num_entries) {
+            ++idx;
+        } else if (num_entries != list->num_entries + 1) {
+            /* Stop immediately if func put/removed another entry */
+            return -1;
+        } else if ((prev ? prev->next : DLIST_UHEAD(list)) != unode) {
+            /* func removed the last entry of this node */
+            unode = prev ? prev->next : DLIST_UHEAD(list);
+            idx = 0;
+        }
+        /* else func removed the current entry, its successor took idx */
+    }
+    return 0;
+}
+
+
+
+/**** Initialization ****/
+DLIST_API int dlist_init(struct dlist *list, 
+    int (*key_compare_cb)(const void *, const void *))
+{
+    return dlist_init_flags(list, key_compare_cb, 0);
+}
+
+DLIST_API int dlist_init_flags(struct dlist *list,
+    int (*key_compare_cb)(const void *, const void *), unsigned flags)
+{
+    DLIST_ASSERT(list != NULL);
+
+    if ((flags & DLIST_F_UNROLLED) && (flags & DLIST_F_SORTED)) {
+        return -EINVAL;
+    }
+    if ((flags & DLIST_F_RCU) &&
+        (flags & (DLIST_F_UNROLLED | DLIST_F_SORTED))) {
+        return -EINVAL;
+    }
+    if ((flags & DLIST_F_STRKEYS) && (flags & DLIST_F_UNROLLED)) {
+        return -EINVAL;
+    }
+
+    list->head = list->tail = 0;
+    list->num_entries = 0;
+
+    list->key_compare = key_compare_cb ?
+        key_compare_cb : dlist_compare_string;
+
+    list->key_alloc = NULL;
+    list->key_free = NULL;
+    list->pool = NULL;
+    list->index = NULL;
+    list->skip = NULL;
+    list->rcu = NULL;
+    list->arena = NULL;
+    list->search_policy = DLIST_SEARCH_NONE;
+    list->flags = flags;
+#ifdef DLIST_STATS
+    memset(&list->stats, 0, sizeof(list->stats));
+#endif
+
+    if (flags & DLIST_F_SORTED) {
+        list->skip = (struct dlist_skip *) calloc(1, sizeof(*list->skip));
+        if (!list->skip) return -ENOMEM;
+        list->skip->rng = 0x9e3779b97f4a7c15ULL;
+    }
+    if (flags & DLIST_F_RCU) {
+        list->rcu = (struct dlist_rcu *) calloc(1, sizeof(*list->rcu));
+        if (!list->rcu) return -ENOMEM;
+    }
+    return 0;
+}
+
+DLIST_API void dlist_destroy(struct dlist *list)
+{
+    if (!list) return;
+
+    dlist_clear(list);
+    if (list->rcu) {
+        /* No readers are left: free what they were waiting on */
+        dlist_rcu_free_chain(list, list->rcu->open);
+        dlist_rcu_free_chain(list, list->rcu->closed);
+        free(list->rcu);
+    }
+    if (list->pool) {
+        dlist_pool_release(list->pool);
+    }
+    if (list->index) {
+        dlist_index_drop(list->index);
+        free(list->index);
+    }
+    free(list->skip);
+    if (list->arena) {
+        dlist_arena_reset(list->arena);
+        free(list->arena);
+    }
+    memset(list, 0, sizeof(*list));
+}
+
+DLIST_API int dlist_pool_enable(struct dlist *list, size_t chunk_nodes)
+{
+    struct dlist_pool *pool;
+
+    DLIST_ASSERT(list != NULL);
+
+    if (list->flags & DLIST_F_UNROLLED) return -EINVAL;
+    if (list->pool) return -EEXIST;
+    if (list->head) return -EBUSY;
+
+    pool = dlist_pool_create(chunk_nodes);
+    if (!pool) return -ENOMEM;
+
+    list->pool = pool;
+    return 0;
+}
+
+DLIST_API int dlist_pool_get_stats(const struct dlist *list,
+    struct dlist_pool_stats *stats)
+{
+    DLIST_ASSERT(list != NULL);
+    DLIST_ASSERT(stats != NULL);
+
+    if (!list->pool) return -ENOENT;
+
+    *stats = list->pool->stats;
+    return 0;
+}
+
+DLIST_API int dlist_set_search_policy(struct dlist *list,
+    enum dlist_search_policy policy)
+{
+    DLIST_ASSERT(list != NULL);
+
+    if (list->flags & (DLIST_F_UNROLLED | DLIST_F_SORTED | DLIST_F_RCU)) {
+        return -EINVAL;
+    }
+    if (policy > DLIST_SEARCH_COUNT) return -EINVAL;
+
+    list->search_policy = policy;
+    return 0;
+}
+
+DLIST_API int dlist_index_enable(struct dlist *list,
+    uint64_t (*key_hash_cb)(const void *), size_t threshold)
+{
+    struct dlist_index *index;
+
+    DLIST_ASSERT(list != NULL);
+    DLIST_ASSERT(key_hash_cb != NULL);
+
+    if (list->flags & (DLIST_F_UNROLLED | DLIST_F_RCU)) return -EINVAL;
+    if (list->index) return -EEXIST;
+
+    index = (struct dlist_index *) calloc(1, sizeof(*index));
+    if (!index) return -ENOMEM;
+
+    index->key_hash = key_hash_cb;
+    index->threshold = threshold;
+    list->index = index;
+    dlist_index_build(list);
+    return 0;
+}
+
+
+/*
+ * Enable internal memory management.
+ */
+DLIST_API int dlist_set_key_alloc_funcs(struct dlist *list, 
+    void *(*key_alloc_cb)(const void *), void (*key_free_cb)(void *))
+{
+    DLIST_ASSERT(list != NULL);
+
+    /* Arena keys must never reach key_free */
+    if (list->arena) return -EINVAL;
+
+    list->key_alloc = key_alloc_cb;
+    list->key_free = key_free_cb;
+    return 0;
+}
+
+DLIST_API int dlist_key_arena_enable(struct dlist *list, size_t block_size,
+    unsigned flags)
+{
+    struct dlist_arena *arena;
+
+    DLIST_ASSERT(list != NULL);
+
+    if (list->rcu) return -EINVAL;
+    if (list->arena) return -EEXIST;
+    if (list->num_entries) return -EBUSY;
+
+    arena = (struct dlist_arena *) calloc(1, sizeof(*arena));
+    if (!arena) return -ENOMEM;
+
+    arena->block_size = block_size ? block_size : DLIST_ARENA_BLOCK_BYTES;
+    arena->flags = flags;
+    list->arena = arena;
+    list->key_alloc = NULL;
+    list->key_free = NULL;
+    return 0;
+}
+
+DLIST_API int dlist_key_arena_get_stats(const struct dlist *list,
+    struct dlist_arena_stats *stats)
+{
+    DLIST_ASSERT(list != NULL);
+    DLIST_ASSERT(stats != NULL);
+
+    if (!list->arena) return -EINVAL;
+
+    *stats = list->arena->stats;
+    return 0;
+}
+
+
+/**** Status ****/
+DLIST_API int dlist_is_empty(struct dlist *list)
+{
+    return list->head == NULL ? 1 : 0;
+}
+
+DLIST_API size_t dlist_len(struct dlist *list)
+{
+    DLIST_ASSERT(list != NULL);
+    return list->num_entries;
+}
+
+DLIST_API int dlist_stats_get(const struct dlist *list,
+    struct dlist_stats *stats)
+{
+    DLIST_ASSERT(list != NULL);
+    DLIST_ASSERT(stats != NULL);
+
+#ifdef DLIST_STATS
+    *stats = list->stats;
+    stats->mean_visited = stats->num_finds ?
+        (double) stats->nodes_visited / stats->num_finds : 0;
+    return 0;
+#else
+    memset(stats, 0, sizeof(*stats));
+    return -ENOTSUP;
+#endif
+}
+
+DLIST_API void dlist_stats_reset(struct dlist *list)
+{
+    DLIST_ASSERT(list != NULL);
+
+#ifdef DLIST_STATS
+    memset(&list->stats, 0, sizeof(list->stats));
+    list->stats.peak_entries = list->num_entries;
+#endif
+}
+
+
+
+/**** Data Modification ****/
+DLIST_API void *dlist_get_data(struct dlist *list, void *data)
+{
+     struct dlist_node *entry;
+
+     DLIST_ASSERT(list != NULL);
+     DLIST_ASSERT(data != NULL);
+
+     if (list->flags & DLIST_F_UNROLLED) {
+         void **slot = dlist_unrolled_find(list, data);
+         return slot ? *slot : NULL;
+     }
+
+     entry = dlist_find_entry(list, data);
+     if (!entry) return NULL;
+
+     if (list->search_policy) {
+         dlist_reorganize(list, entry);
+     }
+     return entry->data;
+}
+
+DLIST_API void *dlist_remove(struct dlist *list, const void *key)
+{
+    struct dlist_node *entry;
+    void *data;
+
+    DLIST_ASSERT(list != NULL);
+    DLIST_ASSERT(key != NULL);
+
+    if (list->flags & DLIST_F_UNROLLED) {
+        void **slot = dlist_unrolled_find(list, key);
+        if (!slot)
+            return NULL;
+        data = *slot;
+        dlist_unrolled_remove_slot(list, slot);
+        return data;
+    }
+
+    entry = dlist_find_entry(list, key);
+    if (!entry) 
+        return NULL;
+
+    data = entry->data;
+    dlist_remove_entry(list, entry);
+    return data;
+}
+
+DLIST_API void *dlist_append(struct dlist *list,  void *data)
+{
+    // Initialize Tail Link 
+    struct dlist_node *new_node;
+    void **slot;
+
+    DLIST_ASSERT(list != NULL);
+
+    if (list->flags & DLIST_F_UNROLLED) {
+        slot = dlist_unrolled_append(list, data);
+        return slot ? *slot : NULL;
+    }
+
+    new_node = dlist_node_alloc(list, data);
+    if (!new_node) return NULL;
+
+    if (list->skip) {
+        dlist_link_sorted(list, new_node);
+    } else {
+        dlist_link_tail(list, new_node);
+    }
+    return new_node->data;
+}
+
+DLIST_API void *dlist_add(struct dlist *list, void *data)
+{
+     // Initialize Head Link 
+    struct dlist_node *new_node;
+    void **slot;
+
+    DLIST_ASSERT(list != NULL);
+
+    if (list->flags & DLIST_F_UNROLLED) {
+        slot = dlist_unrolled_add(list, data);
+        return slot ? *slot : NULL;
+    }
+
+    new_node = dlist_node_alloc(list, data);
+    if (!new_node) return NULL;
+
+    if (list->skip) {
+        dlist_link_sorted(list, new_node);
+    } else {
+        dlist_link_head(list, new_node);
+    }
+    return new_node->data;
+}
+
+/*
+ * Shared by the bulk inserts.  Linked lists get all nodes at once and
+ * link them in one pass; data[] order is kept for append and reversed
+ * for add, as if each element went through dlist_append/dlist_add.
+ */
+static int dlist_insert_bulk(struct dlist *list, void **data, size_t count,
+    bool at_head)
+{
+    struct dlist_node *first, *last, *entry, *next;
+    size_t i;
+
+    DLIST_ASSERT(list != NULL);
+    DLIST_ASSERT(data != NULL || count == 0);
+
+    if (!count) return 0;
+
+    if (list->flags & DLIST_F_UNROLLED) {
+        for (i = 0; i < count; ++i) {
+            if (!(at_head ? dlist_unrolled_add(list, data[i]) :
+                dlist_unrolled_append(list, data[i]))) {
+                return -ENOMEM;
+            }
+        }
+        return 0;
+    }
+
+    first = dlist_node_alloc_chain(list, data, count, &last);
+    if (!first) return -ENOMEM;
+
+    if (list->skip) {
+        for (entry = first; entry; entry = next) {
+            next = entry->next;
+            entry->prev = entry->next = NULL;
+            dlist_link_sorted(list, entry);
+        }
+        return 0;
+    }
+    if (at_head) {
+        /* Reverse the chain so data[count - 1] ends up at the head */
+        for (entry = first; entry; entry = entry->prev) {
+            next = entry->next;
+            entry->next = entry->prev;
+            entry->prev = next;
+        }
+        entry = first;
+        first = last;
+        last = entry;
+    }
+    dlist_link_chain(list, first, last, count, at_head);
+    return 0;
+}
+
+DLIST_API int dlist_append_bulk(struct dlist *list, void **data, size_t count)
+{
+    return dlist_insert_bulk(list, data, count, false);
+}
+
+DLIST_API int dlist_add_bulk(struct dlist *list, void **data, size_t count)
+{
+    return dlist_insert_bulk(list, data, count, true);
+}
+
+/*
+ * Single pass over the list unlinking every entry pred accepts.  Removed
+ * nodes are freed along with their data, or with out, moved to out.
+ */
+static size_t dlist_remove_matching(struct dlist *list,
+    int (*pred)(const void *, void *), void *arg, struct dlist *out)
+{
+    struct dlist_node *entry, *next;
+    size_t num_removed = 0;
+
+    for (entry = list->head; entry; entry = next) {
+        next = entry->next;
+        if (!pred(entry->data, arg)) continue;
+
+        if (out) {
+            dlist_unlink(list, entry);
+            entry->prev = entry->next = NULL;
+            dlist_link_tail(out, entry);
+        } else {
+            dlist_remove_entry(list, entry);
+        }
+        ++num_removed;
+    }
+    return num_removed;
+}
+
+static size_t dlist_unrolled_remove_matching(struct dlist *list,
+    int (*pred)(const void *, void *), void *arg)
+{
+    struct dlist_unode *unode, *next;
+    size_t i, j, num_removed = 0;
+
+    for (unode = DLIST_UHEAD(list); unode; unode = next) {
+        next = unode->next;
+        for (i = j = 0; i < unode->count; ++i) {
+            if (!pred(unode->slots[i], arg)) {
+                unode->slots[j++] = unode->slots[i];
+            } else if (list->key_free) {
+                list->key_free(unode->slots[i]);
+            }
+        }
+        num_removed += unode->count - j;
+        unode->count = j;
+        if (!j) dlist_unode_unlink(list, unode);
+    }
+    list->num_entries -= num_removed;
+    return num_removed;
+}
+
+DLIST_API size_t dlist_remove_if(struct dlist *list,
+    int (*pred)(const void *, void *), void *arg)
+{
+    DLIST_ASSERT(list != NULL);
+    DLIST_ASSERT(pred != NULL);
+
+    if (list->flags & DLIST_F_UNROLLED) {
+        return dlist_unrolled_remove_matching(list, pred, arg);
+    }
+    return dlist_remove_matching(list, pred, arg, NULL);
+}
+
+/*
+ * Nodes must go back to the allocator they came from: moving them from
+ * src to dst needs both on the same pool (or both on the heap).  An
+ * empty dst without a pool joins src's pool.
+ */
+static int dlist_share_pool(struct dlist *dst, struct dlist *src)
+{
+    if (dst->pool == src->pool) return 0;
+    if (dst->pool || !src->pool || dst->head) return -EINVAL;
+
+    dst->pool = src->pool;
+    dst->pool->refs++;
+    return 0;
+}
+
+DLIST_API int dlist_remove_if_detach(struct dlist *list,
+    int (*pred)(const void *, void *), void *arg, struct dlist *out)
+{
+    int rc;
+
+    DLIST_ASSERT(list != NULL);
+    DLIST_ASSERT(pred != NULL);
+    DLIST_ASSERT(out != NULL && out != list);
+
+    if ((list->flags | out->flags) &
+        (DLIST_F_UNROLLED | DLIST_F_SORTED | DLIST_F_RCU)) {
+        return -EINVAL;
+    }
+    if ((list->flags ^ out->flags) & DLIST_F_STRKEYS) return -EINVAL;
+    if (list->arena || out->arena) return -EINVAL;
+    if (out->head) return -EBUSY;
+    rc = dlist_share_pool(out, list);
+    if (rc < 0) return rc;
+
+    out->key_alloc = list->key_alloc;
+    out->key_free = list->key_free;
+
+    dlist_remove_matching(list, pred, arg, out);
+    return 0;
+}
+
+DLIST_API int dlist_splice(struct dlist *dst, struct dlist *src)
+{
+    struct dlist_node *first, *last;
+    size_t count;
+    int rc;
+
+    DLIST_ASSERT(dst != NULL);
+    DLIST_ASSERT(src != NULL);
+
+    if (dst == src) return -EINVAL;
+    if ((dst->flags | src->flags) & (DLIST_F_SORTED | DLIST_F_RCU)) {
+        return -EINVAL;
+    }
+    if ((dst->flags ^ src->flags) & (DLIST_F_UNROLLED | DLIST_F_STRKEYS)) {
+        return -EINVAL;
+    }
+    if (dst->arena || src->arena) return -EINVAL;
+    if (!src->head) return 0;
+    rc = dlist_share_pool(dst, src);
+    if (rc < 0) return rc;
+
+    first = src->head;
+    last = src->tail;
+    count = src->num_entries;
+    src->head = src->tail = 0;
+    src->num_entries = 0;
+
+    if (dst->flags & DLIST_F_UNROLLED) {
+        struct dlist_unode *ufirst = (struct dlist_unode *) first;
+
+        ufirst->prev = DLIST_UTAIL(dst);
+        if (dst->tail) {
+            DLIST_UTAIL(dst)->next = ufirst;
+        } else {
+            dst->head = first;
+        }
+        dst->tail = last;
+        dst->num_entries += count;
+        DLIST_STAT_PEAK(dst);
+        return 0;
+    }
+    if (src->index) {
+        dlist_index_clear(src->index);
+    }
+    dlist_link_chain(dst, first, last, count, false);
+    return 0;
+}
+
+DLIST_API int dlist_splice_range(struct dlist *dst, struct dlist *src,
+    struct dlist_iter *first, struct dlist_iter *last)
+{
+    struct dlist_node *from = (struct dlist_node *) first;
+    struct dlist_node *to, *entry;
+    size_t count = 0;
+    int rc;
+
+    DLIST_ASSERT(dst != NULL);
+    DLIST_ASSERT(src != NULL);
+
+    if (dst == src) return -EINVAL;
+    if ((dst->flags | src->flags) &
+        (DLIST_F_SORTED | DLIST_F_UNROLLED | DLIST_F_RCU)) {
+        return -EINVAL;
+    }
+    if ((dst->flags ^ src->flags) & DLIST_F_STRKEYS) return -EINVAL;
+    if (dst->arena || src->arena) return -EINVAL;
+    if (!first || first == last) return 0;
+    rc = dlist_share_pool(dst, src);
+    if (rc < 0) return rc;
+
+    to = last ? ((struct dlist_node *) last)->prev : src->tail;
+    for (entry = from; ; entry = entry->next) {
+        if (src->index) {
+            dlist_index_delete(src, entry);
+        }
+        ++count;
+        if (entry == to) break;
+    }
+
+    if (from->prev) {
+        from->prev->next = to->next;
+    } else {
+        src->head = to->next;
+    }
+    if (to->next) {
+        to->next->prev = from->prev;
+    } else {
+        src->tail = from->prev;
+    }
+    src->num_entries -= count;
+    from->prev = to->next = NULL;
+
+    dlist_link_chain(dst, from, to, count, false);
+    return 0;
+}
+
+DLIST_API int dlist_split_at(struct dlist *list, struct dlist_iter *iter,
+    struct dlist *out)
+{
+    DLIST_ASSERT(out != NULL);
+
+    if (out->head) return -EBUSY;
+
+    return dlist_splice_range(out, list, iter, NULL);
+}
+
+/*
+ * Merge two null-terminated next chains.  Ties take from a, which holds
+ * the earlier entries, so the sort stays stable.
+ */
+static struct dlist_node *dlist_sort_merge(const struct dlist *list,
+    struct dlist_node *a, struct dlist_node *b)
+{
+    struct dlist_node *head, **link = &head;
+
+    while (a && b) {
+        if (list->key_compare(b->data, a->data) < 0) {
+            *link = b;
+            link = &b->next;
+            b = b->next;
+        } else {
+            *link = a;
+            link = &a->next;
+            a = a->next;
+        }
+    }
+    *link = a ? a : b;
+    return head;
+}
+
+/*
+ * Cut the longest ascending (or strictly descending, which is reversed)
+ * run off the front of *chain and return it null-terminated.
+ */
+static struct dlist_node *dlist_sort_run(const struct dlist *list,
+    struct dlist_node **chain)
+{
+    struct dlist_node *head = *chain, *last = head, *next;
+
+    next = head->next;
+    if (next && list->key_compare(next->data, head->data) < 0) {
+        head->next = NULL;
+        do {
+            last = next;
+            next = next->next;
+            last->next = head;
+            head = last;
+        } while (next && list->key_compare(next->data, head->data) < 0);
+    } else {
+        while (next && list->key_compare(next->data, last->data) >= 0) {
+            last = next;
+            next = next->next;
+        }
+        last->next = NULL;
+    }
+    *chain = next;
+    return head;
+}
+
+/*
+ * Bottom-up natural merge sort of a null-terminated next chain.  runs[i]
+ * holds a merge of 2^i natural runs, all of them earlier in the list
+ * than the runs in lower slots, like the bits of a counter: adding a
+ * run carries merges upward.
+ */
+static struct dlist_node *dlist_sort_chain(const struct dlist *list,
+    struct dlist_node *chain)
+{
+    struct dlist_node *runs[64] = { 0 };
+    struct dlist_node *run;
+    size_t i;
+
+    while (chain) {
+        run = dlist_sort_run(list, &chain);
+        for (i = 0; runs[i]; ++i) {
+            run = dlist_sort_merge(list, runs[i], run);
+            runs[i] = NULL;
+        }
+        runs[i] = run;
+    }
+    for (run = NULL, i = 0; i < 64; ++i) {
+        if (runs[i]) run = dlist_sort_merge(list, runs[i], run);
+    }
+    return run;
+}
+
+/* Make a sorted next chain the list again, restoring the prev links */
+static void dlist_sort_relink(struct dlist *list, struct dlist_node *head)
+{
+    struct dlist_node *entry, *prev = NULL;
+
+    list->head = head;
+    for (entry = head; entry; prev = entry, entry = entry->next) {
+        entry->prev = prev;
+    }
+    list->tail = prev;
+}
+
+DLIST_API int dlist_sort(struct dlist *list)
+{
+    DLIST_ASSERT(list != NULL);
+
+    if (list->flags & (DLIST_F_UNROLLED | DLIST_F_RCU)) return -EINVAL;
+    if (list->flags & DLIST_F_SORTED || list->num_entries < 2) return 0;
+
+    dlist_sort_relink(list, dlist_sort_chain(list, list->head));
+    return 0;
+}
+
+#ifndef DLIST_NOTHREADS
+
+struct dlist_sort_task
+{
+    const struct dlist *list;
+    struct dlist_node *a, *b;           /* b NULL: sort a, else merge */
+};
+
+static void dlist_sort_worker(void *arg, size_t i)
+{
+    struct dlist_sort_task *task = (struct dlist_sort_task *) arg + i;
+
+    task->a = task->b ? dlist_sort_merge(task->list, task->a, task->b) :
+        dlist_sort_chain(task->list, task->a);
+}
+
+DLIST_API int dlist_sort_parallel(struct dlist *list, unsigned nthreads)
+{
+    struct dlist_sort_task tasks[DLIST_MAX_THREADS];
+    struct dlist_node *entry;
+    size_t i, j, count, per_task;
+
+    DLIST_ASSERT(list != NULL);
+
+    if (list->flags & (DLIST_F_UNROLLED | DLIST_F_SORTED | DLIST_F_RCU)) {
+        return dlist_sort(list);
+    }
+    if (nthreads > DLIST_MAX_THREADS) nthreads = DLIST_MAX_THREADS;
+    if (nthreads > list->num_entries / DLIST_SORT_PARALLEL_MIN_NODES) {
+        nthreads = list->num_entries / DLIST_SORT_PARALLEL_MIN_NODES;
+    }
+    if (nthreads < 2) return dlist_sort(list);
+
+    /* Cut the chain into nthreads runs of equal length */
+    per_task = list->num_entries / nthreads;
+    for (i = 0, entry = list->head; i < nthreads; ++i) {
+        tasks[i].list = list;
+        tasks[i].a = entry;
+        tasks[i].b = NULL;
+        if (i == nthreads - 1) break;
+        for (j = 1; j < per_task; ++j) {
+            entry = entry->next;
+        }
+        entry = entry->next;
+        entry->prev->next = NULL;
+    }
+    dlist_workers_run(dlist_sort_worker, tasks, nthreads, nthreads);
+
+    /* Merge neighbouring runs pairwise until one is left */
+    for (count = nthreads; count > 1; count = (count + 1) / 2) {
+        for (i = 0; i < count / 2; ++i) {
+            tasks[i].a = tasks[2 * i].a;
+            tasks[i].b = tasks[2 * i + 1].a;
+        }
+        dlist_workers_run(dlist_sort_worker, tasks, count / 2, count / 2);
+        if (count & 1) {
+            tasks[count / 2].a = tasks[count - 1].a;
+        }
+    }
+
+    dlist_sort_relink(list, tasks[0].a);
+    return 0;
+}
+
+#else
+
+DLIST_API int dlist_sort_parallel(struct dlist *list, unsigned nthreads)
+{
+    return dlist_sort(list);
+}
+
+#endif
+
+DLIST_API void dlist_clear(struct dlist *list)
+{
+    struct dlist_node *entry, *next;
+
+    DLIST_ASSERT(list);
+
+    if (list->flags & DLIST_F_UNROLLED) {
+        dlist_unrolled_clear(list);
+    } else if (list->rcu) {
+        entry = list->head;
+        DLIST_LINK_STORE(list, list->head, NULL);
+        for (; entry; entry = next) {
+            next = entry->next;
+            dlist_rcu_retire(list, entry);
+        }
+    } else {
+        for (entry = list->head; entry; entry = next) {
+            next = entry->next;
+            if (list->key_free) {
+                list->key_free(entry->data);
+            }
+            dlist_node_free(list, entry);
+        }
+    }
+    if (!list->rcu) {
+        list->head = 0;
+    }
+    list->tail = 0;
+    list->num_entries = 0;
+    if (list->index) {
+        dlist_index_clear(list->index);
+    }
+    if (list->skip) {
+        dlist_skip_clear(list->skip);
+    }
+    if (list->arena) {
+        dlist_arena_reset(list->arena);
+    }
+}
+
+DLIST_API int dlist_reset(struct dlist *list)
+{
+    DLIST_ASSERT(list);
+    dlist_clear(list); 
+    return 0;
+}
+
+/**** Pointer Manipulation ****/
+ 
+/* Get a new linked list iterator. The iterator is 
+ * an opaque pointer to dlist_iter_*() functions.
+ * It points at the data slot of the current entry in either backend.
+ */
+DLIST_API struct dlist_iter *dlist_iter(const struct dlist *list)
+{
+    DLIST_ASSERT(list != NULL);
+
+    if (list->rcu) return (struct dlist_iter *) DLIST_RCU_LOAD(list->head);
+    if (!list->head) return NULL;
+
+    if (list->flags & DLIST_F_UNROLLED) {
+        return (struct dlist_iter *) &DLIST_UHEAD(list)->slots[0];
+    }
+    return (struct dlist_iter *) &list->head->data;
+}
+
+DLIST_API struct dlist_iter *dlist_iter_next(struct dlist *list,
+    struct dlist_iter *iter)
+{
+    struct dlist_node *entry = (struct dlist_node *) iter;
+
+    DLIST_ASSERT(list != NULL);
+
+    if (!iter) return NULL;
+
+    if (list->flags & DLIST_F_UNROLLED) {
+        void **slot = (void **) iter;
+        struct dlist_unode *unode = DLIST_UNODE_OF(slot);
+
+        if (++slot < &unode->slots[unode->count]) {
+            return (struct dlist_iter *) slot;
+        }
+        return unode->next ?
+            (struct dlist_iter *) &unode->next->slots[0] : NULL;
+    }
+    if (list->rcu) return (struct dlist_iter *) DLIST_RCU_LOAD(entry->next);
+    return (struct dlist_iter *) entry->next;
+}
+
+DLIST_API struct dlist_iter *dlist_iter_remove(struct dlist *list,
+    struct dlist_iter *iter)
+{
+    struct dlist_node *entry = (struct dlist_node *) iter;
+    struct dlist_node *next;
+
+    DLIST_ASSERT(list != NULL);
+
+    if (!iter) return NULL;  
+
+    if (list->flags & DLIST_F_UNROLLED) {
+        return (struct dlist_iter *) dlist_unrolled_remove_slot(list,
+            (void **) iter);
+    }
+
+    next = entry->next;
+    dlist_remove_entry(list, entry);
+    return (struct dlist_iter *) next;
+}
+
+DLIST_API struct dlist_iter *dlist_lower_bound(const struct dlist *list,
+    const void *key)
+{
+    DLIST_ASSERT(list != NULL);
+    DLIST_ASSERT(list->skip != NULL);
+
+    if (!list->skip) return NULL;
+
+    return (struct dlist_iter *) dlist_skip_search(list, key, false, NULL);
+}
+
+DLIST_API struct dlist_iter *dlist_upper_bound(const struct dlist *list,
+    const void *key)
+{
+    DLIST_ASSERT(list != NULL);
+    DLIST_ASSERT(list->skip != NULL);
+
+    if (!list->skip) return NULL;
+
+    return (struct dlist_iter *) dlist_skip_search(list, key, true, NULL);
+}
+
+DLIST_API const void *dlist_iter_get_key(struct dlist_iter *iter)
+{
+    if (!iter) {
+        return NULL;
+    }
+    return *(void **) iter;
+}
+
+DLIST_API void *dlist_iter_get_data(struct dlist_iter *iter)
+{
+    if (!iter) return NULL;
+
+    return *(void **) iter;
+}
+
+DLIST_API void dlist_iter_set_data(struct dlist_iter *iter,
+    void *data)
+{
+    if (!iter) return;
+
+    *(void **) iter = data;
+}
+
+DLIST_API int dlist_iter_replace(struct dlist *list, struct dlist_iter *iter,
+    void *data)
+{
+    struct dlist_node *entry = (struct dlist_node *) iter;
+
+    DLIST_ASSERT(list != NULL);
+    DLIST_ASSERT(iter != NULL);
+    DLIST_ASSERT(data != NULL);
+
+    if (list->flags & DLIST_F_RCU) return -EINVAL;
+    if (list->flags & DLIST_F_UNROLLED) {
+        *(void **) iter = data;
+        return 0;
+    }
+    if ((list->flags & DLIST_F_SORTED) && dlist_key_compare(list, entry->data, data) != 0) {
+        return -EINVAL;
+    }
+
+    /* The index slot is found by the old key's hash */
+    if (list->index && list->index->slots) {
+        dlist_index_delete(list, entry);
+        entry->data = data;
+        dlist_index_insert(list, entry);
+    } else {
+        entry->data = data;
+    }
+    if (list->flags & DLIST_F_STRKEYS) {
+        entry->key_sig = dlist_key_sig(data);
+    }
+    return 0;
+}
+
+
+/**** Intrusive Lists ****/
+DLIST_API void dlist_ilist_init(struct dlist_ilist *list)
+{
+    DLIST_ASSERT(list != NULL);
+
+    list->head = list->tail = 0;
+    list->num_entries = 0;
+}
+
+DLIST_API void dlist_ilist_append(struct dlist_ilist *list, struct dlist_link *link)
+{
+    DLIST_ASSERT(list != NULL);
+    DLIST_ASSERT(link != NULL);
+
+    link->next = NULL;
+    link->prev = list->tail;
+    if (list->tail) {
+        list->tail->next = link;
+    } else {
+        list->head = link;
+    }
+    list->tail = link;
+    list->num_entries++;
+}
+
+DLIST_API void dlist_ilist_add(struct dlist_ilist *list, struct dlist_link *link)
+{
+    DLIST_ASSERT(list != NULL);
+    DLIST_ASSERT(link != NULL);
+
+    link->prev = NULL;
+    link->next = list->head;
+    if (list->head) {
+        list->head->prev = link;
+    } else {
+        list->tail = link;
+    }
+    list->head = link;
+    list->num_entries++;
+}
+
+DLIST_API void dlist_ilist_unlink(struct dlist_ilist *list, struct dlist_link *link)
+{
+    DLIST_ASSERT(list != NULL);
+    DLIST_ASSERT(link != NULL);
+
+    if (link->prev) {
+        link->prev->next = link->next;
+    } else {
+        list->head = link->next;
+    }
+    if (link->next) {
+        link->next->prev = link->prev;
+    } else {
+        list->tail = link->prev;
+    }
+    link->prev = link->next = NULL;
+    list->num_entries--;
+}
+
+/* func may unlink the link it was called with */
+DLIST_API int dlist_ilist_foreach(const struct dlist_ilist *list,
+    int (*func)(struct dlist_link *, void *), void *arg)
+{
+    struct dlist_link *link, *next;
+    int rc;
+
+    DLIST_ASSERT(list != NULL);
+    DLIST_ASSERT(func != NULL);
+
+    for (link = list->head; link; link = next) {
+        next = link->next;
+        rc = func(link, arg);
+        if (rc < 0) return rc;
+        if (rc > 0) return 0;
+    }
+    return 0;
+}
+
+
+/**** MPSC Queue ****/
+
+/*
+ * Vyukov's multi-producer single-consumer queue on dlist nodes.  head
+ * is an already consumed dummy whose next is the first entry.  Producers
+ * swap their node into tail, then link the previous tail to it; until
+ * that link lands the consumer sees the queue end early.
+ *
+ * Consumed dummies are pushed onto the free_nodes stack by the consumer
+ * and popped by producers under free_lock.  With a single popper at a
+ * time, the top node cannot be popped and pushed back under a popper's
+ * feet, so the stack is free of ABA without tagged pointers.
+ */
+
+static void dlist_mpsc_lock(int *lock)
+{
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(lock, __ATOMIC_RELAXED)) {
+            DLIST_CPU_RELAX();
+        }
+    }
+}
+
+static void dlist_mpsc_unlock(int *lock)
+{
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+static struct dlist_node *dlist_mpsc_node_alloc(struct dlist_mpsc *queue)
+{
+    struct dlist_node *node;
+
+    dlist_mpsc_lock(&queue->free_lock);
+    node = __atomic_load_n(&queue->free_nodes, __ATOMIC_ACQUIRE);
+    while (node && !__atomic_compare_exchange_n(&queue->free_nodes, &node,
+            node->next, true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+    }
+    if (!node) {
+        node = dlist_pool_alloc(queue->pool);
+    }
+    dlist_mpsc_unlock(&queue->free_lock);
+    return node;
+}
+
+DLIST_API int dlist_mpsc_init(struct dlist_mpsc *queue, size_t chunk_nodes)
+{
+    struct dlist_node *dummy;
+
+    DLIST_ASSERT(queue != NULL);
+
+    memset(queue, 0, sizeof(*queue));
+    queue->pool = dlist_pool_create(chunk_nodes);
+    if (!queue->pool) return -ENOMEM;
+
+    dummy = dlist_pool_alloc(queue->pool);
+    if (!dummy) {
+        dlist_pool_release(queue->pool);
+        return -ENOMEM;
+    }
+    dummy->data = NULL;
+    dummy->prev = dummy->next = NULL;
+    queue->head = queue->tail = dummy;
+    return 0;
+}
+
+DLIST_API void dlist_mpsc_destroy(struct dlist_mpsc *queue)
+{
+    DLIST_ASSERT(queue != NULL);
+
+    if (queue->pool) {
+        dlist_pool_release(queue->pool);
+    }
+    memset(queue, 0, sizeof(*queue));
+}
+
+DLIST_API int dlist_mpsc_push_tail(struct dlist_mpsc *queue, void *data)
+{
+    struct dlist_node *node, *prev;
+
+    DLIST_ASSERT(queue != NULL);
+    DLIST_ASSERT(data != NULL);
+
+    node = dlist_mpsc_node_alloc(queue);
+    if (!node) return -ENOMEM;
+
+    node->data = data;
+    node->prev = NULL;
+    __atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+    prev = __atomic_exchange_n(&queue->tail, node, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+    return 0;
+}
+
+DLIST_API void *dlist_mpsc_pop_head(struct dlist_mpsc *queue)
+{
+    struct dlist_node *dummy, *next, *top;
+    void *data;
+
+    DLIST_ASSERT(queue != NULL);
+
+    dummy = queue->head;
+    next = __atomic_load_n(&dummy->next, __ATOMIC_ACQUIRE);
+    if (!next) return NULL;
+
+    /* next becomes the dummy, the old one is recycled */
+    data = next->data;
+    queue->head = next;
+
+    top = __atomic_load_n(&queue->free_nodes, __ATOMIC_RELAXED);
+    do {
+        dummy->next = top;
+    } while (!__atomic_compare_exchange_n(&queue->free_nodes, &top, dummy,
+            true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return data;
+}
+
+DLIST_API int dlist_mpsc_get_stats(struct dlist_mpsc *queue,
+    struct dlist_pool_stats *stats)
+{
+    DLIST_ASSERT(queue != NULL);
+    DLIST_ASSERT(stats != NULL);
+
+    dlist_mpsc_lock(&queue->free_lock);
+    *stats = queue->pool->stats;
+    dlist_mpsc_unlock(&queue->free_lock);
+    return 0;
+}
+
+
+/**** Blocking Queue ****/
+
+/*
+ * A dlist behind a futex lock (0 free, 1 held, 2 held with waiters).
+ * Consumers sleep on seq.  A push wakes one sleeper only when it makes
+ * the queue non-empty; a consumer leaving entries behind passes the
+ * wakeup on to the next sleeper, so a burst costs one wakeup per
+ * consumer it needs rather than one per item.  Without futexes, waits
+ * degrade to yielding.
+ */
+
+static void dlist_futex_wait(uint32_t *addr, uint32_t val,
+    const struct timespec *rel)
+{
+#ifdef __linux__
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, rel, NULL, 0);
+#else
+    (void) rel;
+    if (__atomic_load_n(addr, __ATOMIC_RELAXED) == val) DLIST_CPU_RELAX();
+#endif
+}
+
+static void dlist_futex_wake(uint32_t *addr, int count)
+{
+#ifdef __linux__
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+#else
+    (void) addr;
+    (void) count;
+#endif
+}
+
+static void dlist_bqueue_lock(struct dlist_bqueue *queue)
+{
+    uint32_t c = 0;
+
+    if (__atomic_compare_exchange_n(&queue->lock, &c, 1, false,
+            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+    if (c != 2) c = __atomic_exchange_n(&queue->lock, 2, __ATOMIC_ACQUIRE);
+    while (c != 0) {
+        dlist_futex_wait(&queue->lock, 2, NULL);
+        c = __atomic_exchange_n(&queue->lock, 2, __ATOMIC_ACQUIRE);
+    }
+}
+
+static void dlist_bqueue_unlock(struct dlist_bqueue *queue)
+{
+    if (__atomic_exchange_n(&queue->lock, 0, __ATOMIC_RELEASE) == 2) {
+        dlist_futex_wake(&queue->lock, 1);
+    }
+}
+
+/* Called locked; true if a sleeper must be woken after unlocking */
+static bool dlist_bqueue_signal(struct dlist_bqueue *queue)
+{
+    if (!queue->num_sleepers) return false;
+    __atomic_add_fetch(&queue->seq, 1, __ATOMIC_RELAXED);
+    queue->num_wakeups++;
+    return true;
+}
+
+/* rel = deadline - now; false once the deadline has passed */
+static bool dlist_bqueue_time_left(const struct timespec *deadline,
+    struct timespec *rel)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    rel->tv_sec = deadline->tv_sec - now.tv_sec;
+    rel->tv_nsec = deadline->tv_nsec - now.tv_nsec;
+    if (rel->tv_nsec < 0) {
+        rel->tv_nsec += 1000000000;
+        rel->tv_sec--;
+    }
+    return rel->tv_sec > 0 || (rel->tv_sec == 0 && rel->tv_nsec > 0);
+}
+
+/*
+ * Lock the queue and sleep, unlocked, until it has entries, is closed
+ * or timeout_ns has passed.  Returns with the lock held.
+ */
+static void dlist_bqueue_wait(struct dlist_bqueue *queue,
+    uint64_t timeout_ns)
+{
+    struct timespec deadline, rel;
+    uint32_t seq;
+    bool forever = timeout_ns == DLIST_BQUEUE_FOREVER;
+
+    dlist_bqueue_lock(queue);
+    if (queue->list.num_entries || queue->closed || !timeout_ns) return;
+
+    if (!forever) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_ns / 1000000000;
+        deadline.tv_nsec += timeout_ns % 1000000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_nsec -= 1000000000;
+            deadline.tv_sec++;
+        }
+    }
+    while (!queue->list.num_entries && !queue->closed) {
+        if (!forever && !dlist_bqueue_time_left(&deadline, &rel)) break;
+
+        seq = __atomic_load_n(&queue->seq, __ATOMIC_RELAXED);
+        queue->num_sleepers++;
+        dlist_bqueue_unlock(queue);
+        dlist_futex_wait(&queue->seq, seq, forever ? NULL : &rel);
+        dlist_bqueue_lock(queue);
+        queue->num_sleepers--;
+    }
+}
+
+/* Take up to count entries from the locked queue, then unlock it */
+static size_t dlist_bqueue_take(struct dlist_bqueue *queue, void **data,
+    size_t count)
+{
+    struct dlist_node *head;
+    size_t i;
+    bool wake = false;
+
+    for (i = 0; i < count && (head = queue->list.head); ++i) {
+        data[i] = head->data;
+        dlist_remove_entry(&queue->list, head);
+    }
+    if (queue->list.num_entries) {
+        wake = dlist_bqueue_signal(queue);
+    }
+    dlist_bqueue_unlock(queue);
+
+    if (wake) dlist_futex_wake(&queue->seq, 1);
+    return i;
+}
+
+DLIST_API int dlist_bqueue_init(struct dlist_bqueue *queue, size_t chunk_nodes)
+{
+    int rc;
+
+    DLIST_ASSERT(queue != NULL);
+
+    memset(queue, 0, sizeof(*queue));
+    rc = dlist_init(&queue->list, NULL);
+    if (rc < 0) return rc;
+    return dlist_pool_enable(&queue->list, chunk_nodes);
+}
+
+DLIST_API void dlist_bqueue_destroy(struct dlist_bqueue *queue)
+{
+    DLIST_ASSERT(queue != NULL);
+
+    dlist_destroy(&queue->list);
+    memset(queue, 0, sizeof(*queue));
+}
+
+DLIST_API size_t dlist_bqueue_len(struct dlist_bqueue *queue)
+{
+    size_t len;
+
+    DLIST_ASSERT(queue != NULL);
+
+    dlist_bqueue_lock(queue);
+    len = queue->list.num_entries;
+    dlist_bqueue_unlock(queue);
+    return len;
+}
+
+DLIST_API int dlist_bqueue_push(struct dlist_bqueue *queue, void *data)
+{
+    bool wake = false;
+
+    DLIST_ASSERT(queue != NULL);
+    DLIST_ASSERT(data != NULL);
+
+    dlist_bqueue_lock(queue);
+    if (queue->closed) {
+        dlist_bqueue_unlock(queue);
+        return -EPIPE;
+    }
+    if (!dlist_append(&queue->list, data)) {
+        dlist_bqueue_unlock(queue);
+        return -ENOMEM;
+    }
+    if (queue->list.num_entries == 1) {
+        wake = dlist_bqueue_signal(queue);
+    }
+    dlist_bqueue_unlock(queue);
+
+    if (wake) dlist_futex_wake(&queue->seq, 1);
+    return 0;
+}
+
+DLIST_API void *dlist_bqueue_pop(struct dlist_bqueue *queue)
+{
+    return dlist_bqueue_pop_timed(queue, DLIST_BQUEUE_FOREVER);
+}
+
+DLIST_API void *dlist_bqueue_pop_timed(struct dlist_bqueue *queue,
+    uint64_t timeout_ns)
+{
+    void *data = NULL;
+
+    DLIST_ASSERT(queue != NULL);
+
+    dlist_bqueue_wait(queue, timeout_ns);
+    dlist_bqueue_take(queue, &data, 1);
+    return data;
+}
+
+DLIST_API size_t dlist_bqueue_pop_batch(struct dlist_bqueue *queue, void **data,
+    size_t count, uint64_t timeout_ns)
+{
+    DLIST_ASSERT(queue != NULL);
+    DLIST_ASSERT(data != NULL || count == 0);
+
+    dlist_bqueue_wait(queue, timeout_ns);
+    return dlist_bqueue_take(queue, data, count);
+}
+
+DLIST_API void dlist_bqueue_close(struct dlist_bqueue *queue)
+{
+    DLIST_ASSERT(queue != NULL);
+
+    dlist_bqueue_lock(queue);
+    queue->closed = 1;
+    __atomic_add_fetch(&queue->seq, 1, __ATOMIC_RELAXED);
+    dlist_bqueue_unlock(queue);
+
+    dlist_futex_wake(&queue->seq, INT32_MAX);
+}
+
+/**** Lock-free Ordered Set ****/
+
+/*
+ * Harris-Michael list.  A node is deleted by setting the low bit of its
+ * next word, which freezes it, and unlinked by whoever first swings its
+ * predecessor past it; searches unlink the deleted nodes they pass.
+ * Link words are plain uintptr_t (the head lives in the public struct)
+ * accessed through the __atomic builtins.
+ */
+struct dlist_lfnode
+{
+    void *data;
+    uintptr_t next;                     /* low bit: deleted */
+    struct dlist_lfnode *retired_next;
+    uint64_t retired_epoch;
+};
+
+#define DLIST_LF_MARKED(link)         ((link) & 1)
+#define DLIST_LF_NODE(link)                                             \
+    ((struct dlist_lfnode *) ((link) & ~(uintptr_t) 1))
+
+static uintptr_t dlist_lf_load(uintptr_t *link)
+{
+    return __atomic_load_n(link, __ATOMIC_ACQUIRE);
+}
+
+static bool dlist_lf_cas(uintptr_t *link, uintptr_t old, uintptr_t new)
+{
+    return __atomic_compare_exchange_n(link, &old, new, false,
+        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+/* Free the retired nodes no reader can reach, one reclaimer at a time */
+static void dlist_lfset_reclaim(struct dlist_lfset *set)
+{
+    struct dlist_lfnode *node, *next, *keep = NULL, *keep_last = NULL;
+    uint64_t oldest;
+
+    if (__atomic_exchange_n(&set->reclaim_lock, 1, __ATOMIC_ACQUIRE)) return;
+
+    node = __atomic_exchange_n(&set->retired, NULL, __ATOMIC_ACQUIRE);
+    oldest = dlist_epoch_advance();
+    for (; node; node = next) {
+        next = node->retired_next;
+        if (node->retired_epoch < oldest) {
+            free(node);
+        } else {
+            if (!keep) keep_last = node;
+            node->retired_next = keep;
+            keep = node;
+        }
+    }
+    if (keep) {
+        keep_last->retired_next = __atomic_load_n(&set->retired,
+            __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&set->retired,
+                &keep_last->retired_next, keep, true,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+    }
+    __atomic_store_n(&set->reclaim_lock, 0, __ATOMIC_RELEASE);
+}
+
+/* Queue an unlinked node; true when a reclaim pass is due */
+static bool dlist_lfset_retire(struct dlist_lfset *set,
+    struct dlist_lfnode *node)
+{
+    node->retired_epoch = dlist_epoch_now();
+    node->retired_next = __atomic_load_n(&set->retired, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&set->retired, &node->retired_next,
+            node, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    return __atomic_add_fetch(&set->num_retired, 1, __ATOMIC_RELAXED) %
+        DLIST_LFSET_RECLAIM_EVERY == 0;
+}
+
+/*
+ * Find the first node whose key is not below key.  *prev is the link
+ * word pointing at it; *found tells whether its key is equal.
+ */
+static struct dlist_lfnode *dlist_lfset_search(struct dlist_lfset *set,
+    const void *key, uintptr_t **prev, bool *found, bool *reclaim)
+{
+    struct dlist_lfnode *cur;
+    uintptr_t link, next;
+    int rc;
+
+retry:
+    *prev = &set->head;
+    link = dlist_lf_load(*prev);
+    for (;;) {
+        cur = DLIST_LF_NODE(link);
+        if (!cur) {
+            *found = false;
+            return NULL;
+        }
+        next = dlist_lf_load(&cur->next);
+        if (DLIST_LF_MARKED(next)) {
+            next = (uintptr_t) DLIST_LF_NODE(next);
+            if (!dlist_lf_cas(*prev, (uintptr_t) cur, next)) goto retry;
+            *reclaim |= dlist_lfset_retire(set, cur);
+            link = next;
+            continue;
+        }
+        rc = set->key_compare(key, cur->data);
+        if (rc <= 0) {
+            *found = rc == 0;
+            return cur;
+        }
+        *prev = &cur->next;
+        link = next;
+    }
+}
+
+DLIST_API int dlist_lfset_init(struct dlist_lfset *set,
+    int (*key_compare_cb)(const void *, const void *))
+{
+    DLIST_ASSERT(set != NULL);
 
-struct dlist_node
+    memset(set, 0, sizeof(*set));
+    set->key_compare = key_compare_cb ?
+        key_compare_cb : dlist_compare_string;
+    return 0;
+}
+
+DLIST_API void dlist_lfset_destroy(struct dlist_lfset *set)
 {
-    struct dlist_node *prev, *next;
-    void *data;
-};
+    struct dlist_lfnode *node, *next;
 
-/**** Utility Functions ****/
+    DLIST_ASSERT(set != NULL);
 
-/* Access pointer to current entry */
-static struct dlist_node *dlist_get_entry(const
-    struct dlist *list, struct dlist_node *entry)
-{  
-    struct dlist_node *cur = entry; 
-    while (cur->next) {
-        return cur;
+    for (node = DLIST_LF_NODE(set->head); node; node = next) {
+        next = DLIST_LF_NODE(node->next);
+        free(node);
     }
-    return NULL;
+    for (node = set->retired; node; node = next) {
+        next = node->retired_next;
+        free(node);
+    }
+    memset(set, 0, sizeof(*set));
 }
 
-/* Generic search func for a given key. 
- * Returns NULL if key is invalid.
-*/
-static struct dlist_node *dlist_find_entry(const struct dlist *list, 
-    const void *key)
+DLIST_API size_t dlist_lfset_len(const struct dlist_lfset *set)
 {
-    struct dlist_node *entry = list->head;
-    for(; entry; ) 
-    {   
-        if (list->key_compare(key, entry->data) == 0) {
-            return entry;
+    DLIST_ASSERT(set != NULL);
+
+    return __atomic_load_n(&set->num_entries, __ATOMIC_RELAXED);
+}
+
+DLIST_API int dlist_lfset_insert(struct dlist_lfset *set, void *data)
+{
+    struct dlist_lfnode *node, *cur;
+    uintptr_t *prev;
+    bool found, reclaim = false;
+    int rc;
+
+    DLIST_ASSERT(set != NULL);
+
+    node = (struct dlist_lfnode *) malloc(sizeof(*node));
+    if (!node) return -ENOMEM;
+    if (dlist_epoch_enter() < 0) {
+        free(node);
+        return -ENOMEM;
+    }
+
+    node->data = data;
+    for (;;) {
+        cur = dlist_lfset_search(set, data, &prev, &found, &reclaim);
+        if (found) {
+            rc = -EEXIST;
+            break;
+        }
+        node->next = (uintptr_t) cur;
+        if (dlist_lf_cas(prev, (uintptr_t) cur, (uintptr_t) node)) {
+            __atomic_add_fetch(&set->num_entries, 1, __ATOMIC_RELAXED);
+            rc = 0;
+            break;
         }
-        entry = entry->next;
     }
-    return NULL;
-}
+    dlist_epoch_exit();
 
+    if (rc < 0) free(node);
+    if (reclaim) dlist_lfset_reclaim(set);
+    return rc;
+}
 
-static void dlist_remove_entry(struct dlist *list, 
-     struct dlist_node *del_entry)
+DLIST_API void *dlist_lfset_remove(struct dlist_lfset *set, const void *key)
 {
-    struct dlist_node *prev = del_entry->prev;
-    struct dlist_node *next = del_entry->next;
-    if (list->key_free)  {
-        list->key_free(del_entry->data);
-    } 
+    struct dlist_lfnode *cur;
+    uintptr_t *prev, next;
+    bool found, reclaim = false;
+    void *data = NULL;
 
-    if (prev) {
-        if (next) {
-            prev->next = del_entry->next;
-            next->prev = del_entry->prev;
-        } else {
-            prev->next = 0;
-            list->tail = del_entry->prev;
+    DLIST_ASSERT(set != NULL);
+
+    if (dlist_epoch_enter() < 0) return NULL;
+
+    for (;;) {
+        cur = dlist_lfset_search(set, key, &prev, &found, &reclaim);
+        if (!found) break;
+
+        next = dlist_lf_load(&cur->next);
+        if (DLIST_LF_MARKED(next) ||
+            !dlist_lf_cas(&cur->next, next, next | 1)) {
+            continue;
         }
-    } else {
-        if (next) {
-            next->prev = 0;
-            list->head = del_entry->next;
+        /* Deleted: now unlink it, or let a search do it */
+        data = cur->data;
+        __atomic_sub_fetch(&set->num_entries, 1, __ATOMIC_RELAXED);
+        if (dlist_lf_cas(prev, (uintptr_t) cur, next)) {
+            reclaim |= dlist_lfset_retire(set, cur);
         } else {
-            list->head = 0;
-            list->tail = 0;
+            dlist_lfset_search(set, key, &prev, &found, &reclaim);
         }
+        break;
     }
+    dlist_epoch_exit();
 
-    free (del_entry);
-    list->num_entries--;    
+    if (reclaim) dlist_lfset_reclaim(set);
+    return data;
 }
 
-
-static void dlist_free_data(struct dlist *list)
+DLIST_API void *dlist_lfset_get_data(struct dlist_lfset *set, const void *key)
 {
-    struct dlist_iter *iter;
+    struct dlist_lfnode *cur;
+    uintptr_t next;
+    void *data = NULL;
+    int rc;
 
-    if (!list->key_free) return;
+    DLIST_ASSERT(set != NULL);
 
-    for (iter = dlist_iter(list); iter; 
-        iter = dlist_iter_next(list, iter)) 
-    {
-        list->key_free((void *) dlist_iter_get_data(iter));
+    if (dlist_epoch_enter() < 0) return NULL;
+
+    for (cur = DLIST_LF_NODE(dlist_lf_load(&set->head)); cur;
+            cur = DLIST_LF_NODE(next)) {
+        next = dlist_lf_load(&cur->next);
+        rc = set->key_compare(key, cur->data);
+        if (rc > 0) continue;
+        if (rc == 0 && !DLIST_LF_MARKED(next)) data = cur->data;
+        break;
     }
+    dlist_epoch_exit();
+    return data;
 }
 
-
-
-/**** Initialization ****/
-int dlist_init(struct dlist *list, 
-    int (*key_compare_cb)(const void *, const void *))
+DLIST_API int dlist_lfset_foreach(struct dlist_lfset *set,
+    int (*func)(const void *, void *), void *arg)
 {
-    DLIST_ASSERT(list != NULL);
+    struct dlist_lfnode *cur;
+    uintptr_t next;
+    int rc = 0;
 
-    list->head = list->tail = 0;
-    list->num_entries = 0;
+    DLIST_ASSERT(set != NULL);
+    DLIST_ASSERT(func != NULL);
 
-    list->head = (struct dlist_node *) calloc(1, 
-        sizeof(struct dlist_node));
-    
-    if (!list->head) return -ENOMEM;
+    if (dlist_epoch_enter() < 0) return -ENOMEM;
 
-    list->key_compare = key_compare_cb ?
-        key_compare_cb : dlist_compare_string;
+    for (cur = DLIST_LF_NODE(dlist_lf_load(&set->head)); cur;
+            cur = DLIST_LF_NODE(next)) {
+        next = dlist_lf_load(&cur->next);
+        if (DLIST_LF_MARKED(next)) continue;
 
-    list->key_alloc = NULL;
-    list->key_free = NULL;
-    return 0;
+        rc = func(cur->data, arg);
+        if (rc) break;
+    }
+    dlist_epoch_exit();
+    return rc < 0 ? rc : 0;
 }
 
-void dlist_destroy(struct dlist *list)
-{
-    if (!list) return;
-
-    dlist_free_data(list);
-    free(list->head);
-    memset(list, 0, sizeof(*list));
-}
 
+/**** Sharded Lists ****/
 
 /*
- * Enable internal memory management.
+ * One list and its lock per stripe, each on its own cache lines so
+ * writers on different stripes do not share any.  The stripe comes from
+ * the upper half of the key hash; a stripe's hash index uses the lower.
  */
-void dlist_set_key_alloc_func(struct dlist *list, 
-    void *(key_alloc_cb)(void *), void (*key_free_cb)(void *))
+struct dlist_stripe
 {
-    DLIST_ASSERT(list != NULL);
-
-    list->key_alloc = key_alloc_cb;
-    list->key_free = key_free_cb;
-}
+    _Alignas(DLIST_CACHE_LINE) struct dlist list;
+#ifndef DLIST_NOTHREADS
+    pthread_mutex_t lock;
+#endif
+};
 
+#ifndef DLIST_NOTHREADS
+#define DLIST_STRIPE_LOCK(stripe)     pthread_mutex_lock(&(stripe)->lock)
+#define DLIST_STRIPE_UNLOCK(stripe)   pthread_mutex_unlock(&(stripe)->lock)
+#else
+#define DLIST_STRIPE_LOCK(stripe)
+#define DLIST_STRIPE_UNLOCK(stripe)
+#endif
 
-/**** Status ****/
-int dlist_is_empty(struct dlist *list)
+/* splitmix64 finalizer: every input bit reaches every output bit */
+static inline uint64_t dlist_mix64(uint64_t hash)
 {
-    return list->head == NULL ? 1 : 0;
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
 }
 
-size_t dlist_len(struct dlist *list)
+/*
+ * Mixed first, so 32-bit user hashes still spread over all stripes; the
+ * top bits are used because a stripe's index takes the low bits of the
+ * raw hash.
+ */
+static struct dlist_stripe *dlist_sharded_stripe(
+    const struct dlist_sharded *set, const void *key)
 {
-    DLIST_ASSERT(list != NULL);
-    return list->num_entries;
+    return &set->stripes[(size_t) (dlist_mix64(set->key_hash(key)) >> 32) &
+        set->mask];
 }
 
-
-
-/**** Data Modification ****/
-void *dlist_get_data(struct dlist *list, void *data)
+DLIST_API int dlist_sharded_init(struct dlist_sharded *set, size_t num_stripes,
+    int (*key_compare_cb)(const void *, const void *),
+    uint64_t (*key_hash_cb)(const void *), unsigned flags)
 {
-     struct dlist_node *entry;
-
-     DLIST_ASSERT(list != NULL);
-     DLIST_ASSERT(data != NULL);
+    size_t i, n = 1;
+    int rc;
 
-     entry = dlist_find_entry(list, data);
-     if (!entry) return NULL;
+    DLIST_ASSERT(set != NULL);
+    DLIST_ASSERT(key_hash_cb != NULL);
 
-     return entry->data;
+    if (flags & DLIST_F_RCU) return -EINVAL;
+    if (!num_stripes) num_stripes = DLIST_SHARDED_STRIPES;
+    if (num_stripes > DLIST_SHARDED_MAX_STRIPES) {
+        num_stripes = DLIST_SHARDED_MAX_STRIPES;
+    }
+    while (n < num_stripes) n <<= 1;
+
+    set->stripes = (struct dlist_stripe *) aligned_alloc(
+        _Alignof(struct dlist_stripe), n * sizeof(struct dlist_stripe));
+    if (!set->stripes) return -ENOMEM;
+
+    for (i = 0; i < n; ++i) {
+        rc = dlist_init_flags(&set->stripes[i].list, key_compare_cb, flags);
+        if (rc < 0) {
+            while (i--) {
+                dlist_destroy(&set->stripes[i].list);
+            }
+            free(set->stripes);
+            set->stripes = NULL;
+            return rc;
+        }
+#ifndef DLIST_NOTHREADS
+        pthread_mutex_init(&set->stripes[i].lock, NULL);
+#endif
+    }
+    set->mask = n - 1;
+    set->key_hash = key_hash_cb;
+    return 0;
 }
 
-void *dlist_remove(struct dlist *list, const void *key)
+DLIST_API void dlist_sharded_destroy(struct dlist_sharded *set)
 {
-    struct dlist_node *entry;
-    void *data;
-
-    DLIST_ASSERT(list != NULL);
-    DLIST_ASSERT(key != NULL);
+    size_t i;
 
-    entry = dlist_find_entry(list, key);
-    if (!entry) 
-        return NULL;
+    DLIST_ASSERT(set != NULL);
 
-    data = entry->data;
-    dlist_remove_entry(list, entry);
-    return data;
+    if (!set->stripes) return;
+    for (i = 0; i <= set->mask; ++i) {
+        dlist_destroy(&set->stripes[i].list);
+#ifndef DLIST_NOTHREADS
+        pthread_mutex_destroy(&set->stripes[i].lock);
+#endif
+    }
+    free(set->stripes);
+    set->stripes = NULL;
 }
 
-void *dlist_append(struct dlist *list,  void *data)
+DLIST_API int dlist_sharded_index_enable(struct dlist_sharded *set, size_t threshold)
 {
-    // Initialize Tail Link 
-    struct dlist_node *new_node = calloc(1, sizeof(struct dlist_node));
-   
-    if(!list) {
-        fprintf(stderr, "calloc failed. \n");
-        exit(EXIT_FAILURE);
-    }
+    size_t i;
+    int rc = 0;
 
-    new_node->data = data;
+    DLIST_ASSERT(set != NULL);
 
-    if (list->tail) {
-        /* Join the two final nodes together. */
-        list->tail->next = new_node;
-        new_node->prev = list->tail;
-        list->tail = new_node;
-    } else {
-        list->head = new_node;
-        list->tail = new_node;
+    for (i = 0; i <= set->mask && rc == 0; ++i) {
+        DLIST_STRIPE_LOCK(&set->stripes[i]);
+        rc = dlist_index_enable(&set->stripes[i].list, set->key_hash,
+            threshold);
+        DLIST_STRIPE_UNLOCK(&set->stripes[i]);
+        if (rc == -EEXIST) rc = 0;
     }
-    list->num_entries++;
-    return data;  
+    return rc;
 }
 
-void *dlist_add(struct dlist *list, void *data)
+DLIST_API int dlist_sharded_set_key_alloc_funcs(struct dlist_sharded *set,
+    void *(*key_alloc_cb)(const void *), void (*key_free_cb)(void *))
 {
-     // Initialize Head Link 
-    struct dlist_node *new_node;
-    new_node = calloc(1, sizeof(struct dlist_node));
+    size_t i;
+    bool arena = false;
+    int rc;
 
-    if (!list) {
-        fprintf(stderr, "calloc failed. \n");
-        exit(EXIT_FAILURE);
-    }
+    DLIST_ASSERT(set != NULL);
 
-    new_node->data = data;
+    /* All stripes or none, so they never disagree on who owns keys */
+    for (i = 0; i <= set->mask; ++i) {
+        DLIST_STRIPE_LOCK(&set->stripes[i]);
+        arena |= set->stripes[i].list.arena != NULL;
+        DLIST_STRIPE_UNLOCK(&set->stripes[i]);
+    }
+    if (arena) return -EINVAL;
 
-    if (list->head) {
-        new_node->next = list->head;
-        list->head = new_node;
-    } else {
-        list->head = new_node;
-        list->tail = new_node;
+    for (i = 0; i <= set->mask; ++i) {
+        DLIST_STRIPE_LOCK(&set->stripes[i]);
+        rc = dlist_set_key_alloc_funcs(&set->stripes[i].list, key_alloc_cb,
+            key_free_cb);
+        DLIST_STRIPE_UNLOCK(&set->stripes[i]);
+        if (rc < 0) return rc;
     }
-    list->num_entries++;
-    return data;
+    return 0;
 }
 
-void dlist_clear(struct dlist *list)
+DLIST_API size_t dlist_sharded_len(struct dlist_sharded *set)
 {
-    DLIST_ASSERT(list);
-    dlist_free_data(list);
-    list->num_entries = 0;
-    memset(list->head, 0, sizeof(struct dlist_node) * (dlist_len(list)));
+    size_t i, len = 0;
+
+    DLIST_ASSERT(set != NULL);
+
+    for (i = 0; i <= set->mask; ++i) {
+        DLIST_STRIPE_LOCK(&set->stripes[i]);
+        len += set->stripes[i].list.num_entries;
+        DLIST_STRIPE_UNLOCK(&set->stripes[i]);
+    }
+    return len;
 }
 
-int dlist_reset(struct dlist *list)
+DLIST_API void *dlist_sharded_add(struct dlist_sharded *set, void *data)
 {
-    dlist_clear(list); 
-    dlist_init(list, list->key_compare);
-    return 0;
+    struct dlist_stripe *stripe;
+
+    DLIST_ASSERT(set != NULL);
+
+    stripe = dlist_sharded_stripe(set, data);
+    DLIST_STRIPE_LOCK(stripe);
+    data = dlist_add(&stripe->list, data);
+    DLIST_STRIPE_UNLOCK(stripe);
+    return data;
 }
 
-/**** Pointer Manipulation ****/
- 
-/* Get a new linked list iterator. The iterator is 
- * an opaque pointer to dlist_iter_*() functions.
- */
-struct dlist_iter *dlist_iter(const struct dlist *list)
+DLIST_API void *dlist_sharded_append(struct dlist_sharded *set, void *data)
 {
-    DLIST_ASSERT(list != NULL);
+    struct dlist_stripe *stripe;
 
-    if ((list->num_entries) == 0) return NULL;
+    DLIST_ASSERT(set != NULL);
 
-    return (struct dlist_iter *) dlist_get_entry(list,
-        (list->head));
+    stripe = dlist_sharded_stripe(set, data);
+    DLIST_STRIPE_LOCK(stripe);
+    data = dlist_append(&stripe->list, data);
+    DLIST_STRIPE_UNLOCK(stripe);
+    return data;
 }
 
-struct dlist_iter *dlist_iter_next(struct dlist *list,
-    struct dlist_iter *iter)
+DLIST_API void *dlist_sharded_get_data(struct dlist_sharded *set, void *key)
 {
-    struct dlist_node *entry = (struct dlist_node *) iter;
-
-    DLIST_ASSERT(list != NULL);
+    struct dlist_stripe *stripe;
+    void *data;
 
-    if (!iter) return NULL;
+    DLIST_ASSERT(set != NULL);
 
-    return (struct dlist_iter *) dlist_get_entry(list,
-        entry->next);
+    stripe = dlist_sharded_stripe(set, key);
+    DLIST_STRIPE_LOCK(stripe);
+    data = dlist_get_data(&stripe->list, key);
+    DLIST_STRIPE_UNLOCK(stripe);
+    return data;
 }
 
-struct dlist_iter *dlist_iter_remove(struct dlist *list,
-    struct dlist_iter *iter)
+DLIST_API void *dlist_sharded_remove(struct dlist_sharded *set, const void *key)
 {
-    struct dlist_node *entry = (struct dlist_node *) iter;
-
-    DLIST_ASSERT(list != NULL);
+    struct dlist_stripe *stripe;
+    void *data;
 
-    if (!iter) return NULL;  
+    DLIST_ASSERT(set != NULL);
 
-    if (!entry) 
-    /* Iterator is invalid, so just return the next valid entry */
-        return dlist_iter_next(list, iter);  
- 
-    return (struct dlist_iter *) dlist_get_entry(list, entry->next);
-        (dlist_remove_entry(list, entry));    
+    stripe = dlist_sharded_stripe(set, key);
+    DLIST_STRIPE_LOCK(stripe);
+    data = dlist_remove(&stripe->list, key);
+    DLIST_STRIPE_UNLOCK(stripe);
+    return data;
 }
 
-const void *dlist_iter_get_key(struct dlist_iter *iter)
+/* Carries a stop out of dlist_foreach(), which folds positives into 0 */
+struct dlist_sharded_foreach_state
 {
-    if (!iter) {
-        return NULL;
-    }
-    return (void *)((struct dlist_node *)iter)->data;
-}
+    int (*func)(const void *, void *);
+    void *arg;
+    int rc;
+};
 
-void *dlist_iter_get_data(struct dlist_iter *iter)
+static int dlist_sharded_foreach_callback(const void *data, void *arg)
 {
-    if (!iter) return NULL;
+    struct dlist_sharded_foreach_state *s =
+        (struct dlist_sharded_foreach_state *) arg;
 
-    return ((struct dlist_node *) iter)->data;
+    s->rc = s->func(data, s->arg);
+    return s->rc;
 }
 
-void dlist_iter_set_data(struct dlist_iter *iter,
-    void *data)
+DLIST_API int dlist_sharded_foreach(struct dlist_sharded *set,
+    int (*func)(const void *, void *), void *arg)
 {
-    if (!iter) return;
+    struct dlist_sharded_foreach_state s = {func, arg, 0};
+    size_t i;
 
-    ((struct dlist_node *) iter)->data = data;
-}
+    DLIST_ASSERT(set != NULL);
+    DLIST_ASSERT(func != NULL);
 
+    for (i = 0; i <= set->mask && s.rc == 0; ++i) {
+        DLIST_STRIPE_LOCK(&set->stripes[i]);
+        dlist_foreach(&set->stripes[i].list,
+            dlist_sharded_foreach_callback, &s);
+        DLIST_STRIPE_UNLOCK(&set->stripes[i]);
+    }
+    return s.rc < 0 ? s.rc : 0;
+}
 
 /**** Generic FOREACH caller to user-defined functions ****/
-int dlist_foreach(const struct dlist *list,
+DLIST_API int dlist_foreach(const struct dlist *list,
     int (*func)(const void *, void *), void *arg)
 {
-    struct dlist_node *entry;
+    struct dlist_node *entry, *prev, *next;
     size_t num_entries;
-    const void *data;
     int rc;
     DLIST_ASSERT(list != NULL);
     DLIST_ASSERT(func !=NULL);
 
-    for (entry = &list->head[0]; entry <= &list->head[(list)->num_entries]; ++entry)
-    {
-        if (!entry->data || !entry->prev) continue;
+    if (list->flags & DLIST_F_UNROLLED) {
+        return dlist_unrolled_foreach(list, func, arg);
+    }
+    if (list->rcu) {
+        /* Readers run alongside the writer: no modification checks */
+        for (entry = DLIST_RCU_LOAD(list->head); entry;
+                entry = DLIST_RCU_LOAD(entry->next)) {
+            rc = func(entry->data, arg);
+            if (rc) return rc < 0 ? rc : 0;
+        }
+        return 0;
+    }
 
+    for (entry = list->head; entry; entry = next)
+    {
         num_entries = list->num_entries;
-        data = entry->data;
+        prev = entry->prev;
+        next = entry->next;
         rc = func(entry->data, arg);
         if (rc < 0) return rc;
         if (rc > 0) return 0;
 
-        if (entry->prev->data != data) {
-            --entry;
-        } else if (num_entries != list->num_entries) {
+        if (num_entries == list->num_entries) {
+            next = entry->next;
+        } else if (num_entries != list->num_entries + 1 ||
+            (prev ? prev->next : list->head) != next) {
             /* Stop immediately if func put/removed another entry */
             return -1;
         }
+        /* else func removed the current entry, continue with next */
+    }
+    return 0;
+}
+
+#ifndef DLIST_NOTHREADS
+
+/*
+ * A thread's share of the chunks, [lo, hi) packed in one word so that
+ * the owner taking lo and thieves taking hi - 1 agree through one CAS.
+ */
+#define DLIST_SPAN(lo, hi)            ((uint64_t) (lo) << 32 | (hi))
+#define DLIST_SPAN_LO(span)           ((size_t) ((span) >> 32))
+#define DLIST_SPAN_HI(span)           ((size_t) ((span) & 0xffffffff))
+
+struct dlist_foreach_job
+{
+    const struct dlist *list;
+    int (*func)(const void *, void *);
+    void *arg;
+    void **chunks;                      /* first node/unode of each chunk */
+    size_t num_chunks;
+    unsigned nthreads;
+    atomic_int rc;                      /* first stop, negative preferred */
+    _Atomic uint64_t spans[DLIST_MAX_THREADS];
+};
+
+/* Cut the list into at most num_chunks chunks of about equal length */
+static size_t dlist_foreach_cut(const struct dlist *list, void **chunks,
+    size_t num_chunks)
+{
+    size_t per_chunk = (list->num_entries + num_chunks - 1) / num_chunks;
+    size_t n = 0, i = 0;
+
+    if (list->flags & DLIST_F_UNROLLED) {
+        struct dlist_unode *unode;
+
+        for (unode = DLIST_UHEAD(list); unode; unode = unode->next) {
+            if (i >= n * per_chunk) chunks[n++] = unode;
+            i += unode->count;
+        }
+    } else {
+        struct dlist_node *entry;
+
+        for (entry = list->head; entry; entry = entry->next, ++i) {
+            if (i % per_chunk == 0) chunks[n++] = entry;
+        }
+    }
+    return n;
+}
+
+static bool dlist_foreach_claim(_Atomic uint64_t *span, bool steal,
+    size_t *chunk)
+{
+    uint64_t old = atomic_load(span), new;
+    size_t lo, hi;
+
+    do {
+        lo = DLIST_SPAN_LO(old);
+        hi = DLIST_SPAN_HI(old);
+        if (lo >= hi) return false;
+        new = steal ? DLIST_SPAN(lo, hi - 1) : DLIST_SPAN(lo + 1, hi);
+    } while (!atomic_compare_exchange_weak(span, &old, new));
+
+    *chunk = steal ? hi - 1 : lo;
+    return true;
+}
+
+static void dlist_foreach_stop(struct dlist_foreach_job *job, int rc)
+{
+    int old = atomic_load(&job->rc);
+
+    while (old == 0 || (old > 0 && rc < 0)) {
+        if (atomic_compare_exchange_weak(&job->rc, &old, rc)) break;
+    }
+}
+
+static int dlist_foreach_chunk(struct dlist_foreach_job *job, size_t c)
+{
+    void *end = c + 1 < job->num_chunks ? job->chunks[c + 1] : NULL;
+    int rc;
+
+    if (job->list->flags & DLIST_F_UNROLLED) {
+        struct dlist_unode *unode;
+        size_t i;
+
+        for (unode = job->chunks[c]; unode != end; unode = unode->next) {
+            for (i = 0; i < unode->count; ++i) {
+                if (atomic_load_explicit(&job->rc, memory_order_relaxed)) {
+                    return 0;
+                }
+                rc = job->func(unode->slots[i], job->arg);
+                if (rc) return rc;
+            }
+        }
+    } else {
+        struct dlist_node *entry;
+
+        for (entry = job->chunks[c]; entry != end; entry = entry->next) {
+            if (atomic_load_explicit(&job->rc, memory_order_relaxed)) {
+                return 0;
+            }
+            rc = job->func(entry->data, job->arg);
+            if (rc) return rc;
+        }
     }
     return 0;
 }
 
+/* Work through our own share, then steal from the others' */
+static void dlist_foreach_worker(void *arg, size_t self)
+{
+    struct dlist_foreach_job *job = (struct dlist_foreach_job *) arg;
+    size_t c = 0, i;
+    int rc;
+
+    while (!atomic_load_explicit(&job->rc, memory_order_relaxed)) {
+        if (!dlist_foreach_claim(&job->spans[self], false, &c)) {
+            for (i = 1; i < job->nthreads; ++i) {
+                if (dlist_foreach_claim(
+                        &job->spans[(self + i) % job->nthreads], true, &c)) {
+                    break;
+                }
+            }
+            if (i == job->nthreads) return;
+        }
+        rc = dlist_foreach_chunk(job, c);
+        if (rc) dlist_foreach_stop(job, rc);
+    }
+}
+
+DLIST_API int dlist_foreach_parallel(const struct dlist *list,
+    int (*func)(const void *, void *), void *arg, unsigned nthreads)
+{
+    struct dlist_foreach_job job;
+    size_t i;
+    int rc;
+
+    DLIST_ASSERT(list != NULL);
+    DLIST_ASSERT(func != NULL);
+
+    /* Workers walk the chain outside any read-side section */
+    if (list->flags & DLIST_F_RCU) return -EINVAL;
+    if (nthreads > DLIST_MAX_THREADS) nthreads = DLIST_MAX_THREADS;
+    if (nthreads < 2 || list->num_entries < 2) {
+        return dlist_foreach(list, func, arg);
+    }
+
+    job.num_chunks = (size_t) nthreads * DLIST_FOREACH_CHUNKS_PER_THREAD;
+    if (job.num_chunks > list->num_entries) {
+        job.num_chunks = list->num_entries;
+    }
+    job.chunks = (void **) malloc(job.num_chunks * sizeof(void *));
+    if (!job.chunks) return -ENOMEM;
+
+    job.list = list;
+    job.func = func;
+    job.arg = arg;
+    job.num_chunks = dlist_foreach_cut(list, job.chunks, job.num_chunks);
+    job.nthreads = nthreads;
+    atomic_init(&job.rc, 0);
+    for (i = 0; i < nthreads; ++i) {
+        atomic_init(&job.spans[i],
+            DLIST_SPAN(i * job.num_chunks / nthreads,
+                (i + 1) * job.num_chunks / nthreads));
+    }
+
+    dlist_workers_run(dlist_foreach_worker, &job, nthreads, nthreads);
+
+    free(job.chunks);
+    rc = atomic_load(&job.rc);
+    return rc < 0 ? rc : 0;
+}
+
+#else
+
+DLIST_API int dlist_foreach_parallel(const struct dlist *list,
+    int (*func)(const void *, void *), void *arg, unsigned nthreads)
+{
+    if (list->flags & DLIST_F_RCU) return -EINVAL;
+    return dlist_foreach(list, func, arg);
+}
+
+#endif
+
 
 /* Default linked list key-matching callback logic */
-int dlist_compare_string(const void *a, const void *b)
+DLIST_API int dlist_compare_string(const void *a, const void *b)
 {
     return strcmp((const char *) a, (const char *) b);
 }
 
-void *dlist_alloc_key_string(const void *key)
+DLIST_API void *dlist_alloc_key_string(const void *key)
 {
     return (void *) strdup((const char *) key);
 }
 
+/* FNV-1a */
+DLIST_API uint64_t dlist_hash_string(const void *key)
+{
+    const unsigned char *c = (const unsigned char *) key;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (; *c; ++c) {
+        hash ^= *c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+DLIST_API uint64_t dlist_hash_uint64(const void *key)
+{
+    return dlist_mix64(*(const uint64_t *) key);
+}
+
 
 
 
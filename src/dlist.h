@@ -4,6 +4,28 @@
 #define __DLIST_H__
 
 #include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Define DLIST_HEADER_ONLY before including dlist.h to compile the
+ * library into the including file as static inline functions, so small
+ * calls like dlist_iter_next() and dlist_len() can be inlined into the
+ * caller's loops without LTO.  Each such file gets its own copy of the
+ * worker pool and epoch state: lists may be passed between it and other
+ * files, but RCU lists and lock-free sets must only be used through one
+ * copy of the code.
+ */
+#ifdef DLIST_HEADER_ONLY
+#define DLIST_API               static inline
+#else
+#define DLIST_API
+#endif
 
 
 /*
@@ -92,8 +114,270 @@
             __##name##_dlist_foreach_callback, &s);                     \
     }
 
+/*
+ * Recover the structure embedding a struct dlist_link.
+ */
+#define dlist_container_of(ptr, type, member)                           \
+    ((type *) ((char *) (ptr) - offsetof(type, member)))
+
+/*
+ * Macros to declare typed accessors for an intrusive list threaded
+ * through the struct dlist_link member of data_type.  An object can sit
+ * on as many lists as it has links; instantiate once per member.
+ */
+#define DLIST_LINK_FUNC_DECL(name, data_type, member)                   \
+    data_type *name##_dlist_entry(struct dlist_link *link);             \
+    data_type *name##_dlist_first(const struct dlist_ilist *list);      \
+    data_type *name##_dlist_last(const struct dlist_ilist *list);       \
+    data_type *name##_dlist_next(data_type *entry);                     \
+    data_type *name##_dlist_prev(data_type *entry);                     \
+    void name##_dlist_link_append(struct dlist_ilist *list,             \
+        data_type *entry);                                              \
+    void name##_dlist_link_add(struct dlist_ilist *list,                \
+        data_type *entry);                                              \
+    void name##_dlist_unlink(struct dlist_ilist *list,                  \
+        data_type *entry);                                              \
+    data_type *name##_dlist_find(const struct dlist_ilist *list,        \
+        const void *key, int (*match)(const void *, const data_type *));
+
+#define DLIST_LINK_FUNC_CREATE(name, data_type, member)                 \
+    data_type *name##_dlist_entry(struct dlist_link *link)              \
+    {                                                                   \
+        return link ?                                                   \
+            dlist_container_of(link, data_type, member) : NULL;         \
+    }                                                                   \
+    data_type *name##_dlist_first(const struct dlist_ilist *list)       \
+    {                                                                   \
+        return name##_dlist_entry(list->head);                          \
+    }                                                                   \
+    data_type *name##_dlist_last(const struct dlist_ilist *list)        \
+    {                                                                   \
+        return name##_dlist_entry(list->tail);                          \
+    }                                                                   \
+    data_type *name##_dlist_next(data_type *entry)                      \
+    {                                                                   \
+        return name##_dlist_entry(entry->member.next);                  \
+    }                                                                   \
+    data_type *name##_dlist_prev(data_type *entry)                      \
+    {                                                                   \
+        return name##_dlist_entry(entry->member.prev);                  \
+    }                                                                   \
+    void name##_dlist_link_append(struct dlist_ilist *list,             \
+        data_type *entry)                                               \
+    {                                                                   \
+        dlist_ilist_append(list, &entry->member);                       \
+    }                                                                   \
+    void name##_dlist_link_add(struct dlist_ilist *list,                \
+        data_type *entry)                                               \
+    {                                                                   \
+        dlist_ilist_add(list, &entry->member);                          \
+    }                                                                   \
+    void name##_dlist_unlink(struct dlist_ilist *list,                  \
+        data_type *entry)                                               \
+    {                                                                   \
+        dlist_ilist_unlink(list, &entry->member);                       \
+    }                                                                   \
+    data_type *name##_dlist_find(const struct dlist_ilist *list,        \
+        const void *key, int (*match)(const void *, const data_type *)) \
+    {                                                                   \
+        struct dlist_link *link;                                        \
+        for (link = list->head; link; link = link->next) {              \
+            data_type *entry =                                          \
+                dlist_container_of(link, data_type, member);            \
+            if (match(key, entry) == 0) return entry;                   \
+        }                                                               \
+        return NULL;                                                    \
+    }
+
+/*
+ * Macros to generate a list specialized for data_type with key_type
+ * keys.  compare(key, data) is called directly on (const key_type *,
+ * const data_type *) and returns <0, 0 or >0 like key_compare; pass a
+ * function-like macro or a static inline function so the compiler can
+ * inline it into the search loop.  Lists hold data_type pointers in
+ * malloc()ed nodes and never free the data; name##_tlist_unlink()
+ * frees a node from find or a loop and returns its data.  Walk a list
+ * with DLIST_FOREACH, or DLIST_FOREACH_SAFE to unlink as you go.
+ */
+#define DLIST_TYPED_DECL(name, data_type, key_type)                     \
+    struct name##_tlist_node {                                          \
+        data_type *data;                                                \
+        struct name##_tlist_node *prev, *next;                          \
+    };                                                                  \
+    struct name##_tlist {                                               \
+        size_t num_entries;                                             \
+        struct name##_tlist_node *head, *tail;                          \
+    };                                                                  \
+    void name##_tlist_init(struct name##_tlist *list);                  \
+    void name##_tlist_destroy(struct name##_tlist *list);               \
+    size_t name##_tlist_len(const struct name##_tlist *list);           \
+    data_type *name##_tlist_append(struct name##_tlist *list,           \
+        data_type *data);                                               \
+    data_type *name##_tlist_add(struct name##_tlist *list,              \
+        data_type *data);                                               \
+    struct name##_tlist_node *name##_tlist_find(                        \
+        const struct name##_tlist *list, const key_type *key);          \
+    data_type *name##_tlist_get_data(const struct name##_tlist *list,   \
+        const key_type *key);                                           \
+    data_type *name##_tlist_unlink(struct name##_tlist *list,           \
+        struct name##_tlist_node *node);                                \
+    data_type *name##_tlist_remove(struct name##_tlist *list,           \
+        const key_type *key);
+
+#define DLIST_TYPED_CREATE(name, data_type, key_type, compare)          \
+    void name##_tlist_init(struct name##_tlist *list)                   \
+    {                                                                   \
+        list->num_entries = 0;                                          \
+        list->head = list->tail = NULL;                                 \
+    }                                                                   \
+    void name##_tlist_destroy(struct name##_tlist *list)                \
+    {                                                                   \
+        struct name##_tlist_node *node, *next;                          \
+        for (node = list->head; node; node = next) {                    \
+            next = node->next;                                          \
+            free(node);                                                 \
+        }                                                               \
+        name##_tlist_init(list);                                        \
+    }                                                                   \
+    size_t name##_tlist_len(const struct name##_tlist *list)            \
+    {                                                                   \
+        return list->num_entries;                                       \
+    }                                                                   \
+    data_type *name##_tlist_append(struct name##_tlist *list,           \
+        data_type *data)                                                \
+    {                                                                   \
+        struct name##_tlist_node *node = (struct name##_tlist_node *)   \
+            malloc(sizeof(*node));                                      \
+        if (!node) return NULL;                                         \
+        node->data = data;                                              \
+        node->next = NULL;                                              \
+        node->prev = list->tail;                                        \
+        if (list->tail) list->tail->next = node;                        \
+        else list->head = node;                                         \
+        list->tail = node;                                              \
+        list->num_entries++;                                            \
+        return data;                                                    \
+    }                                                                   \
+    data_type *name##_tlist_add(struct name##_tlist *list,              \
+        data_type *data)                                                \
+    {                                                                   \
+        struct name##_tlist_node *node = (struct name##_tlist_node *)   \
+            malloc(sizeof(*node));                                      \
+        if (!node) return NULL;                                         \
+        node->data = data;                                              \
+        node->prev = NULL;                                              \
+        node->next = list->head;                                        \
+        if (list->head) list->head->prev = node;                        \
+        else list->tail = node;                                         \
+        list->head = node;                                              \
+        list->num_entries++;                                            \
+        return data;                                                    \
+    }                                                                   \
+    struct name##_tlist_node *name##_tlist_find(                        \
+        const struct name##_tlist *list, const key_type *key)           \
+    {                                                                   \
+        struct name##_tlist_node *node;                                 \
+        for (node = list->head; node; node = node->next) {              \
+            if (compare(key, (const data_type *) node->data) == 0) {    \
+                return node;                                            \
+            }                                                           \
+        }                                                               \
+        return NULL;                                                    \
+    }                                                                   \
+    data_type *name##_tlist_get_data(const struct name##_tlist *list,   \
+        const key_type *key)                                            \
+    {                                                                   \
+        struct name##_tlist_node *node = name##_tlist_find(list, key);  \
+        return node ? node->data : NULL;                                \
+    }                                                                   \
+    data_type *name##_tlist_unlink(struct name##_tlist *list,           \
+        struct name##_tlist_node *node)                                 \
+    {                                                                   \
+        data_type *data = node->data;                                   \
+        if (node->prev) node->prev->next = node->next;                  \
+        else list->head = node->next;                                   \
+        if (node->next) node->next->prev = node->prev;                  \
+        else list->tail = node->prev;                                   \
+        list->num_entries--;                                            \
+        free(node);                                                     \
+        return data;                                                    \
+    }                                                                   \
+    data_type *name##_tlist_remove(struct name##_tlist *list,           \
+        const key_type *key)                                            \
+    {                                                                   \
+        struct name##_tlist_node *node = name##_tlist_find(list, key);  \
+        return node ? name##_tlist_unlink(list, node) : NULL;           \
+    }
+
+/*
+ * Inline loops over a DLIST_TYPED list; node is a struct
+ * name##_tlist_node pointer and node->data the entry.  The _SAFE form
+ * keeps the successor in tmp so node may be unlinked in the body.
+ */
+#define DLIST_FOREACH(node, list)                                       \
+    for ((node) = (list)->head; (node); (node) = (node)->next)
+
+#define DLIST_FOREACH_SAFE(node, list, tmp)                             \
+    for ((node) = (list)->head;                                         \
+        (node) && ((tmp) = (node)->next, 1); (node) = (tmp))
+
 struct dlist_iter;
 struct dlist_node;
+struct dlist_pool;
+struct dlist_index;
+struct dlist_skip;
+struct dlist_rcu;
+struct dlist_lfnode;
+struct dlist_stripe;
+struct dlist_arena;
+
+
+/* Intrusive list link, embedded in the user's structs */
+struct dlist_link
+{
+    struct dlist_link *prev, *next;
+};
+
+/* Intrusive list State */
+struct dlist_ilist
+{
+    size_t num_entries;
+    struct dlist_link *head, *tail;
+};
+
+
+/* Self-organizing search policies for dlist_get_data() hits */
+enum dlist_search_policy
+{
+    DLIST_SEARCH_NONE = 0,
+    DLIST_SEARCH_MOVE_TO_FRONT,         /* found entry becomes the head */
+    DLIST_SEARCH_TRANSPOSE,             /* found entry swaps with prev */
+    DLIST_SEARCH_COUNT                  /* order by hit count */
+};
+
+
+/*
+ * Per-list operation counters, kept when DLIST_STATS is defined.  The
+ * define changes struct dlist, so it must be the same for the library
+ * and every file including dlist.h.  Finds are the key lookups behind
+ * dlist_get_data() and dlist_remove(); nodes_visited counts the nodes
+ * (index slots, unrolled slots) each one looked at.  Updates are plain
+ * increments by the list's writer; on DLIST_F_RCU lists, calls made
+ * inside dlist_epoch_enter()/dlist_epoch_exit() are not counted.
+ */
+struct dlist_stats
+{
+    uint64_t num_compares;      /* key_compare calls, except by sorts */
+    uint64_t num_finds;
+    uint64_t num_hits;
+    uint64_t num_misses;
+    uint64_t nodes_visited;     /* total over all finds */
+    uint64_t max_visited;       /* most visited by a single find */
+    double mean_visited;        /* set by dlist_stats_get() */
+    uint64_t num_allocs;        /* nodes allocated */
+    uint64_t num_frees;         /* nodes freed */
+    size_t peak_entries;        /* highest num_entries seen */
+};
 
 
 /* Linked list State */
@@ -102,76 +386,567 @@ struct dlist
     size_t num_entries;
     struct dlist_node *head, *tail;
     int (*key_compare)(const void *, const void *);
-    void *(*key_alloc)(void *);
+    void *(*key_alloc)(const void *);
     void (*key_free)(void *);
+    struct dlist_pool *pool;
+    struct dlist_index *index;
+    struct dlist_skip *skip;
+    struct dlist_rcu *rcu;
+    struct dlist_arena *arena;
+    enum dlist_search_policy search_policy;
+    unsigned flags;
+#ifdef DLIST_STATS
+    struct dlist_stats stats;
+#endif
+};
+
+
+/* Keeps fields written by different threads apart */
+#ifndef DLIST_CACHE_LINE
+#define DLIST_CACHE_LINE        64
+#endif
+
+/* Lock-free multi-producer single-consumer queue State */
+struct dlist_mpsc
+{
+    struct dlist_node *head;            /* consumer end, a used dummy */
+    char pad[DLIST_CACHE_LINE - sizeof(struct dlist_node *)];
+    struct dlist_node *tail;            /* producer end */
+    struct dlist_node *free_nodes;      /* recycled nodes */
+    int free_lock;                      /* producers taking free_nodes */
+    struct dlist_pool *pool;
+};
+
+
+/* Blocking FIFO queue State */
+struct dlist_bqueue
+{
+    struct dlist list;
+    uint32_t lock;                      /* futex word */
+    uint32_t seq;                       /* futex word consumers sleep on */
+    uint32_t num_sleepers;
+    int closed;
+    size_t num_wakeups;                 /* consumer wakeups issued */
+};
+
+/* dlist_bqueue timeout that never expires */
+#define DLIST_BQUEUE_FOREVER    UINT64_MAX
+
+
+/* Lock-free ordered set State */
+struct dlist_lfset
+{
+    uintptr_t head;                     /* first node, low bit unused */
+    int (*key_compare)(const void *, const void *);
+    size_t num_entries;
+    struct dlist_lfnode *retired;       /* unlinked, awaiting readers */
+    size_t num_retired;
+    int reclaim_lock;
+};
+
+
+/* Sharded list State */
+struct dlist_sharded
+{
+    struct dlist_stripe *stripes;
+    size_t mask;                        /* number of stripes - 1 */
+    uint64_t (*key_hash)(const void *);
+};
+
+
+/* dlist_init_flags() backend and mode flags */
+#define DLIST_F_UNROLLED        0x0001  /* many data pointers per node */
+#define DLIST_F_SORTED          0x0002  /* keep entries in key order */
+#define DLIST_F_RCU             0x0004  /* lock-free readers, see below */
+#define DLIST_F_STRKEYS         0x0008  /* string keys, cached signature */
+
+
+/* Node pool counters */
+struct dlist_pool_stats
+{
+    size_t num_chunks;          /* chunks allocated from the heap */
+    size_t num_nodes;           /* total node capacity of all chunks */
+    size_t nodes_in_use;        /* nodes handed out to the list */
+    size_t nodes_free;          /* nodes waiting on the freelist */
+    size_t num_allocs;          /* node requests served */
+    size_t num_reuses;          /* requests served from the freelist */
+    size_t num_frees;           /* nodes returned to the pool */
+};
+
+
+/* dlist_key_arena_enable() flags */
+#define DLIST_ARENA_INTERN      0x0001  /* share storage for equal keys */
+
+/* Key arena counters */
+struct dlist_arena_stats
+{
+    size_t num_blocks;          /* blocks allocated from the heap */
+    size_t bytes_reserved;      /* total size of all blocks */
+    size_t bytes_used;          /* bytes handed out to keys */
+    size_t num_keys;            /* keys copied into the arena */
+    size_t num_shared;          /* inserts served by an interned copy */
 };
 
 
 /* List Status */
-int dlist_is_empty(struct dlist *list);
+DLIST_API int dlist_is_empty(struct dlist *list);
 
-size_t dlist_len(struct dlist *list);
+DLIST_API size_t dlist_len(struct dlist *list);
+
+/*
+ * Copy the list's counters into stats.  Returns -ENOTSUP unless the
+ * library was built with DLIST_STATS.  dlist_stats_reset() zeroes them,
+ * peak_entries restarting from the current length.
+ */
+DLIST_API int dlist_stats_get(const struct dlist *list,
+    struct dlist_stats *stats);
+
+DLIST_API void dlist_stats_reset(struct dlist *list);
 
 
 /* List Initialization */
-int dlist_init(struct dlist *list, int 
+DLIST_API int dlist_init(struct dlist *list, int 
     (*key_compare_cb)(const void *, const void *));
 
-void dlist_destroy(struct dlist *list);
+/*
+ * Initialize with DLIST_F_* flags.  DLIST_F_UNROLLED stores a small
+ * array of data pointers per cache-line sized node so traversal walks
+ * memory sequentially.  It does not combine with the node pool.
+ *
+ * DLIST_F_SORTED makes dlist_append() and dlist_add() insert by
+ * key_compare, after any equal keys, and keeps a skip list over the
+ * nodes so lookups, removals and the bound searches take O(log n).
+ * Data changed through dlist_iter_set_data() must keep its key.
+ *
+ * DLIST_F_STRKEYS is for lists whose data are NUL-terminated string
+ * keys, with key_compare returning 0 exactly for equal strings (as
+ * dlist_compare_string does).  Each node caches a signature of its key,
+ * a hash and the length, taken on insert; linear lookups compare that
+ * first and call key_compare only on a match, so a miss costs one
+ * integer compare per node.  Not combinable with DLIST_F_UNROLLED; data
+ * changed through dlist_iter_set_data() must keep its key, and lists
+ * only splice with lists in the same mode.
+ */
+DLIST_API int dlist_init_flags(struct dlist *list,
+    int (*key_compare_cb)(const void *, const void *), unsigned flags);
+
+DLIST_API void dlist_destroy(struct dlist *list);
 
 /*
- * Enable internal memory management.
+ * Enable the slab node pool.  Nodes are carved out of chunks of
+ * chunk_nodes nodes (0 selects DLIST_POOL_CHUNK_NODES) and recycled
+ * through a freelist instead of going back to the heap.  The list must
+ * be empty.  The pool is released by dlist_destroy() of the last list
+ * using it.
  */
-void dlist_set_key_alloc_funcs(struct dlist *list,
-    void *(*key_alloc_cb)(void *),
+DLIST_API int dlist_pool_enable(struct dlist *list, size_t chunk_nodes);
+
+DLIST_API int dlist_pool_get_stats(const struct dlist *list,
+    struct dlist_pool_stats *stats);
+
+/*
+ * Let dlist_get_data() move the entries it finds toward the head so
+ * frequently requested keys are found after a few comparisons.  Only
+ * for linked lists that are not sorted.
+ */
+DLIST_API int dlist_set_search_policy(struct dlist *list,
+    enum dlist_search_policy policy);
+
+/*
+ * Enable the hash index (key hash -> node) used by dlist_get_data() and
+ * dlist_remove() instead of a linear scan.  key_hash_cb must agree with
+ * the list's key_compare.  The index is built once the list holds
+ * threshold entries (0 builds it immediately).  With duplicate keys,
+ * which duplicate an indexed lookup finds is unspecified.  Not available
+ * on unrolled lists.  Data changed through dlist_iter_set_data() must
+ * keep its key; use dlist_iter_replace() to change it.
+ */
+DLIST_API int dlist_index_enable(struct dlist *list,
+    uint64_t (*key_hash_cb)(const void *), size_t threshold);
+
+/*
+ * Enable internal memory management.  key_alloc_cb copies each key as it
+ * is inserted and dlist_append()/dlist_add() return the stored copy;
+ * key_free_cb releases it when the entry is removed.  Returns -EINVAL
+ * once a key arena is enabled, leaving the arena in charge of the keys.
+ */
+DLIST_API int dlist_set_key_alloc_funcs(struct dlist *list,
+    void *(*key_alloc_cb)(const void *),
     void (*key_free_cb)(void *));
 
+/*
+ * Copy string keys into a per-list arena instead of one heap allocation
+ * per key.  Keys are bump allocated from block_size byte blocks (0 picks
+ * DLIST_ARENA_BLOCK_BYTES) and are only released, all at once, by
+ * dlist_clear() or dlist_destroy(); removing an entry leaves its bytes in
+ * place.  With DLIST_ARENA_INTERN, equal keys share one copy.  Replaces
+ * any key_alloc/key_free callbacks.  The list must be empty and not use
+ * DLIST_F_RCU.  Arena lists cannot be spliced or detached into since the
+ * keys would outlive their storage.  Returns -EBUSY, -EINVAL, -EEXIST or
+ * -ENOMEM on failure.
+ */
+DLIST_API int dlist_key_arena_enable(struct dlist *list, size_t block_size,
+    unsigned flags);
+
+/*
+ * Copy the key arena counters into stats.  Returns -EINVAL if the list
+ * has no arena.
+ */
+DLIST_API int dlist_key_arena_get_stats(const struct dlist *list,
+    struct dlist_arena_stats *stats);
+
 
 /* Data Modification */
-void *dlist_append(struct dlist *list, void *data);
+DLIST_API void *dlist_append(struct dlist *list, void *data);
+
+DLIST_API void *dlist_add(struct dlist *list, void *data);
 
-void *dlist_add(struct dlist *list, void *data);
+/*
+ * Insert count entries at once: data[] keeps its order at the tail
+ * (append) or ends up reversed at the head (add), just as with one
+ * dlist_append()/dlist_add() call per element.  With a node pool (see
+ * dlist_pool_enable()) the nodes come from a single reservation.  A list
+ * without one gets the batch as one heap block, freed once every node
+ * in it has been removed, wherever the nodes were spliced to; batches
+ * too small to fill half a DLIST_BATCH_BYTES block allocate each node on
+ * its own.  The list's allocator is never changed.  Returns 0 or
+ * -ENOMEM, in which case a linked list is left unchanged.
+ */
+DLIST_API int dlist_append_bulk(struct dlist *list, void **data, size_t count);
 
-void *dlist_get_data(struct dlist *list, void *data);
+DLIST_API int dlist_add_bulk(struct dlist *list, void **data, size_t count);
 
-void *dlist_remove(struct dlist *list, const void *key);
+DLIST_API void *dlist_get_data(struct dlist *list, void *data);
 
-void dlist_clear(struct dlist *list);
+DLIST_API void *dlist_remove(struct dlist *list, const void *key);
 
-int dlist_reset(struct dlist *list);
+/*
+ * Remove every entry for which pred returns non-zero in one pass,
+ * calling key_free on each.  pred must not modify the list.  Returns
+ * the number of entries removed.
+ */
+DLIST_API size_t dlist_remove_if(struct dlist *list,
+    int (*pred)(const void *, void *), void *arg);
+
+/*
+ * Like dlist_remove_if(), but the removed entries are moved, in order,
+ * onto out, an empty list initialized with dlist_init(), instead of
+ * being freed.  out takes over the list's key functions and shares its
+ * node pool, so dlist_clear(out) or dlist_destroy(out) frees the whole
+ * chain at once.  Not for unrolled or sorted lists.
+ */
+DLIST_API int dlist_remove_if_detach(struct dlist *list,
+    int (*pred)(const void *, void *), void *arg, struct dlist *out);
+
+/*
+ * Move nodes between lists without allocating.  dlist_splice() moves
+ * every node of src onto the tail of dst in O(1).  dlist_splice_range()
+ * moves the range [first, last) of src (last NULL for the end) and
+ * dlist_split_at() moves iter up to the end of list onto the empty list
+ * out; both count the range to keep num_entries exact.  Lists with a
+ * hash index pay O(moved nodes) to keep the indexes in sync.  Both lists
+ * must use the same node pool (an empty list without one joins the
+ * other's).  Sorted lists are not supported; unrolled lists only by
+ * dlist_splice().
+ */
+DLIST_API int dlist_splice(struct dlist *dst, struct dlist *src);
+
+DLIST_API int dlist_splice_range(struct dlist *dst, struct dlist *src,
+    struct dlist_iter *first, struct dlist_iter *last);
+
+DLIST_API int dlist_split_at(struct dlist *list, struct dlist_iter *iter,
+    struct dlist *out);
+
+/*
+ * Stable in-place sort by key_compare.  Relinks the existing nodes with
+ * a bottom-up merge of the list's natural runs, so sorted or reversed
+ * input takes one pass.  No-op on sorted lists, -EINVAL on unrolled ones.
+ */
+DLIST_API int dlist_sort(struct dlist *list);
+
+/*
+ * dlist_sort() on up to nthreads threads: the list is cut into equal
+ * runs that are sorted concurrently and then merged pairwise, each level
+ * of the merge tree in parallel.  key_compare must be safe to call from
+ * several threads.  Small lists, or builds with DLIST_NOTHREADS, sort on
+ * the calling thread.
+ */
+DLIST_API int dlist_sort_parallel(struct dlist *list, unsigned nthreads);
+
+DLIST_API void dlist_clear(struct dlist *list);
+
+/*
+ * Clear the list, keeping its comparator, key functions and node pool.
+ */
+DLIST_API int dlist_reset(struct dlist *list);
 
 /* Iterator */
-struct dlist_iter *dlist_iter(const struct dlist *list);
+DLIST_API struct dlist_iter *dlist_iter(const struct dlist *list);
 
-struct dlist_iter *dlist_iter_next(struct dlist *list,
+DLIST_API struct dlist_iter *dlist_iter_next(struct dlist *list,
     struct dlist_iter *iter);
 
-struct dlist_iter *dlist_iter_remove(struct dlist *list,
+DLIST_API struct dlist_iter *dlist_iter_remove(struct dlist *list,
     struct dlist_iter *iter);
 
-void *dlist_iter_get_data(struct dlist_iter *iter);
+DLIST_API void *dlist_iter_get_data(struct dlist_iter *iter);
+
+DLIST_API const void *dlist_iter_get_key(struct dlist_iter *iter);
+
+/*
+ * Sorted lists only: iterator at the first entry whose key is not less
+ * than (lower) or greater than (upper) key, NULL if there is none.
+ */
+DLIST_API struct dlist_iter *dlist_lower_bound(const struct dlist *list,
+    const void *key);
+
+DLIST_API struct dlist_iter *dlist_upper_bound(const struct dlist *list,
+    const void *key);
+
+DLIST_API void dlist_iter_set_data(struct dlist_iter *iter, void *data);
+
+/*
+ * dlist_iter_set_data() for data whose key may differ: the hash index
+ * and the DLIST_F_STRKEYS signature are updated to the new key.  data is
+ * stored as given, without key_alloc.  Returns -EINVAL on RCU lists and
+ * on sorted lists when the key changes.
+ */
+DLIST_API int dlist_iter_replace(struct dlist *list, struct dlist_iter *iter,
+    void *data);
+
+
+
+/*
+ * Intrusive lists.  Links are owned by the caller; nothing is allocated
+ * or freed and no key callbacks are involved.
+ */
+DLIST_API void dlist_ilist_init(struct dlist_ilist *list);
+
+DLIST_API void dlist_ilist_append(struct dlist_ilist *list, struct dlist_link *link);
+
+DLIST_API void dlist_ilist_add(struct dlist_ilist *list, struct dlist_link *link);
+
+DLIST_API void dlist_ilist_unlink(struct dlist_ilist *list, struct dlist_link *link);
+
+DLIST_API int dlist_ilist_foreach(const struct dlist_ilist *list,
+    int (*func)(struct dlist_link *, void *), void *arg);
+
+
+/*
+ * Lock-free MPSC queue on dlist nodes.  dlist_mpsc_push_tail() may be
+ * called from any number of threads, dlist_mpsc_pop_head() from one
+ * consumer thread at a time.  Nodes come from a pool of chunk_nodes
+ * node chunks (0 for the default) and are recycled on pop, so a queue
+ * that stays under its high-water mark does not allocate.  Pushing never
+ * blocks on the queue itself; only taking a recycled node is serialized
+ * between producers.
+ *
+ * Queued data must not be NULL: pop returns NULL when the queue is
+ * empty, or when the next push has not finished linking yet.  Destroy
+ * drops whatever is still queued without touching the data.
+ */
+DLIST_API int dlist_mpsc_init(struct dlist_mpsc *queue, size_t chunk_nodes);
+
+DLIST_API void dlist_mpsc_destroy(struct dlist_mpsc *queue);
+
+DLIST_API int dlist_mpsc_push_tail(struct dlist_mpsc *queue, void *data);
+
+DLIST_API void *dlist_mpsc_pop_head(struct dlist_mpsc *queue);
+
+/* Node pool counters; every node ever handed out counts as in use */
+DLIST_API int dlist_mpsc_get_stats(struct dlist_mpsc *queue,
+    struct dlist_pool_stats *stats);
+
+
+/*
+ * Blocking FIFO queue for producer/consumer hand-off between any number
+ * of threads.  Nodes come from a pool of chunk_nodes node chunks (0 for
+ * the default) and are recycled.  push fails with -EPIPE once the queue
+ * is closed.  A sleeping consumer is woken only when a push makes the
+ * queue non-empty, or by a consumer leaving entries behind, never once
+ * per item.
+ *
+ * pop_timed waits up to timeout_ns (0 polls, DLIST_BQUEUE_FOREVER
+ * blocks) and returns NULL when it runs out or the queue is closed and
+ * drained; pop blocks.  pop_batch waits the same way for the first
+ * entry, then takes up to count entries in one lock hold and returns
+ * how many.  close wakes every consumer; entries already queued can
+ * still be popped.  Queued data must not be NULL; destroy drops what
+ * is left without touching the data.
+ */
+DLIST_API int dlist_bqueue_init(struct dlist_bqueue *queue, size_t chunk_nodes);
+
+DLIST_API void dlist_bqueue_destroy(struct dlist_bqueue *queue);
+
+DLIST_API size_t dlist_bqueue_len(struct dlist_bqueue *queue);
+
+DLIST_API int dlist_bqueue_push(struct dlist_bqueue *queue, void *data);
+
+DLIST_API void *dlist_bqueue_pop(struct dlist_bqueue *queue);
+
+DLIST_API void *dlist_bqueue_pop_timed(struct dlist_bqueue *queue,
+    uint64_t timeout_ns);
+
+DLIST_API size_t dlist_bqueue_pop_batch(struct dlist_bqueue *queue, void **data,
+    size_t count, uint64_t timeout_ns);
+
+DLIST_API void dlist_bqueue_close(struct dlist_bqueue *queue);
+
+
+/*
+ * Epoch-based reclamation.  Code between dlist_epoch_enter() and
+ * dlist_epoch_exit() may hold pointers into lock-free structures; memory
+ * they unlink is freed only after every thread inside at the time has
+ * left.  Sections nest.  enter fails with -ENOMEM only if the thread's
+ * first record cannot be allocated.
+ */
+DLIST_API int dlist_epoch_enter(void);
+
+DLIST_API void dlist_epoch_exit(void);
+
+/*
+ * DLIST_F_RCU lists take lock-free readers alongside one writer at a
+ * time (writers serialize among themselves).  Readers wrap dlist_iter,
+ * dlist_iter_next, dlist_get_data and dlist_foreach calls, and any use
+ * of the data they return, in dlist_epoch_enter()/dlist_epoch_exit();
+ * they never write shared memory beyond their own epoch record.  The
+ * writer links nodes with release stores and defers freeing removed
+ * nodes, and calling key_free on their data, until every reader that
+ * could see them has left.  Writers must not change data in place.
+ * Not combinable with the unrolled or sorted backends, a hash index,
+ * search policies, sorting, splicing or dlist_remove_if_detach().
+ *
+ * Reclamation runs every DLIST_RCU_RECLAIM_EVERY removals, or on
+ * dlist_rcu_reclaim(), which never blocks.  dlist_rcu_barrier() waits
+ * until all removed nodes are freed; the writer must not be inside an
+ * epoch section itself.
+ */
+DLIST_API void dlist_rcu_reclaim(struct dlist *list);
+
+DLIST_API void dlist_rcu_barrier(struct dlist *list);
+
+/*
+ * Lock-free ordered set (Harris-Michael list) of unique keys by
+ * key_compare.  insert, remove, get_data, foreach and len are safe from
+ * any number of threads; each runs inside its own epoch section and
+ * nodes unlinked by remove are freed once no reader can still see them.
+ * insert returns -EEXIST for a key already present; remove returns the
+ * removed data or NULL.  foreach visits entries in key order, skipping
+ * ones deleted meanwhile.  init and destroy need exclusive access.
+ */
+DLIST_API int dlist_lfset_init(struct dlist_lfset *set,
+    int (*key_compare_cb)(const void *, const void *));
+
+DLIST_API void dlist_lfset_destroy(struct dlist_lfset *set);
 
-const void *dlist_iter_get_key(struct dlist_iter *iter);
+DLIST_API size_t dlist_lfset_len(const struct dlist_lfset *set);
 
-void dlist_iter_set_data(struct dlist_iter *iter, void *data);
+DLIST_API int dlist_lfset_insert(struct dlist_lfset *set, void *data);
 
+DLIST_API void *dlist_lfset_remove(struct dlist_lfset *set, const void *key);
+
+DLIST_API void *dlist_lfset_get_data(struct dlist_lfset *set, const void *key);
+
+DLIST_API int dlist_lfset_foreach(struct dlist_lfset *set,
+    int (*func)(const void *, void *), void *arg);
+
+
+/*
+ * Key-partitioned list for concurrent writers: num_stripes lists (0 for
+ * DLIST_SHARDED_STRIPES, rounded up to a power of two), each behind its
+ * own mutex, with a key's stripe picked by key_hash.  The hash is run
+ * through a 64-bit finalizer first, so one that fills only the low 32
+ * bits spreads over the stripes too.  add, append, get_data and remove
+ * lock only the key's stripe, so operations on keys in different
+ * stripes run in parallel.  flags are passed to each stripe's
+ * dlist_init_flags(); DLIST_F_RCU is rejected with -EINVAL.
+ *
+ * len and foreach lock one stripe at a time, so under concurrent writes
+ * they see each stripe at a different moment.  foreach visits stripe by
+ * stripe with a stripe's lock held; func must not call back into the
+ * set.  Data returned by get_data may be removed by another thread at
+ * any time after; callers share data across threads by their own rules.
+ * index_enable puts a hash index, keyed by key_hash, on every stripe.
+ * init and destroy need exclusive access.
+ */
+DLIST_API int dlist_sharded_init(struct dlist_sharded *set, size_t num_stripes,
+    int (*key_compare_cb)(const void *, const void *),
+    uint64_t (*key_hash_cb)(const void *), unsigned flags);
+
+DLIST_API void dlist_sharded_destroy(struct dlist_sharded *set);
+
+DLIST_API int dlist_sharded_index_enable(struct dlist_sharded *set, size_t threshold);
+
+/*
+ * dlist_set_key_alloc_funcs() on every stripe.  Returns -EINVAL, with no
+ * stripe changed, if any stripe has a key arena.
+ */
+DLIST_API int dlist_sharded_set_key_alloc_funcs(struct dlist_sharded *set,
+    void *(*key_alloc_cb)(const void *), void (*key_free_cb)(void *));
+
+DLIST_API size_t dlist_sharded_len(struct dlist_sharded *set);
+
+DLIST_API void *dlist_sharded_add(struct dlist_sharded *set, void *data);
+
+DLIST_API void *dlist_sharded_append(struct dlist_sharded *set, void *data);
+
+DLIST_API void *dlist_sharded_get_data(struct dlist_sharded *set, void *key);
+
+DLIST_API void *dlist_sharded_remove(struct dlist_sharded *set, const void *key);
+
+DLIST_API int dlist_sharded_foreach(struct dlist_sharded *set,
+    int (*func)(const void *, void *), void *arg);
 
 
 /* Foreach operation */
-int dlist_foreach(const struct dlist *list,
+DLIST_API int dlist_foreach(const struct dlist *list,
     int (*func)(const void *, void *), void *arg);
 
+/*
+ * dlist_foreach() on up to nthreads threads, counting the caller.  The
+ * list is cut into chunks; each thread starts on its own run of chunks
+ * and steals from the others' once it is done.  Entries are visited in
+ * no particular order, func must be thread-safe and must not modify the
+ * list.  A negative return aborts and is returned (over any positive
+ * one); a positive return stops with 0.  Chunks already running when
+ * func stops may still visit a few more entries.  -EINVAL on DLIST_F_RCU
+ * lists.
+ */
+DLIST_API int dlist_foreach_parallel(const struct dlist *list,
+    int (*func)(const void *, void *), void *arg, unsigned nthreads);
+
+/*
+ * Stop the threads kept for parallel operations, e.g. before exit or
+ * fork.  The next parallel call starts them again.
+ */
+DLIST_API void dlist_workers_shutdown(void);
+
 
 /* Default Linked List Initialization Key Comparator Func */
-int dlist_compare_string(const void *a, const void *b);
+DLIST_API int dlist_compare_string(const void *a, const void *b);
+
+/* Hash index callbacks for dlist_compare_string and uint64_t keys */
+DLIST_API uint64_t dlist_hash_string(const void *key);
+
+DLIST_API uint64_t dlist_hash_uint64(const void *key);
 
 
 /*
  * Default key allocation function for string keys.  Use free() for the
- * key_free_cb.
+ * key_free_cb.  Lists holding many short keys should prefer
+ * dlist_key_arena_enable().
  */
-void *dlist_alloc_key_string(const void *key);
+DLIST_API void *dlist_alloc_key_string(const void *key);
+
+#ifdef __cplusplus
+}
+#endif
+
 
+/* The implementation, for DLIST_HEADER_ONLY builds */
+#ifdef DLIST_HEADER_ONLY
+#include "dlist.c"
+#endif
 
 
 
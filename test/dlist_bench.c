@@ -0,0 +1,1019 @@
+// "dlist_bench.c"
+
+/*
+ * Standalone benchmark for regression tracking.  Every operation of the
+ * mix runs repeats times on a list of count entries, after warmup untimed
+ * runs.  Per-entry operations are timed in batches of batch calls, whole
+ * list operations once per run; each timing becomes one ns/op sample and
+ * the samples of all runs are summarized as mean and p50/p99/p999.
+ *
+ *   dlist_bench [-n count] [-k int|str] [-b backend] [-o op,op,...]
+ *               [-r repeats] [-w warmup] [-l lookups] [-B batch]
+ *               [-s seed] [-c out.csv] [-j out.json] [-P]
+ *
+ * Counts take a k, M or G suffix.  Backends: linked, pooled, unrolled,
+ * indexed, sorted and strkeys (string keys only).  Ops: add, append, get,
+ * remove, iterate, foreach, clear and reset.  get and remove do lookups
+ * random keys per run (every key with an index, 100 otherwise); lookups
+ * that walk the list are timed one at a time.
+ *
+ * On Linux the timed runs are also measured with perf_event_open()
+ * counters (cycles, instructions, L1d/LLC/dTLB read misses and branch
+ * misses, user space only), reported per op.  Counters the kernel or
+ * CPU does not offer are left out; -P turns them off.  The timer reads
+ * between batches are included in the counts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include <dlist.h>
+
+#define ARRAY_LEN(array)    (sizeof(array) / sizeof(array[0]))
+
+#define BENCH_KEY_STR_LEN       32
+#define BENCH_DEFAULT_COUNT     1000000
+#define BENCH_DEFAULT_LOOKUPS   100
+#define BENCH_DEFAULT_BATCH     64
+#define BENCH_DEFAULT_REPEATS   5
+#define BENCH_DEFAULT_WARMUP    1
+#define BENCH_DEFAULT_OPS       \
+    "add,append,get,remove,iterate,foreach,clear,reset"
+
+enum bench_counter
+{
+    BENCH_CYCLES,
+    BENCH_INSTRUCTIONS,
+    BENCH_L1D_MISSES,
+    BENCH_LLC_MISSES,
+    BENCH_DTLB_MISSES,
+    BENCH_BRANCH_MISSES,
+    BENCH_NUM_COUNTERS
+};
+
+static const char *bench_counter_names[BENCH_NUM_COUNTERS] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses",
+    "branch_misses"
+};
+
+enum bench_key_type
+{
+    BENCH_KEYS_INT,
+    BENCH_KEYS_STR
+};
+
+struct bench_backend
+{
+    const char *name;
+    unsigned flags;             /* dlist_init_flags() flags */
+    bool pool;
+    bool index;
+};
+
+static const struct bench_backend bench_backends[] = {
+    { "linked",     0,                  false,  false },
+    { "pooled",     0,                  true,   false },
+    { "unrolled",   DLIST_F_UNROLLED,   false,  false },
+    { "indexed",    0,                  false,  true  },
+    { "sorted",     DLIST_F_SORTED,     false,  false },
+    { "strkeys",    DLIST_F_STRKEYS,    false,  false },
+};
+
+struct bench_config
+{
+    size_t count;
+    size_t lookups;
+    size_t batch;
+    size_t lookup_batch;        /* batch for get and remove */
+    unsigned repeats;
+    unsigned warmup;
+    bool counters;              /* read perf counters, unless -P */
+    uint64_t seed;
+    enum bench_key_type key_type;
+    const struct bench_backend *backend;
+    const char *ops;
+    const char *csv_path;
+    const char *json_path;
+};
+
+struct bench_samples
+{
+    double *ns;                 /* ns/op, one per timed batch or run */
+    size_t len;
+    size_t cap;
+};
+
+struct bench_result
+{
+    char op[16];
+    size_t samples;
+    double mean;
+    double p50;
+    double p99;
+    double p999;
+    double min;
+    double max;
+    double counters[BENCH_NUM_COUNTERS];    /* per op, < 0 if unavailable */
+};
+
+/* One perf event fd per counter, -1 where it could not be opened */
+struct bench_counters
+{
+    int fd[BENCH_NUM_COUNTERS];
+    int error;                  /* errno of the first failed open */
+};
+
+/* Keys and the order get and remove visit them in */
+struct bench_keys
+{
+    void **keys;
+    size_t *order;
+    void *storage;
+};
+
+struct bench_foreach_state
+{
+    struct bench_samples *samples;
+    size_t batch;
+    size_t seen;
+    uint64_t start;
+};
+
+struct bench_op
+{
+    const char *name;
+    bool populate;              /* list holds every key before the run */
+    bool lookups;               /* runs do lookups ops rather than count */
+    void (*run)(const struct bench_config *, struct dlist *,
+            struct bench_keys *, struct bench_samples *);
+};
+
+
+/**** Helpers ****/
+
+static uint64_t bench_time_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t) now.tv_sec) * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+static void *bench_malloc(size_t size)
+{
+    void *ptr = malloc(size);
+
+    if (!ptr) {
+        fprintf(stderr, "dlist_bench: out of memory\n");
+        exit(1);
+    }
+    return ptr;
+}
+
+static uint64_t bench_rand(uint64_t *state)
+{
+    /* xorshift64*, state must not be 0 */
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static int bench_compare_uint64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+static int bench_compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+static void bench_sample(struct bench_samples *samples, uint64_t ns,
+    size_t ops)
+{
+    if (samples->len == samples->cap) {
+        samples->cap = samples->cap ? samples->cap * 2 : 1024;
+        samples->ns = (double *) realloc(samples->ns,
+                samples->cap * sizeof(*samples->ns));
+        if (!samples->ns) {
+            fprintf(stderr, "dlist_bench: out of memory\n");
+            exit(1);
+        }
+    }
+    samples->ns[samples->len++] = (double) ns / (double) ops;
+}
+
+/* Nearest-rank percentile of sorted samples, permille of 1000 */
+static double bench_percentile(const struct bench_samples *samples,
+    size_t permille)
+{
+    size_t rank = (samples->len * permille + 999) / 1000;
+
+    return samples->ns[rank ? rank - 1 : 0];
+}
+
+static void bench_summarize(struct bench_samples *samples, const char *op,
+    struct bench_result *result)
+{
+    double sum = 0;
+    size_t i;
+
+    memset(result, 0, sizeof(*result));
+    snprintf(result->op, sizeof(result->op), "%s", op);
+    if (!samples->len) return;
+
+    qsort(samples->ns, samples->len, sizeof(*samples->ns),
+            bench_compare_double);
+    for (i = 0; i < samples->len; ++i) {
+        sum += samples->ns[i];
+    }
+    result->samples = samples->len;
+    result->mean = sum / samples->len;
+    result->p50 = bench_percentile(samples, 500);
+    result->p99 = bench_percentile(samples, 990);
+    result->p999 = bench_percentile(samples, 999);
+    result->min = samples->ns[0];
+    result->max = samples->ns[samples->len - 1];
+}
+
+
+/**** Keys and Lists ****/
+
+static void bench_keys_generate(const struct bench_config *config,
+    struct bench_keys *keys)
+{
+    uint64_t state = config->seed ^ 0x9E3779B97F4A7C15ULL, value;
+    size_t i, j, tmp;
+
+    keys->keys = (void **) bench_malloc(config->count * sizeof(void *));
+    keys->order = (size_t *) bench_malloc(config->count * sizeof(size_t));
+
+    /* i * odd constant is a bijection, so every key is distinct */
+    if (config->key_type == BENCH_KEYS_INT) {
+        uint64_t *values = (uint64_t *) bench_malloc(config->count *
+                sizeof(*values));
+
+        for (i = 0; i < config->count; ++i) {
+            values[i] = (i + config->seed) * 0x9E3779B97F4A7C15ULL;
+            keys->keys[i] = &values[i];
+        }
+        keys->storage = values;
+    } else {
+        char *strings = (char *) bench_malloc(config->count *
+                (BENCH_KEY_STR_LEN + 1));
+
+        for (i = 0; i < config->count; ++i) {
+            char *key = &strings[i * (BENCH_KEY_STR_LEN + 1)];
+
+            value = (i + config->seed) * 0x9E3779B97F4A7C15ULL;
+            snprintf(key, BENCH_KEY_STR_LEN + 1, "%016llx%016llx",
+                    (unsigned long long) value,
+                    (unsigned long long) bench_rand(&state));
+            keys->keys[i] = key;
+        }
+        keys->storage = strings;
+    }
+
+    for (i = 0; i < config->count; ++i) {
+        keys->order[i] = i;
+    }
+    for (i = config->count; i > 1; --i) {
+        j = bench_rand(&state) % i;
+        tmp = keys->order[i - 1];
+        keys->order[i - 1] = keys->order[j];
+        keys->order[j] = tmp;
+    }
+}
+
+static void bench_keys_free(struct bench_keys *keys)
+{
+    free(keys->keys);
+    free(keys->order);
+    free(keys->storage);
+}
+
+static void bench_list_init(const struct bench_config *config,
+    struct dlist *list)
+{
+    bool str = config->key_type == BENCH_KEYS_STR;
+    int rc;
+
+    rc = dlist_init_flags(list,
+            str ? dlist_compare_string : bench_compare_uint64,
+            config->backend->flags);
+    if (rc == 0 && config->backend->pool) {
+        rc = dlist_pool_enable(list, 0);
+    }
+    if (rc == 0 && config->backend->index) {
+        rc = dlist_index_enable(list,
+                str ? dlist_hash_string : dlist_hash_uint64, 0);
+    }
+    if (rc < 0) {
+        fprintf(stderr, "dlist_bench: list init failed: %s\n", strerror(-rc));
+        exit(1);
+    }
+}
+
+static void bench_list_populate(const struct bench_config *config,
+    struct dlist *list, struct bench_keys *keys)
+{
+    size_t i;
+
+    for (i = 0; i < config->count; ++i) {
+        if (!dlist_append(list, keys->keys[i])) {
+            fprintf(stderr, "dlist_bench: out of memory\n");
+            exit(1);
+        }
+    }
+}
+
+
+/**** Hardware Counters ****/
+
+#ifdef __linux__
+static int bench_counter_open(enum bench_counter counter)
+{
+    struct perf_event_attr attr;
+    const unsigned long long read_miss = (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    switch (counter) {
+    case BENCH_CYCLES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case BENCH_INSTRUCTIONS:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case BENCH_L1D_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | read_miss;
+        break;
+    case BENCH_LLC_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_LL | read_miss;
+        break;
+    case BENCH_DTLB_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | read_miss;
+        break;
+    default:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    }
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+static void bench_counters_open(const struct bench_config *config,
+    struct bench_counters *counters)
+{
+    int i;
+
+    counters->error = config->counters ? 0 : EPERM;
+    for (i = 0; i < BENCH_NUM_COUNTERS; ++i) {
+        counters->fd[i] = -1;
+#ifdef __linux__
+        if (!config->counters) continue;
+        counters->fd[i] = bench_counter_open((enum bench_counter) i);
+        if (counters->fd[i] < 0 && !counters->error) {
+            counters->error = errno;
+        }
+#else
+        counters->error = ENOSYS;
+#endif
+    }
+}
+
+static void bench_counters_close(struct bench_counters *counters)
+{
+    int i;
+
+    for (i = 0; i < BENCH_NUM_COUNTERS; ++i) {
+        if (counters->fd[i] >= 0) close(counters->fd[i]);
+        counters->fd[i] = -1;
+    }
+}
+
+static void bench_counters_start(struct bench_counters *counters)
+{
+#ifdef __linux__
+    int i;
+
+    for (i = 0; i < BENCH_NUM_COUNTERS; ++i) {
+        if (counters->fd[i] < 0) continue;
+        ioctl(counters->fd[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(counters->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#else
+    (void) counters;
+#endif
+}
+
+/* Add the counts since start to totals, scaled up if multiplexed */
+static void bench_counters_stop(struct bench_counters *counters,
+    double totals[BENCH_NUM_COUNTERS])
+{
+#ifdef __linux__
+    uint64_t value[3];          /* count, time enabled, time running */
+    int i;
+
+    for (i = 0; i < BENCH_NUM_COUNTERS; ++i) {
+        if (counters->fd[i] < 0) continue;
+        ioctl(counters->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (i = 0; i < BENCH_NUM_COUNTERS; ++i) {
+        if (counters->fd[i] < 0) continue;
+        if (read(counters->fd[i], value, sizeof(value)) != sizeof(value)) {
+            close(counters->fd[i]);
+            counters->fd[i] = -1;
+            continue;
+        }
+        if (value[2]) {
+            totals[i] += (double) value[0] * value[1] / value[2];
+        }
+    }
+#else
+    (void) counters;
+    (void) totals;
+#endif
+}
+
+static bool bench_counters_any(const struct bench_counters *counters)
+{
+    int i;
+
+    for (i = 0; i < BENCH_NUM_COUNTERS; ++i) {
+        if (counters->fd[i] >= 0) return true;
+    }
+    return false;
+}
+
+
+/**** Operations ****/
+
+static void bench_run_insert(const struct bench_config *config,
+    struct dlist *list, struct bench_keys *keys,
+    struct bench_samples *samples, void *(*insert)(struct dlist *, void *))
+{
+    size_t i, j, end;
+    uint64_t start;
+
+    for (i = 0; i < config->count; i = end) {
+        end = i + config->batch < config->count ? i + config->batch :
+            config->count;
+        start = bench_time_ns();
+        for (j = i; j < end; ++j) {
+            insert(list, keys->keys[j]);
+        }
+        bench_sample(samples, bench_time_ns() - start, end - i);
+    }
+}
+
+static void bench_run_add(const struct bench_config *config,
+    struct dlist *list, struct bench_keys *keys,
+    struct bench_samples *samples)
+{
+    bench_run_insert(config, list, keys, samples, dlist_add);
+}
+
+static void bench_run_append(const struct bench_config *config,
+    struct dlist *list, struct bench_keys *keys,
+    struct bench_samples *samples)
+{
+    bench_run_insert(config, list, keys, samples, dlist_append);
+}
+
+static void bench_run_get(const struct bench_config *config,
+    struct dlist *list, struct bench_keys *keys,
+    struct bench_samples *samples)
+{
+    uint64_t state = config->seed ^ 0x2545F4914F6CDD1DULL, start;
+    size_t i, j, end, misses = 0;
+
+    for (i = 0; i < config->lookups; i = end) {
+        end = i + config->lookup_batch < config->lookups ?
+            i + config->lookup_batch : config->lookups;
+        start = bench_time_ns();
+        for (j = i; j < end; ++j) {
+            void *key = keys->keys[bench_rand(&state) % config->count];
+
+            misses += dlist_get_data(list, key) != key;
+        }
+        bench_sample(samples, bench_time_ns() - start, end - i);
+    }
+    if (misses) {
+        fprintf(stderr, "dlist_bench: get missed %zu keys\n", misses);
+        exit(1);
+    }
+}
+
+static void bench_run_remove(const struct bench_config *config,
+    struct dlist *list, struct bench_keys *keys,
+    struct bench_samples *samples)
+{
+    size_t i, j, end, misses = 0;
+    uint64_t start;
+
+    for (i = 0; i < config->lookups; i = end) {
+        end = i + config->lookup_batch < config->lookups ?
+            i + config->lookup_batch : config->lookups;
+        start = bench_time_ns();
+        for (j = i; j < end; ++j) {
+            misses += !dlist_remove(list, keys->keys[keys->order[j]]);
+        }
+        bench_sample(samples, bench_time_ns() - start, end - i);
+    }
+    if (misses) {
+        fprintf(stderr, "dlist_bench: remove missed %zu keys\n", misses);
+        exit(1);
+    }
+}
+
+static void bench_run_iterate(const struct bench_config *config,
+    struct dlist *list, struct bench_keys *keys,
+    struct bench_samples *samples)
+{
+    struct dlist_iter *iter;
+    volatile uintptr_t sink = 0;
+    size_t n = 0;
+    uint64_t start = bench_time_ns(), now;
+
+    (void) keys;
+    for (iter = dlist_iter(list); iter; iter = dlist_iter_next(list, iter)) {
+        sink += (uintptr_t) dlist_iter_get_data(iter);
+        if (++n == config->batch) {
+            now = bench_time_ns();
+            bench_sample(samples, now - start, n);
+            start = now;
+            n = 0;
+        }
+    }
+    if (n) bench_sample(samples, bench_time_ns() - start, n);
+}
+
+static int bench_foreach_func(const void *data, void *arg)
+{
+    struct bench_foreach_state *state = (struct bench_foreach_state *) arg;
+    uint64_t now;
+
+    (void) data;
+    if (++state->seen == state->batch) {
+        now = bench_time_ns();
+        bench_sample(state->samples, now - state->start, state->seen);
+        state->start = now;
+        state->seen = 0;
+    }
+    return 0;
+}
+
+static void bench_run_foreach(const struct bench_config *config,
+    struct dlist *list, struct bench_keys *keys,
+    struct bench_samples *samples)
+{
+    struct bench_foreach_state state;
+
+    (void) keys;
+    state.samples = samples;
+    state.batch = config->batch;
+    state.seen = 0;
+    state.start = bench_time_ns();
+    dlist_foreach(list, bench_foreach_func, &state);
+    if (state.seen) {
+        bench_sample(samples, bench_time_ns() - state.start, state.seen);
+    }
+}
+
+static void bench_run_clear(const struct bench_config *config,
+    struct dlist *list, struct bench_keys *keys,
+    struct bench_samples *samples)
+{
+    uint64_t start = bench_time_ns();
+
+    (void) keys;
+    dlist_clear(list);
+    bench_sample(samples, bench_time_ns() - start, config->count);
+}
+
+static void bench_run_reset(const struct bench_config *config,
+    struct dlist *list, struct bench_keys *keys,
+    struct bench_samples *samples)
+{
+    uint64_t start = bench_time_ns();
+
+    (void) keys;
+    dlist_reset(list);
+    bench_sample(samples, bench_time_ns() - start, config->count);
+}
+
+static const struct bench_op bench_ops[] = {
+    { "add",        false,  false,  bench_run_add },
+    { "append",     false,  false,  bench_run_append },
+    { "get",        true,   true,   bench_run_get },
+    { "remove",     true,   true,   bench_run_remove },
+    { "iterate",    true,   false,  bench_run_iterate },
+    { "foreach",    true,   false,  bench_run_foreach },
+    { "clear",      true,   false,  bench_run_clear },
+    { "reset",      true,   false,  bench_run_reset },
+};
+
+static const struct bench_op *bench_op_find(const char *name, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_LEN(bench_ops); ++i) {
+        if (strlen(bench_ops[i].name) == len &&
+                strncmp(bench_ops[i].name, name, len) == 0) {
+            return &bench_ops[i];
+        }
+    }
+    return NULL;
+}
+
+/* warmup untimed runs, then repeats timed ones, each on a fresh list */
+static void bench_op_run(const struct bench_config *config,
+    const struct bench_op *op, struct bench_keys *keys,
+    struct bench_counters *counters, struct bench_result *result)
+{
+    struct bench_samples samples, scratch;
+    double totals[BENCH_NUM_COUNTERS] = { 0 };
+    struct dlist list;
+    unsigned run;
+    int i;
+
+    memset(&samples, 0, sizeof(samples));
+    memset(&scratch, 0, sizeof(scratch));
+    for (run = 0; run < config->warmup + config->repeats; ++run) {
+        bench_list_init(config, &list);
+        if (op->populate) {
+            bench_list_populate(config, &list, keys);
+        }
+        scratch.len = 0;
+        if (run < config->warmup) {
+            op->run(config, &list, keys, &scratch);
+        } else {
+            bench_counters_start(counters);
+            op->run(config, &list, keys, &samples);
+            bench_counters_stop(counters, totals);
+        }
+        dlist_destroy(&list);
+    }
+    bench_summarize(&samples, op->name, result);
+    for (i = 0; i < BENCH_NUM_COUNTERS; ++i) {
+        result->counters[i] = counters->fd[i] < 0 ? -1 :
+            totals[i] / ((double) config->repeats *
+                    (op->lookups ? config->lookups : config->count));
+    }
+    free(samples.ns);
+    free(scratch.ns);
+}
+
+
+/**** Output ****/
+
+static void bench_write_csv(const struct bench_config *config,
+    const struct bench_result *results, size_t num_results)
+{
+    FILE *file = fopen(config->csv_path, "w");
+    size_t i;
+    int c;
+
+    if (!file) {
+        fprintf(stderr, "dlist_bench: %s: %s\n", config->csv_path,
+                strerror(errno));
+        exit(1);
+    }
+    fprintf(file, "op,backend,keys,count,repeats,batch,samples,"
+            "mean_ns,p50_ns,p99_ns,p999_ns,min_ns,max_ns");
+    for (c = 0; c < BENCH_NUM_COUNTERS; ++c) {
+        fprintf(file, ",%s", bench_counter_names[c]);
+    }
+    fprintf(file, "\n");
+    for (i = 0; i < num_results; ++i) {
+        fprintf(file, "%s,%s,%s,%zu,%u,%zu,%zu,%.2f,%.2f,%.2f,%.2f,%.2f,"
+                "%.2f", results[i].op, config->backend->name,
+                config->key_type == BENCH_KEYS_INT ? "int" : "str",
+                config->count, config->repeats, config->batch,
+                results[i].samples, results[i].mean, results[i].p50,
+                results[i].p99, results[i].p999, results[i].min,
+                results[i].max);
+        /* Unavailable counters are left empty */
+        for (c = 0; c < BENCH_NUM_COUNTERS; ++c) {
+            if (results[i].counters[c] < 0) {
+                fprintf(file, ",");
+            } else {
+                fprintf(file, ",%.3f", results[i].counters[c]);
+            }
+        }
+        fprintf(file, "\n");
+    }
+    fclose(file);
+}
+
+static void bench_write_json(const struct bench_config *config,
+    const struct bench_result *results, size_t num_results)
+{
+    FILE *file = fopen(config->json_path, "w");
+    size_t i;
+    int c;
+
+    if (!file) {
+        fprintf(stderr, "dlist_bench: %s: %s\n", config->json_path,
+                strerror(errno));
+        exit(1);
+    }
+    fprintf(file, "{\n  \"backend\": \"%s\",\n  \"keys\": \"%s\",\n"
+            "  \"count\": %zu,\n  \"lookups\": %zu,\n  \"repeats\": %u,\n"
+            "  \"warmup\": %u,\n  \"batch\": %zu,\n  \"seed\": %llu,\n"
+            "  \"results\": [\n", config->backend->name,
+            config->key_type == BENCH_KEYS_INT ? "int" : "str",
+            config->count, config->lookups, config->repeats,
+            config->warmup, config->batch,
+            (unsigned long long) config->seed);
+    for (i = 0; i < num_results; ++i) {
+        fprintf(file, "    { \"op\": \"%s\", \"samples\": %zu, "
+                "\"mean_ns\": %.2f, \"p50_ns\": %.2f, \"p99_ns\": %.2f, "
+                "\"p999_ns\": %.2f, \"min_ns\": %.2f, \"max_ns\": %.2f",
+                results[i].op, results[i].samples, results[i].mean,
+                results[i].p50, results[i].p99, results[i].p999,
+                results[i].min, results[i].max);
+        /* Unavailable counters are null */
+        for (c = 0; c < BENCH_NUM_COUNTERS; ++c) {
+            if (results[i].counters[c] < 0) {
+                fprintf(file, ", \"%s\": null", bench_counter_names[c]);
+            } else {
+                fprintf(file, ", \"%s\": %.3f", bench_counter_names[c],
+                        results[i].counters[c]);
+            }
+        }
+        fprintf(file, " }%s\n", i + 1 < num_results ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+}
+
+static void bench_print_counters(const struct bench_result *results,
+    size_t num_results)
+{
+    static const char *headers[BENCH_NUM_COUNTERS] = {
+        "cycles", "instr", "L1d miss", "LLC miss", "dTLB miss", "br miss"
+    };
+    size_t i;
+    int c;
+
+    printf("\nper op    ");
+    for (c = 0; c < BENCH_NUM_COUNTERS; ++c) {
+        printf(" %10s", headers[c]);
+    }
+    printf(" %6s\n", "IPC");
+    for (i = 0; i < num_results; ++i) {
+        printf("%-10s", results[i].op);
+        for (c = 0; c < BENCH_NUM_COUNTERS; ++c) {
+            if (results[i].counters[c] < 0) {
+                printf(" %10s", "-");
+            } else {
+                printf(" %10.2f", results[i].counters[c]);
+            }
+        }
+        if (results[i].counters[BENCH_CYCLES] > 0 &&
+                results[i].counters[BENCH_INSTRUCTIONS] >= 0) {
+            printf(" %6.2f\n", results[i].counters[BENCH_INSTRUCTIONS] /
+                    results[i].counters[BENCH_CYCLES]);
+        } else {
+            printf(" %6s\n", "-");
+        }
+    }
+}
+
+
+/**** Command Line ****/
+
+static void bench_usage(void)
+{
+    size_t i;
+
+    fprintf(stderr, "usage: dlist_bench [-n count] [-k int|str] "
+            "[-b backend] [-o op,op,...]\n"
+            "                   [-r repeats] [-w warmup] [-l lookups] "
+            "[-B batch]\n"
+            "                   [-s seed] [-c out.csv] [-j out.json] [-P]\n"
+            "backends:");
+    for (i = 0; i < ARRAY_LEN(bench_backends); ++i) {
+        fprintf(stderr, " %s", bench_backends[i].name);
+    }
+    fprintf(stderr, "\nops:");
+    for (i = 0; i < ARRAY_LEN(bench_ops); ++i) {
+        fprintf(stderr, " %s", bench_ops[i].name);
+    }
+    fprintf(stderr, "\n");
+    exit(2);
+}
+
+/* Decimal count with an optional k, M or G suffix */
+static size_t bench_parse_count(const char *arg, bool allow_zero)
+{
+    unsigned long long value;
+    char *end;
+
+    errno = 0;
+    value = strtoull(arg, &end, 10);
+    switch (*end) {
+    case 'k': case 'K': value *= 1000; end++; break;
+    case 'm': case 'M': value *= 1000000; end++; break;
+    case 'g': case 'G': value *= 1000000000; end++; break;
+    }
+    if (errno || end == arg || *end || (!value && !allow_zero)) {
+        fprintf(stderr, "dlist_bench: bad count '%s'\n", arg);
+        bench_usage();
+    }
+    return (size_t) value;
+}
+
+static void bench_parse_args(int argc, char **argv,
+    struct bench_config *config)
+{
+    bool lookups_set = false;
+    size_t i;
+    int opt;
+
+    memset(config, 0, sizeof(*config));
+    config->count = BENCH_DEFAULT_COUNT;
+    config->batch = BENCH_DEFAULT_BATCH;
+    config->repeats = BENCH_DEFAULT_REPEATS;
+    config->warmup = BENCH_DEFAULT_WARMUP;
+    config->counters = true;
+    config->seed = 1;
+    config->key_type = BENCH_KEYS_INT;
+    config->backend = &bench_backends[0];
+    config->ops = BENCH_DEFAULT_OPS;
+
+    while ((opt = getopt(argc, argv, "n:k:b:o:r:w:l:B:s:c:j:Ph")) != -1) {
+        switch (opt) {
+        case 'n':
+            config->count = bench_parse_count(optarg, false);
+            break;
+        case 'k':
+            if (strcmp(optarg, "int") == 0) {
+                config->key_type = BENCH_KEYS_INT;
+            } else if (strcmp(optarg, "str") == 0) {
+                config->key_type = BENCH_KEYS_STR;
+            } else {
+                bench_usage();
+            }
+            break;
+        case 'b':
+            config->backend = NULL;
+            for (i = 0; i < ARRAY_LEN(bench_backends); ++i) {
+                if (strcmp(optarg, bench_backends[i].name) == 0) {
+                    config->backend = &bench_backends[i];
+                }
+            }
+            if (!config->backend) bench_usage();
+            break;
+        case 'o':
+            config->ops = optarg;
+            break;
+        case 'r':
+            config->repeats = (unsigned) bench_parse_count(optarg, false);
+            break;
+        case 'w':
+            config->warmup = (unsigned) bench_parse_count(optarg, true);
+            break;
+        case 'l':
+            config->lookups = bench_parse_count(optarg, false);
+            lookups_set = true;
+            break;
+        case 'B':
+            config->batch = bench_parse_count(optarg, false);
+            break;
+        case 's':
+            config->seed = bench_parse_count(optarg, true);
+            break;
+        case 'c':
+            config->csv_path = optarg;
+            break;
+        case 'j':
+            config->json_path = optarg;
+            break;
+        case 'P':
+            config->counters = false;
+            break;
+        default:
+            bench_usage();
+        }
+    }
+    if (optind != argc) bench_usage();
+
+    if (!lookups_set) {
+        config->lookups = config->backend->index ? config->count :
+            BENCH_DEFAULT_LOOKUPS;
+    }
+    if (config->lookups > config->count) {
+        config->lookups = config->count;
+    }
+    config->lookup_batch = config->backend->index ||
+        (config->backend->flags & DLIST_F_SORTED) ? config->batch : 1;
+    if ((config->backend->flags & DLIST_F_STRKEYS) &&
+            config->key_type != BENCH_KEYS_STR) {
+        fprintf(stderr, "dlist_bench: strkeys needs -k str\n");
+        exit(2);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct bench_config config;
+    struct bench_keys keys;
+    struct bench_counters counters;
+    struct bench_result *results;
+    const struct bench_op *op;
+    const char *name, *end;
+    size_t num_results = 0, max_results;
+
+    bench_parse_args(argc, argv, &config);
+
+    /* Validate the whole mix before spending time on keys */
+    max_results = 1;
+    for (name = config.ops; *name; ++name) {
+        max_results += *name == ',';
+    }
+    for (name = config.ops; *name; name = *end ? end + 1 : end) {
+        end = strchr(name, ',');
+        if (!end) end = name + strlen(name);
+        if (!bench_op_find(name, end - name)) {
+            fprintf(stderr, "dlist_bench: unknown op '%.*s'\n",
+                    (int) (end - name), name);
+            bench_usage();
+        }
+    }
+    results = (struct bench_result *) bench_malloc(max_results *
+            sizeof(*results));
+
+    printf("dlist_bench: %zu %s keys, %s backend, %zu lookups, "
+            "%u+%u runs, batch %zu\n", config.count,
+            config.key_type == BENCH_KEYS_INT ? "int" : "str",
+            config.backend->name, config.lookups, config.warmup,
+            config.repeats, config.batch);
+    bench_keys_generate(&config, &keys);
+    bench_counters_open(&config, &counters);
+    if (config.counters && !bench_counters_any(&counters)) {
+        printf("perf counters unavailable: %s\n", strerror(counters.error));
+    }
+
+    printf("%-8s %9s %10s %10s %10s %10s %10s\n", "op", "samples",
+            "mean ns", "p50 ns", "p99 ns", "p999 ns", "max ns");
+    for (name = config.ops; *name; name = *end ? end + 1 : end) {
+        end = strchr(name, ',');
+        if (!end) end = name + strlen(name);
+        op = bench_op_find(name, end - name);
+        bench_op_run(&config, op, &keys, &counters, &results[num_results]);
+        printf("%-8s %9zu %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+                results[num_results].op, results[num_results].samples,
+                results[num_results].mean, results[num_results].p50,
+                results[num_results].p99, results[num_results].p999,
+                results[num_results].max);
+        fflush(stdout);
+        num_results++;
+    }
+    if (bench_counters_any(&counters)) {
+        bench_print_counters(results, num_results);
+    }
+    bench_counters_close(&counters);
+
+    if (config.csv_path) {
+        bench_write_csv(&config, results, num_results);
+    }
+    if (config.json_path) {
+        bench_write_json(&config, results, num_results);
+    }
+    bench_keys_free(&keys);
+    free(results);
+    return 0;
+}
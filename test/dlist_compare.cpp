@@ -0,0 +1,505 @@
+// "dlist_compare.cpp"
+
+/*
+ * Runs the same workloads on dlist and on the usual alternatives, so the
+ * cost of dlist's node layout and key_compare indirection shows up next
+ * to a baseline:
+ *
+ *   append     count appends to an empty container
+ *   lookup     lookups finds of random keys
+ *   remove     lookups removals of distinct random keys
+ *   iterate    one pass over count entries
+ *   churn      count rounds of remove-from-front plus append
+ *
+ *   dlist_compare [-n count] [-l lookups] [-r repeats]
+ *
+ * Every cell is the median of repeats runs, in ns per operation (per
+ * entry for iterate).  Keys are distinct uint64_t; the pointer-based
+ * containers link to them, the std:: ones store copies.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/queue.h>
+
+#include <algorithm>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include <dlist.h>
+
+#define ARRAY_LEN(array)    (sizeof(array) / sizeof(array[0]))
+
+#define COMPARE_DEFAULT_COUNT       100000
+#define COMPARE_DEFAULT_LOOKUPS     1000
+#define COMPARE_DEFAULT_REPEATS     5
+
+enum compare_workload
+{
+    COMPARE_APPEND,
+    COMPARE_LOOKUP,
+    COMPARE_REMOVE,
+    COMPARE_ITERATE,
+    COMPARE_CHURN,
+    COMPARE_NUM_WORKLOADS
+};
+
+static const char *compare_workload_names[COMPARE_NUM_WORKLOADS] = {
+    "append", "lookup", "remove", "iterate", "churn"
+};
+
+struct compare_config
+{
+    size_t count;
+    size_t lookups;
+    unsigned repeats;
+    std::vector<uint64_t> keys;
+    std::vector<size_t> probes;     /* random distinct key indexes */
+};
+
+static volatile uint64_t compare_sink;
+
+
+/**** Helpers ****/
+
+static uint64_t compare_time_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t) now.tv_sec) * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+static int compare_uint64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+static inline int compare_uint64_inline(const uint64_t *a, const uint64_t *b)
+{
+    return (*a > *b) - (*a < *b);
+}
+
+DLIST_TYPED_DECL(compare, uint64_t, uint64_t)
+DLIST_TYPED_CREATE(compare, uint64_t, uint64_t, compare_uint64_inline)
+
+
+/**** Contenders ****/
+
+/*
+ * Each contender wraps one container behind the same five calls:
+ * append(key), find(key), remove(key), sum() over every key and
+ * pop_front().
+ */
+
+struct compare_dlist
+{
+    static const char *name() { return "dlist"; }
+    struct dlist list;
+
+    compare_dlist() { dlist_init(&list, compare_uint64); }
+    ~compare_dlist() { dlist_destroy(&list); }
+    void append(uint64_t *key) { dlist_append(&list, key); }
+    bool find(uint64_t *key) { return dlist_get_data(&list, key) != NULL; }
+    bool remove(uint64_t *key) { return dlist_remove(&list, key) != NULL; }
+    uint64_t sum()
+    {
+        struct dlist_iter *iter;
+        uint64_t total = 0;
+
+        for (iter = dlist_iter(&list); iter;
+                iter = dlist_iter_next(&list, iter)) {
+            total += *(const uint64_t *) dlist_iter_get_data(iter);
+        }
+        return total;
+    }
+    uint64_t *pop_front()
+    {
+        struct dlist_iter *iter = dlist_iter(&list);
+        uint64_t *key = (uint64_t *) dlist_iter_get_data(iter);
+
+        dlist_iter_remove(&list, iter);
+        return key;
+    }
+};
+
+struct compare_dlist_indexed : compare_dlist
+{
+    static const char *name() { return "dlist+index"; }
+
+    compare_dlist_indexed()
+    {
+        dlist_index_enable(&list, dlist_hash_uint64, 0);
+    }
+};
+
+struct compare_dlist_typed
+{
+    static const char *name() { return "dlist typed"; }
+    struct compare_tlist list;
+
+    compare_dlist_typed() { compare_tlist_init(&list); }
+    ~compare_dlist_typed() { compare_tlist_destroy(&list); }
+    void append(uint64_t *key) { compare_tlist_append(&list, key); }
+    bool find(uint64_t *key) { return compare_tlist_get_data(&list, key); }
+    bool remove(uint64_t *key) { return compare_tlist_remove(&list, key); }
+    uint64_t sum()
+    {
+        struct compare_tlist_node *node;
+        uint64_t total = 0;
+
+        DLIST_FOREACH(node, &list) {
+            total += *node->data;
+        }
+        return total;
+    }
+    uint64_t *pop_front() { return compare_tlist_unlink(&list, list.head); }
+};
+
+struct compare_std_list
+{
+    static const char *name() { return "std::list"; }
+    std::list<uint64_t> list;
+
+    void append(uint64_t *key) { list.push_back(*key); }
+    bool find(uint64_t *key)
+    {
+        return std::find(list.begin(), list.end(), *key) != list.end();
+    }
+    bool remove(uint64_t *key)
+    {
+        std::list<uint64_t>::iterator it =
+            std::find(list.begin(), list.end(), *key);
+
+        if (it == list.end()) return false;
+        list.erase(it);
+        return true;
+    }
+    uint64_t sum()
+    {
+        uint64_t total = 0;
+
+        for (std::list<uint64_t>::iterator it = list.begin();
+                it != list.end(); ++it) {
+            total += *it;
+        }
+        return total;
+    }
+    uint64_t *pop_front() { list.pop_front(); return NULL; }
+};
+
+struct compare_std_deque
+{
+    static const char *name() { return "std::deque"; }
+    std::deque<uint64_t> deque;
+
+    void append(uint64_t *key) { deque.push_back(*key); }
+    bool find(uint64_t *key)
+    {
+        return std::find(deque.begin(), deque.end(), *key) != deque.end();
+    }
+    bool remove(uint64_t *key)
+    {
+        std::deque<uint64_t>::iterator it =
+            std::find(deque.begin(), deque.end(), *key);
+
+        if (it == deque.end()) return false;
+        deque.erase(it);
+        return true;
+    }
+    uint64_t sum()
+    {
+        uint64_t total = 0;
+
+        for (std::deque<uint64_t>::iterator it = deque.begin();
+                it != deque.end(); ++it) {
+            total += *it;
+        }
+        return total;
+    }
+    uint64_t *pop_front() { deque.pop_front(); return NULL; }
+};
+
+/*
+ * A hash map has no front, so a FIFO of appended keys gives pop_front()
+ * the oldest entry; keys removed by key are skipped there.
+ */
+struct compare_std_unordered_map
+{
+    static const char *name() { return "unordered_map"; }
+    std::unordered_map<uint64_t, uint64_t *> map;
+    std::deque<uint64_t *> order;
+
+    void append(uint64_t *key)
+    {
+        if (map.emplace(*key, key).second) order.push_back(key);
+    }
+    bool find(uint64_t *key) { return map.find(*key) != map.end(); }
+    bool remove(uint64_t *key) { return map.erase(*key) != 0; }
+    uint64_t sum()
+    {
+        uint64_t total = 0;
+
+        for (std::unordered_map<uint64_t, uint64_t *>::iterator it =
+                map.begin(); it != map.end(); ++it) {
+            total += it->first;
+        }
+        return total;
+    }
+    uint64_t *pop_front()
+    {
+        uint64_t *key;
+
+        do {
+            key = order.front();
+            order.pop_front();
+        } while (map.erase(*key) == 0);
+        return key;
+    }
+};
+
+struct compare_tq_entry
+{
+    uint64_t *key;
+    TAILQ_ENTRY(compare_tq_entry) link;
+};
+
+TAILQ_HEAD(compare_tq_head, compare_tq_entry);
+
+struct compare_tailq
+{
+    static const char *name() { return "TAILQ"; }
+    struct compare_tq_head head;
+
+    compare_tailq() { TAILQ_INIT(&head); }
+    ~compare_tailq()
+    {
+        while (!TAILQ_EMPTY(&head)) {
+            pop_front();
+        }
+    }
+    void append(uint64_t *key)
+    {
+        struct compare_tq_entry *entry =
+            (struct compare_tq_entry *) malloc(sizeof(*entry));
+
+        if (!entry) abort();
+        entry->key = key;
+        TAILQ_INSERT_TAIL(&head, entry, link);
+    }
+    struct compare_tq_entry *lookup(const uint64_t *key)
+    {
+        struct compare_tq_entry *entry;
+
+        TAILQ_FOREACH(entry, &head, link) {
+            if (*entry->key == *key) return entry;
+        }
+        return NULL;
+    }
+    bool find(uint64_t *key) { return lookup(key) != NULL; }
+    bool remove(uint64_t *key)
+    {
+        struct compare_tq_entry *entry = lookup(key);
+
+        if (!entry) return false;
+        TAILQ_REMOVE(&head, entry, link);
+        free(entry);
+        return true;
+    }
+    uint64_t sum()
+    {
+        struct compare_tq_entry *entry;
+        uint64_t total = 0;
+
+        TAILQ_FOREACH(entry, &head, link) {
+            total += *entry->key;
+        }
+        return total;
+    }
+    uint64_t *pop_front()
+    {
+        struct compare_tq_entry *entry = TAILQ_FIRST(&head);
+        uint64_t *key = entry->key;
+
+        TAILQ_REMOVE(&head, entry, link);
+        free(entry);
+        return key;
+    }
+};
+
+
+/**** Workloads ****/
+
+/* ns/op of one run of workload on a fresh container */
+template <typename T>
+static double compare_run(struct compare_config *config,
+    enum compare_workload workload)
+{
+    std::vector<uint64_t> &keys = config->keys;
+    T container;
+    uint64_t start, misses = 0;
+    size_t i, ops;
+
+    if (workload != COMPARE_APPEND) {
+        for (i = 0; i < config->count; ++i) {
+            container.append(&keys[i]);
+        }
+    }
+
+    start = compare_time_ns();
+    switch (workload) {
+    case COMPARE_APPEND:
+        for (i = 0; i < config->count; ++i) {
+            container.append(&keys[i]);
+        }
+        ops = config->count;
+        break;
+    case COMPARE_LOOKUP:
+        for (i = 0; i < config->lookups; ++i) {
+            misses += !container.find(&keys[config->probes[i]]);
+        }
+        ops = config->lookups;
+        break;
+    case COMPARE_REMOVE:
+        for (i = 0; i < config->lookups; ++i) {
+            misses += !container.remove(&keys[config->probes[i]]);
+        }
+        ops = config->lookups;
+        break;
+    case COMPARE_ITERATE:
+        compare_sink = container.sum();
+        ops = config->count;
+        break;
+    default:
+        /* Entries leave in insertion order, so key i goes back in */
+        for (i = 0; i < config->count; ++i) {
+            container.pop_front();
+            container.append(&keys[i]);
+        }
+        ops = config->count;
+        break;
+    }
+    start = compare_time_ns() - start;
+
+    if (misses) {
+        fprintf(stderr, "dlist_compare: %s %s missed %llu keys\n",
+                T::name(), compare_workload_names[workload],
+                (unsigned long long) misses);
+        exit(1);
+    }
+    return (double) start / (double) ops;
+}
+
+template <typename T>
+static void compare_contender(struct compare_config *config,
+    double results[COMPARE_NUM_WORKLOADS])
+{
+    std::vector<double> runs(config->repeats);
+    int w;
+    unsigned r;
+
+    for (w = 0; w < COMPARE_NUM_WORKLOADS; ++w) {
+        for (r = 0; r < config->repeats; ++r) {
+            runs[r] = compare_run<T>(config, (enum compare_workload) w);
+        }
+        std::sort(runs.begin(), runs.end());
+        results[w] = runs[config->repeats / 2];
+    }
+}
+
+
+/**** Command Line ****/
+
+static void compare_usage(void)
+{
+    fprintf(stderr, "usage: dlist_compare [-n count] [-l lookups] "
+            "[-r repeats]\n");
+    exit(2);
+}
+
+static size_t compare_parse_count(const char *arg)
+{
+    char *end;
+    unsigned long long value = strtoull(arg, &end, 10);
+
+    if (end == arg || *end || !value) compare_usage();
+    return (size_t) value;
+}
+
+int main(int argc, char **argv)
+{
+    struct compare_config config;
+    static const char *names[] = {
+        compare_dlist::name(), compare_dlist_indexed::name(),
+        compare_dlist_typed::name(), compare_std_list::name(),
+        compare_std_deque::name(), compare_std_unordered_map::name(),
+        compare_tailq::name()
+    };
+    double results[ARRAY_LEN(names)][COMPARE_NUM_WORKLOADS];
+    std::vector<size_t> order;
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    size_t i, j, c;
+    int opt, w;
+
+    config.count = COMPARE_DEFAULT_COUNT;
+    config.lookups = COMPARE_DEFAULT_LOOKUPS;
+    config.repeats = COMPARE_DEFAULT_REPEATS;
+    while ((opt = getopt(argc, argv, "n:l:r:h")) != -1) {
+        switch (opt) {
+        case 'n': config.count = compare_parse_count(optarg); break;
+        case 'l': config.lookups = compare_parse_count(optarg); break;
+        case 'r': config.repeats = compare_parse_count(optarg); break;
+        default: compare_usage();
+        }
+    }
+    if (optind != argc) compare_usage();
+    if (config.lookups > config.count) config.lookups = config.count;
+
+    /* Distinct keys in random order, probes a random distinct subset */
+    config.keys.resize(config.count);
+    order.resize(config.count);
+    for (i = 0; i < config.count; ++i) {
+        config.keys[i] = (i + 1) * 0x9E3779B97F4A7C15ULL;
+        order[i] = i;
+    }
+    for (i = config.count; i > 1; --i) {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        j = (state * 0x2545F4914F6CDD1DULL) % i;
+        std::swap(order[i - 1], order[j]);
+    }
+    config.probes.assign(order.begin(), order.begin() + config.lookups);
+
+    compare_contender<compare_dlist>(&config, results[0]);
+    compare_contender<compare_dlist_indexed>(&config, results[1]);
+    compare_contender<compare_dlist_typed>(&config, results[2]);
+    compare_contender<compare_std_list>(&config, results[3]);
+    compare_contender<compare_std_deque>(&config, results[4]);
+    compare_contender<compare_std_unordered_map>(&config, results[5]);
+    compare_contender<compare_tailq>(&config, results[6]);
+
+    printf("dlist_compare: %zu keys, %zu lookups, median of %u runs, "
+            "ns/op\n", config.count, config.lookups, config.repeats);
+    printf("%-8s", "");
+    for (c = 0; c < ARRAY_LEN(names); ++c) {
+        printf(" %13s", names[c]);
+    }
+    printf("\n");
+    for (w = 0; w < COMPARE_NUM_WORKLOADS; ++w) {
+        printf("%-8s", compare_workload_names[w]);
+        for (c = 0; c < ARRAY_LEN(names); ++c) {
+            printf(" %13.1f", results[c][w]);
+        }
+        printf("\n");
+    }
+    return 0;
+}
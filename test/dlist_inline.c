@@ -0,0 +1,50 @@
+// "dlist_inline.c"
+
+/*
+ * Built against the header-only library; dlist_test.c calls these to
+ * check that mode and to time its loops against the linked library.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DLIST_HEADER_ONLY
+#include <dlist.h>
+
+static int test_inline_compare(const void *a, const void *b)
+{
+    return *(uint64_t *)a < *(uint64_t *)b ? -1 :
+        *(uint64_t *)a > *(uint64_t *)b;
+}
+
+bool test_inline_run(void)
+{
+    uint64_t values[64], key;
+    struct dlist list;
+    size_t i;
+    bool success = true;
+
+    success &= dlist_init(&list, test_inline_compare) == 0;
+    for (i = 0; i < 64; ++i) {
+        values[i] = i;
+        success &= dlist_append(&list, &values[i]) == &values[i];
+    }
+    key = 17;
+    success &= dlist_get_data(&list, &key) == &values[17];
+    success &= dlist_remove(&list, &key) == &values[17];
+    success &= dlist_get_data(&list, &key) == NULL;
+    success &= dlist_len(&list) == 63;
+    dlist_destroy(&list);
+    return success;
+}
+
+uint64_t test_inline_iter_sum(struct dlist *list)
+{
+    struct dlist_iter *iter;
+    uint64_t sum = 0;
+
+    for (iter = dlist_iter(list); iter; iter = dlist_iter_next(list, iter)) {
+        sum += *(uint64_t *) dlist_iter_get_data(iter);
+    }
+    return sum;
+}
@@ -0,0 +1,100 @@
+// "dlist_stats.c"
+
+/*
+ * Built against the header-only library with DLIST_STATS, which changes
+ * struct dlist; lists from here must not be passed to dlist_test.c.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DLIST_HEADER_ONLY
+#define DLIST_STATS
+#include <dlist.h>
+
+static int test_stats_compare(const void *a, const void *b)
+{
+    return *(uint64_t *)a < *(uint64_t *)b ? -1 :
+        *(uint64_t *)a > *(uint64_t *)b;
+}
+
+bool test_stats_run(void)
+{
+    uint64_t values[10], key;
+    struct dlist_stats stats;
+    struct dlist list;
+    size_t i;
+    bool success = true;
+
+    dlist_init(&list, test_stats_compare);
+    for (i = 0; i < 10; ++i) {
+        values[i] = i;
+        dlist_append(&list, &values[i]);
+    }
+    key = 5;
+    success &= dlist_get_data(&list, &key) == &values[5];
+    key = 42;
+    success &= dlist_get_data(&list, &key) == NULL;
+    key = 0;
+    success &= dlist_remove(&list, &key) == &values[0];
+
+    /* 6 nodes to find 5, all 10 to miss 42, 1 to find 0 */
+    success &= dlist_stats_get(&list, &stats) == 0;
+    success &= stats.num_finds == 3;
+    success &= stats.num_hits == 2 && stats.num_misses == 1;
+    success &= stats.nodes_visited == 17 && stats.max_visited == 10;
+    success &= stats.mean_visited > 5.6 && stats.mean_visited < 5.7;
+    success &= stats.num_compares == 17;
+    success &= stats.num_allocs == 10 && stats.num_frees == 1;
+    success &= stats.peak_entries == 10;
+
+    dlist_stats_reset(&list);
+    success &= dlist_stats_get(&list, &stats) == 0;
+    success &= stats.num_finds == 0 && stats.num_allocs == 0;
+    success &= stats.peak_entries == 9;
+    dlist_destroy(&list);
+
+    /* An index looks at a slot or two instead of the whole chain */
+    dlist_init(&list, test_stats_compare);
+    dlist_index_enable(&list, dlist_hash_uint64, 0);
+    for (i = 0; i < 10; ++i) {
+        dlist_append(&list, &values[i]);
+    }
+    key = 9;
+    success &= dlist_get_data(&list, &key) == &values[9];
+    success &= dlist_stats_get(&list, &stats) == 0;
+    success &= stats.num_hits == 1 && stats.max_visited <= 2;
+    dlist_destroy(&list);
+
+    /* Unrolled lists count slots, and nodes holding many entries */
+    dlist_init_flags(&list, test_stats_compare, DLIST_F_UNROLLED);
+    for (i = 0; i < 10; ++i) {
+        dlist_append(&list, &values[i]);
+    }
+    key = 3;
+    success &= dlist_get_data(&list, &key) == &values[3];
+    success &= dlist_stats_get(&list, &stats) == 0;
+    success &= stats.nodes_visited == 4 && stats.num_allocs >= 1 &&
+        stats.num_allocs < 10;
+    dlist_clear(&list);
+    success &= dlist_stats_get(&list, &stats) == 0;
+    success &= stats.num_frees == stats.num_allocs;
+    dlist_destroy(&list);
+
+    /* RCU readers, inside an epoch section, are not counted */
+    dlist_init_flags(&list, test_stats_compare, DLIST_F_RCU);
+    for (i = 0; i < 10; ++i) {
+        dlist_append(&list, &values[i]);
+    }
+    key = 5;
+    success &= dlist_epoch_enter() == 0;
+    success &= dlist_get_data(&list, &key) == &values[5];
+    dlist_epoch_exit();
+    success &= dlist_stats_get(&list, &stats) == 0;
+    success &= stats.num_finds == 0 && stats.num_compares == 0;
+    success &= dlist_get_data(&list, &key) == &values[5];
+    success &= dlist_stats_get(&list, &stats) == 0;
+    success &= stats.num_finds == 1 && stats.num_allocs == 10;
+    dlist_destroy(&list);
+    return success;
+}
@@ -8,6 +8,10 @@
 #include <string.h>
 #include <time.h>
 #include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include <dlist.h>
 
@@ -16,11 +20,76 @@
 #define TEST_NUM_KEYS       10  
 #define TEST_KEY_STR_LEN    32
 
+#define TEST_BENCH_NUM_NODES    1000000
+#define TEST_BENCH_ROUNDS       4
+
+#define TEST_MODEL_NUM_OPS      20000
+#define TEST_MODEL_NUM_VALUES   512
+
+#define TEST_SORT_PARALLEL_NODES    100000
+#define TEST_BENCH_SORT_NODES       4000000
+#define TEST_BENCH_FOREACH_NODES    200000
+
+#define TEST_MPSC_PRODUCERS         4
+#define TEST_MPSC_ITEMS             50000
+#define TEST_BENCH_MPSC_ITEMS       1000000
+#define TEST_BQUEUE_PRODUCERS       4
+#define TEST_BQUEUE_CONSUMERS       3
+#define TEST_BQUEUE_ITEMS           20000
+#define TEST_BQUEUE_BATCH           32
+#define TEST_BENCH_BQUEUE_ITEMS     1000000
+#define TEST_BENCH_BQUEUE_PINGS     50000
+
+#define TEST_LFSET_THREADS          4
+#define TEST_LFSET_KEYS             256
+#define TEST_LFSET_OPS              50000
+#define TEST_BENCH_LFSET_OPS        100000
+
+#define TEST_RCU_READERS            3
+#define TEST_RCU_KEYS               64
+#define TEST_RCU_WRITES             20000
+#define TEST_BENCH_RCU_KEYS         256
+#define TEST_BENCH_RCU_LOOKUPS      200000
+
+#define TEST_SHARDED_THREADS        4
+#define TEST_SHARDED_KEYS           512
+#define TEST_SHARDED_OPS            20000
+#define TEST_BENCH_SHARDED_KEYS     4096
+#define TEST_BENCH_SHARDED_OPS      200000
+
+#define TEST_BENCH_TYPED_NODES      100000
+#define TEST_BENCH_TYPED_LOOKUPS    2000
+#define TEST_BENCH_TYPED_ROUNDS     20
+
+#define TEST_BENCH_INLINE_NODES     16384
+#define TEST_BENCH_INLINE_ROUNDS    256
+
+#define TEST_BENCH_STRKEYS_NODES    10000
+#define TEST_BENCH_STRKEYS_LOOKUPS  2000
+#define TEST_BENCH_ARENA_KEYS       1000000
+#define TEST_BENCH_ARENA_DISTINCT   1000
+
+/* dlist_inline.c, built with DLIST_HEADER_ONLY */
+bool test_inline_run(void);
+uint64_t test_inline_iter_sum(struct dlist *list);
+
+/* dlist_stats.c, built with DLIST_HEADER_ONLY and DLIST_STATS */
+bool test_stats_run(void);
+
 void **keys_str_random;
 void **keys_int_random;
 
 struct dlist str_list;
 struct dlist int_list;
+struct dlist str_pool_list;
+struct dlist int_pool_list;
+struct dlist str_unrolled_list;
+struct dlist int_unrolled_list;
+struct dlist str_indexed_list;
+struct dlist int_indexed_list;
+struct dlist str_sorted_list;
+struct dlist int_sorted_list;
+struct dlist str_strkeys_list;
 
 struct test
 {
@@ -33,6 +102,19 @@ struct test
 DLIST_FUNC_DECL(test,  void)
 DLIST_FUNC_CREATE(test, void)
 
+/* Object linked on two intrusive lists at once */
+struct test_obj
+{
+    uint64_t key;
+    struct dlist_link all_link;
+    struct dlist_link odd_link;
+};
+
+DLIST_LINK_FUNC_DECL(test_all, struct test_obj, all_link)
+DLIST_LINK_FUNC_CREATE(test_all, struct test_obj, all_link)
+DLIST_LINK_FUNC_DECL(test_odd, struct test_obj, odd_link)
+DLIST_LINK_FUNC_CREATE(test_odd, struct test_obj, odd_link)
+
 uint64_t test_time_us(void)
 {
     struct timespec now;
@@ -124,11 +206,26 @@ void test_reset_list(struct dlist *list)
     dlist_reset(list);
 }
 
+void test_print_pool_stats(struct dlist *list)
+{
+    struct dlist_pool_stats stats;
+
+    if (dlist_pool_get_stats(list, &stats) < 0) return;
+
+    printf("    Pool chunks:        %zu\n", stats.num_chunks);
+    printf("    Pool nodes:         %zu (%zu in use, %zu free)\n",
+            stats.num_nodes, stats.nodes_in_use, stats.nodes_free);
+    printf("    Pool allocs:        %zu (%zu reused)\n",
+            stats.num_allocs, stats.num_reuses);
+    printf("    Pool frees:         %zu\n", stats.num_frees);
+}
+
 void test_print_stats(struct dlist *list, const char *label)
 {
     printf("Dlist stats: %s\n", label);
     printf("    # entries:           %zu\n", list->num_entries);
     printf("    List size:          %zu\n", dlist_len(list));
+    test_print_pool_stats(list);
 }
 
 bool test_run(struct dlist *list, void **keys, 
@@ -193,9 +290,18 @@ bool test_run_all(struct dlist *list, void **keys, const
 
 int test_compare_uint64(const void *a, const void *b)
 {
-    return *(int64_t *)a - *(int64_t *)b;
+    /* A difference would overflow and break ordering */
+    return *(uint64_t *)a < *(uint64_t *)b ? -1 :
+        *(uint64_t *)a > *(uint64_t *)b;
 }
 
+/* test_compare_uint64 for the specialized list, inlined */
+#define TEST_COMPARE_UINT64(key, data)                                  \
+    (*(key) < *(data) ? -1 : *(key) > *(data))
+
+DLIST_TYPED_DECL(u64, uint64_t, uint64_t)
+DLIST_TYPED_CREATE(u64, uint64_t, uint64_t, TEST_COMPARE_UINT64)
+
 bool test_add(struct dlist *list, void **keys)
 {
     void **key;
@@ -221,7 +327,7 @@ bool test_get(struct dlist *list, void **keys)
     void **key;
     void *data;
 
-    for (key = keys; *key < keys[TEST_NUM_KEYS]; ++key) {
+    for (key = keys; *key; ++key) {
         data = test_dlist_get_data(list, *key);
         if (!data) {
             printf("entry not found\n");
@@ -241,7 +347,7 @@ bool test_remove(struct dlist *list, void **keys)
     void **key;
     void *data;
 
-    for (key = keys; *key < key[TEST_NUM_KEYS]; ++key) {
+    for (key = keys; *key; ++key) {
         data = test_dlist_remove(list, *key);
         if (!data) {
             printf("entry not found\n");
@@ -286,7 +392,7 @@ bool test_iterate_remove(struct dlist *list, void **keys)
             return false;
         }
         iter = dlist_iter_remove(list, iter);
-        if (test_dlist_get_data(list, key) != key) {
+        if (test_dlist_get_data(list, key)) {
             printf("iter_remove failed on entry #%zu\n", i);
             return false;
         }
@@ -310,7 +416,6 @@ int test_foreach_callback(const void *key, void *arg)
 
     if (state->i & 1) {
         /* Remove every other key */
-        test_dlist_remove(state->list, key);
         if (!(test_dlist_remove(state->list, key))) {
             printf("could not remove expected key\n");
             return -1;
@@ -328,10 +433,10 @@ bool test_foreach(struct dlist *list, void **keys)
     if (test_dlist_foreach(list, test_foreach_callback, &arg) < 0) {
         return false;
     }
-    if (list->num_entries != size) {
+    if (list->num_entries != size / 2) {
         printf("foreach delete did not remove expected # of entries: "
                 "contains %zu vs. expected %zu\n", dlist_len(list),
-                size);
+                size / 2);
         return false;
     }
     return true;
@@ -399,45 +504,3536 @@ bool test_reset(struct dlist *list, void **keys)
         }
 };
 
+int test_match_obj(const void *key, const struct test_obj *obj)
+{
+    return *(const uint64_t *) key == obj->key ? 0 : 1;
+}
+
+int test_count_links(struct dlist_link *link, void *arg)
+{
+    ++*(size_t *) arg;
+    return 0;
+}
+
+bool test_intrusive(void)
+{
+    struct test_obj objs[TEST_NUM_KEYS], *obj;
+    struct dlist_ilist all_list, odd_list;
+    size_t i, count = 0;
+
+    printf("\n**************************************************\n");
+    printf("Test: intrusive lists, one object on two lists\n");
+
+    dlist_ilist_init(&all_list);
+    dlist_ilist_init(&odd_list);
+    for (i = 0; i < TEST_NUM_KEYS; ++i) {
+        objs[i].key = *(uint64_t *) keys_int_random[i];
+        test_all_dlist_link_append(&all_list, &objs[i]);
+        if (i & 1) {
+            test_odd_dlist_link_add(&odd_list, &objs[i]);
+        }
+    }
+    for (i = 0; i < TEST_NUM_KEYS; ++i) {
+        if (test_all_dlist_find(&all_list, &objs[i].key,
+                test_match_obj) != &objs[i]) {
+            printf("intrusive find failed on entry #%zu\n", i);
+            return false;
+        }
+    }
+
+    /* Dropping the odd objects from one list must leave the other intact */
+    for (obj = test_odd_dlist_first(&odd_list); obj;
+            obj = test_odd_dlist_next(obj)) {
+        test_all_dlist_unlink(&all_list, obj);
+    }
+    dlist_ilist_foreach(&odd_list, test_count_links, &count);
+    if (count != TEST_NUM_KEYS / 2 || odd_list.num_entries != count ||
+            test_odd_dlist_last(&odd_list) != &objs[1]) {
+        printf("odd list damaged: %zu entries\n", count);
+        return false;
+    }
+    for (i = 0, obj = test_all_dlist_first(&all_list); obj;
+            obj = test_all_dlist_next(obj), i += 2) {
+        if (obj != &objs[i]) {
+            printf("all list damaged at entry #%zu\n", i);
+            return false;
+        }
+    }
+    if (all_list.num_entries != TEST_NUM_KEYS - count) {
+        printf("all list has %zu entries\n", all_list.num_entries);
+        return false;
+    }
+    printf("Completed successfully\n");
+    return true;
+}
+
 /*
- * Main function
+ * Random appends, adds, removals and iterator removals checked against
+ * a plain array model of the list after every operation batch.  With
+ * unique_keys, values already in the list are not inserted again.
  */
-int main(int argc, char **argv)
+bool test_list_model(struct dlist *list, bool unique_keys,
+    const char *label)
+{
+    static uint64_t values[TEST_MODEL_NUM_VALUES];
+    void **model;
+    size_t i, n = 0, op, pos;
+    struct dlist_iter *iter;
+    uint64_t *value;
+    int kind;
+
+    printf("\n**************************************************\n");
+    printf("Test: %u random operations against a model, %s\n",
+            TEST_MODEL_NUM_OPS, label);
+
+    model = test_keys_alloc(TEST_MODEL_NUM_OPS);
+    for (i = 0; i < TEST_MODEL_NUM_VALUES; ++i) {
+        values[i] = i;
+    }
+    srand(7);
+    for (op = 0; op < TEST_MODEL_NUM_OPS; ++op) {
+        value = &values[rand() % TEST_MODEL_NUM_VALUES];
+        kind = rand() % 5;
+        if (unique_keys && kind <= 2) {
+            for (pos = 0; pos < n && model[pos] != value; ++pos);
+            if (pos < n) continue;
+        }
+        switch (kind) {
+        case 0:
+        case 1:
+            dlist_append(list, value);
+            model[n++] = value;
+            break;
+        case 2:
+            dlist_add(list, value);
+            memmove(&model[1], &model[0], n++ * sizeof(void *));
+            model[0] = value;
+            break;
+        case 3:
+            /* First match from the head goes */
+            for (pos = 0; pos < n && model[pos] != value; ++pos);
+            if (dlist_remove(list, value) != (pos < n ? value : NULL)) {
+                printf("remove mismatch at op %zu\n", op);
+                return false;
+            }
+            if (pos < n) {
+                memmove(&model[pos], &model[pos + 1],
+                        (--n - pos) * sizeof(void *));
+            }
+            break;
+        case 4:
+            if (!n) break;
+            pos = rand() % n;
+            for (i = 0, iter = dlist_iter(list); i < pos; ++i) {
+                iter = dlist_iter_next(list, iter);
+            }
+            iter = dlist_iter_remove(list, iter);
+            memmove(&model[pos], &model[pos + 1],
+                    (--n - pos) * sizeof(void *));
+            if (dlist_iter_get_data(iter) != (pos < n ? model[pos] : NULL)) {
+                printf("iter_remove returned wrong entry at op %zu\n", op);
+                return false;
+            }
+            break;
+        }
+        if (dlist_len(list) != n) {
+            printf("length mismatch at op %zu\n", op);
+            return false;
+        }
+        if (op % 64) continue;
+        for (i = 0, iter = dlist_iter(list); iter;
+                iter = dlist_iter_next(list, iter), ++i) {
+            if (i >= n || dlist_iter_get_data(iter) != model[i]) {
+                printf("order mismatch at op %zu, entry %zu\n", op, i);
+                return false;
+            }
+        }
+        if (i != n) {
+            printf("iterated %zu of %zu entries at op %zu\n", i, n, op);
+            return false;
+        }
+    }
+    dlist_clear(list);
+    free(model);
+    printf("Completed successfully\n");
+    return true;
+}
+
+/*
+ * Random inserts and removals with many duplicate keys; the list must
+ * stay ordered, hold the expected multiset and answer bound searches
+ * like a linear scan would.
+ */
+bool test_sorted_model(struct dlist *list)
+{
+    static uint64_t values[TEST_MODEL_NUM_VALUES];
+    size_t counts[TEST_MODEL_NUM_VALUES / 4] = { 0 };
+    size_t i, op, n = 0;
+    struct dlist_iter *iter, *bound;
+    uint64_t *value, prev, key;
+
+    printf("\n**************************************************\n");
+    printf("Test: %u random operations on a sorted list\n",
+            TEST_MODEL_NUM_OPS);
+
+    for (i = 0; i < TEST_MODEL_NUM_VALUES; ++i) {
+        values[i] = i % ARRAY_LEN(counts);
+    }
+    srand(17);
+    for (op = 0; op < TEST_MODEL_NUM_OPS; ++op) {
+        value = &values[rand() % TEST_MODEL_NUM_VALUES];
+        switch (rand() % 4) {
+        case 0:
+            dlist_append(list, value);
+            counts[*value]++, n++;
+            break;
+        case 1:
+            dlist_add(list, value);
+            counts[*value]++, n++;
+            break;
+        case 2:
+            if (dlist_remove(list, value)) {
+                counts[*value]--, n--;
+            } else if (counts[*value]) {
+                printf("remove missed key %llu at op %zu\n",
+                        (long long unsigned) *value, op);
+                return false;
+            }
+            break;
+        case 3:
+            iter = dlist_lower_bound(list, value);
+            if (iter) {
+                counts[*(uint64_t *) dlist_iter_get_data(iter)]--, n--;
+                dlist_iter_remove(list, iter);
+            }
+            break;
+        }
+        if (dlist_len(list) != n) {
+            printf("length mismatch at op %zu\n", op);
+            return false;
+        }
+        if (op % 64) continue;
+
+        key = rand() % (ARRAY_LEN(counts) + 1);
+        bound = NULL;
+        for (i = 0, prev = 0, iter = dlist_iter(list); iter;
+                iter = dlist_iter_next(list, iter), ++i) {
+            value = (uint64_t *) dlist_iter_get_data(iter);
+            if (*value < prev) {
+                printf("list out of order at op %zu\n", op);
+                return false;
+            }
+            if (!bound && *value >= key) bound = iter;
+            prev = *value;
+        }
+        if (i != n || dlist_lower_bound(list, &key) != bound) {
+            printf("lower bound of %llu wrong at op %zu\n",
+                    (long long unsigned) key, op);
+            return false;
+        }
+        for (i = 0; bound && i < counts[key]; ++i) {
+            bound = dlist_iter_next(list, bound);
+        }
+        if (dlist_upper_bound(list, &key) != bound) {
+            printf("upper bound of %llu wrong at op %zu\n",
+                    (long long unsigned) key, op);
+            return false;
+        }
+    }
+    dlist_clear(list);
+
+    /* Equal keys stay in insertion order */
+    for (i = 0; i < 3; ++i) {
+        dlist_add(list, &values[i * ARRAY_LEN(counts)]);
+    }
+    for (i = 0, iter = dlist_iter(list); iter;
+            iter = dlist_iter_next(list, iter), ++i) {
+        if (dlist_iter_get_data(iter) != &values[i * ARRAY_LEN(counts)]) {
+            printf("equal keys reordered\n");
+            return false;
+        }
+    }
+    dlist_clear(list);
+    printf("Completed successfully\n");
+    return true;
+}
+
+bool test_expect_order(struct dlist *list, uint64_t *values,
+    const char *order, const char *label)
+{
+    struct dlist_iter *iter = dlist_iter(list);
+    const char *c;
+
+    for (c = order; *c; ++c, iter = dlist_iter_next(list, iter)) {
+        if (dlist_iter_get_data(iter) != &values[*c - '0']) {
+            printf("%s: expected order %s\n", label, order);
+            return false;
+        }
+    }
+    return iter == NULL;
+}
+
+bool test_search_policy(void)
 {
+    static uint64_t values[5] = { 0, 1, 2, 3, 4 };
+    struct dlist list;
+    size_t i;
     bool success = true;
 
-    /* Initialize */
-    printf("Initializing lists...");
-    if (dlist_init(&str_list, dlist_compare_string) < 0) {
-        success = false;
+    printf("\n**************************************************\n");
+    printf("Test: self-organizing search policies\n");
+
+    dlist_init(&list, test_compare_uint64);
+    for (i = 0; i < ARRAY_LEN(values); ++i) {
+        dlist_append(&list, &values[i]);
     }
-    /*
-    dlist_set_key_alloc_funcs(&str_list, dlist_alloc_key_string, free);
-     */
-    if (dlist_init(&int_list, test_compare_uint64) < 0) {
+    dlist_set_search_policy(&list, DLIST_SEARCH_TRANSPOSE);
+    dlist_get_data(&list, &values[4]);
+    success &= test_expect_order(&list, values, "01243", "transpose");
+    dlist_get_data(&list, &values[0]);
+    success &= test_expect_order(&list, values, "01243", "transpose head");
+
+    dlist_set_search_policy(&list, DLIST_SEARCH_MOVE_TO_FRONT);
+    dlist_get_data(&list, &values[3]);
+    success &= test_expect_order(&list, values, "30124", "move-to-front");
+
+    dlist_set_search_policy(&list, DLIST_SEARCH_COUNT);
+    dlist_get_data(&list, &values[4]);
+    success &= test_expect_order(&list, values, "43012", "count");
+    dlist_get_data(&list, &values[2]);
+    dlist_get_data(&list, &values[2]);
+    success &= test_expect_order(&list, values, "24301", "count twice");
+
+    /* The chain must still be intact both ways */
+    for (i = 0; i < ARRAY_LEN(values); ++i) {
+        success &= dlist_remove(&list, &values[i]) == &values[i];
+    }
+    success &= dlist_is_empty(&list) && dlist_iter(&list) == NULL;
+    dlist_destroy(&list);
+
+    if (dlist_init_flags(&list, test_compare_uint64, DLIST_F_SORTED) < 0 ||
+            dlist_set_search_policy(&list,
+                DLIST_SEARCH_MOVE_TO_FRONT) != -EINVAL) {
         success = false;
     }
-    printf("done\n");
+    dlist_destroy(&list);
 
-    if (!success) {
-        printf("dlist init failed");
-        return 1;
+    printf(success ? "Completed successfully\n" : "Failed\n");
+    return success;
+}
+
+/*
+ * Bulk append and add on a fresh list, checked against one
+ * dlist_append()/dlist_add() call per element.
+ */
+bool test_bulk(unsigned flags, bool pooled, bool indexed, bool non_empty,
+    const char *label)
+{
+    static uint64_t values[TEST_MODEL_NUM_VALUES];
+    struct dlist list, expect;
+    struct dlist_iter *iter, *expect_iter;
+    struct dlist_pool_stats stats;
+    void *batch[TEST_MODEL_NUM_VALUES];
+    size_t i, half = TEST_MODEL_NUM_VALUES / 2;
+    bool success = true;
+
+    printf("\n**************************************************\n");
+    printf("Test: bulk append/add, %s\n", label);
+
+    for (i = 0; i < TEST_MODEL_NUM_VALUES; ++i) {
+        values[i] = (i * 7919) % TEST_MODEL_NUM_VALUES;
+        batch[i] = &values[i];
+    }
+    dlist_init_flags(&list, test_compare_uint64, flags);
+    dlist_init_flags(&expect, test_compare_uint64, flags);
+    if (pooled) dlist_pool_enable(&list, 8);
+    if (indexed) dlist_index_enable(&list, dlist_hash_uint64, 0);
+    if (non_empty) {
+        dlist_append(&list, batch[0]);
+        dlist_append(&expect, batch[0]);
     }
 
-    printf("Generating test %u test keys...", TEST_NUM_KEYS);
-    test_keys_generate();
-    printf("done\n");
+    if (dlist_append_bulk(&list, &batch[1], half - 1) < 0 ||
+            dlist_add_bulk(&list, &batch[half], half) < 0 ||
+            dlist_append_bulk(&list, batch, 0) < 0) {
+        printf("bulk insert failed\n");
+        return false;
+    }
+    for (i = 1; i < half; ++i) {
+        dlist_append(&expect, batch[i]);
+    }
+    for (i = half; i < TEST_MODEL_NUM_VALUES; ++i) {
+        dlist_add(&expect, batch[i]);
+    }
 
-    printf("Running tests\n\n");
-    success &= test_run_all(&str_list, keys_str_random, tests,
-            ARRAY_LEN(tests), "dlist w/randomized string keys");
-    success &= test_run_all(&int_list, keys_int_random, tests,
-            ARRAY_LEN(tests), "dlist w/randomized integer keys");
+    /* Bulk inserts never switch a heap list over to a pool */
+    if (!(flags & DLIST_F_UNROLLED)) {
+        success &= (dlist_pool_get_stats(&list, &stats) == 0) == pooled;
+    }
+
+    success &= dlist_len(&list) == dlist_len(&expect);
+    for (iter = dlist_iter(&list), expect_iter = dlist_iter(&expect);
+            iter && expect_iter; iter = dlist_iter_next(&list, iter),
+            expect_iter = dlist_iter_next(&expect, expect_iter)) {
+        success &= dlist_iter_get_data(iter) ==
+            dlist_iter_get_data(expect_iter);
+    }
+    success &= !iter && !expect_iter;
+
+    /* Plain appends after a batch use the same allocator */
+    if (!(flags & (DLIST_F_UNROLLED | DLIST_F_SORTED))) {
+        success &= dlist_append(&list, batch[0]) == batch[0];
+        success &= (dlist_pool_get_stats(&list, &stats) == 0) == pooled;
+        success &= dlist_remove(&list, batch[0]) == batch[0];
+    }
+    for (i = non_empty ? 0 : 1; i < TEST_MODEL_NUM_VALUES; ++i) {
+        success &= dlist_remove(&list, batch[i]) == batch[i];
+    }
+    success &= dlist_is_empty(&list);
+    dlist_destroy(&list);
+    dlist_destroy(&expect);
+
+    printf(success ? "Completed successfully\n" : "Failed\n");
+    return success;
+}
+
+int test_is_odd(const void *data, void *arg)
+{
+    return *(const uint64_t *) data & 1;
+}
+
+void *test_key_alloc_fail_100(const void *key)
+{
+    return *(const uint64_t *) key == 100 ? NULL : (void *) key;
+}
+
+/*
+ * Bulk inserts into heap lists share one block per batch; it has to
+ * outlive the list when some of its nodes were detached onto another.
+ */
+bool test_bulk_batches(void)
+{
+    static uint64_t values[TEST_MODEL_NUM_VALUES];
+    void *batch[TEST_MODEL_NUM_VALUES];
+    struct dlist_pool_stats stats;
+    struct dlist_iter *iter;
+    struct dlist list, out;
+    size_t i;
+    bool success = true;
+
+    printf("\n**************************************************\n");
+    printf("Test: bulk insert batches on heap lists\n");
+
+    for (i = 0; i < TEST_MODEL_NUM_VALUES; ++i) {
+        values[i] = i;
+        batch[i] = &values[i];
+    }
+    dlist_init(&list, test_compare_uint64);
+    dlist_init(&out, test_compare_uint64);
+    success &= dlist_append_bulk(&list, batch, TEST_MODEL_NUM_VALUES) == 0;
+    success &= dlist_add_bulk(&list, batch, 2) == 0;
+    success &= dlist_pool_get_stats(&list, &stats) == -ENOENT;
+    success &= dlist_remove_if_detach(&list, test_is_odd, NULL, &out) == 0;
+    success &= dlist_len(&out) == TEST_MODEL_NUM_VALUES / 2 + 1;
+    success &= dlist_remove(&list, &values[10]) == &values[10];
+    dlist_destroy(&list);
+
+    /* Detached nodes stay valid after their first list is gone */
+    iter = dlist_iter(&out);
+    success &= dlist_iter_get_data(iter) == &values[1];
+    for (i = 1, iter = dlist_iter_next(&out, iter); iter;
+            iter = dlist_iter_next(&out, iter), i += 2) {
+        success &= dlist_iter_get_data(iter) == &values[i];
+    }
+    success &= i == TEST_MODEL_NUM_VALUES + 1;
+    success &= dlist_append(&out, &values[0]) == &values[0];
+    dlist_destroy(&out);
+
+    /* A key that cannot be stored undoes the whole batch */
+    dlist_init(&list, test_compare_uint64);
+    dlist_set_key_alloc_funcs(&list, test_key_alloc_fail_100, NULL);
+    success &= dlist_append_bulk(&list, batch, TEST_MODEL_NUM_VALUES) ==
+        -ENOMEM;
+    success &= dlist_is_empty(&list);
+    success &= dlist_append_bulk(&list, &batch[101], 200) == 0;
+    success &= dlist_len(&list) == 200;
+    dlist_destroy(&list);
+
+    printf(success ? "Completed successfully\n" : "Failed\n");
+    return success;
+}
+
+size_t test_num_key_frees;
+
+void test_count_key_free(void *data)
+{
+    ++test_num_key_frees;
+}
+
+/*
+ * Drop the odd values from a list holding 0..TEST_MODEL_NUM_VALUES-1,
+ * freeing them or, with detach, handing them back on another list.
+ */
+bool test_remove_if(unsigned flags, bool pooled, bool indexed, bool detach,
+    const char *label)
+{
+    static uint64_t values[TEST_MODEL_NUM_VALUES];
+    struct dlist list, out;
+    struct dlist_iter *iter;
+    size_t i, num_removed;
+    bool success = true;
+
+    printf("\n**************************************************\n");
+    printf("Test: remove_if%s, %s\n", detach ? " detach" : "", label);
+
+    dlist_init_flags(&list, test_compare_uint64, flags);
+    if (pooled) dlist_pool_enable(&list, 8);
+    if (indexed) dlist_index_enable(&list, dlist_hash_uint64, 0);
+    dlist_set_key_alloc_funcs(&list, NULL, test_count_key_free);
+    for (i = 0; i < TEST_MODEL_NUM_VALUES; ++i) {
+        values[i] = i;
+        dlist_append(&list, &values[i]);
+    }
+
+    test_num_key_frees = 0;
+    if (detach) {
+        dlist_init(&out, test_compare_uint64);
+        if (dlist_remove_if_detach(&list, test_is_odd, NULL, &out) < 0) {
+            printf("dlist_remove_if_detach() failed\n");
+            return false;
+        }
+        num_removed = dlist_len(&out);
+        for (i = 1, iter = dlist_iter(&out); iter;
+                iter = dlist_iter_next(&out, iter), i += 2) {
+            success &= dlist_iter_get_data(iter) == &values[i];
+        }
+        success &= test_num_key_frees == 0;
+        dlist_destroy(&out);
+    } else {
+        num_removed = dlist_remove_if(&list, test_is_odd, NULL);
+    }
+    success &= num_removed == TEST_MODEL_NUM_VALUES / 2;
+    success &= test_num_key_frees == num_removed;
+    success &= dlist_len(&list) == TEST_MODEL_NUM_VALUES - num_removed;
+
+    for (i = 0, iter = dlist_iter(&list); iter;
+            iter = dlist_iter_next(&list, iter), i += 2) {
+        success &= dlist_iter_get_data(iter) == &values[i];
+    }
+    for (i = 0; i < TEST_MODEL_NUM_VALUES; ++i) {
+        success &= (dlist_get_data(&list, &values[i]) != NULL) == !(i & 1);
+    }
+    dlist_set_key_alloc_funcs(&list, NULL, NULL);
+    dlist_destroy(&list);
+
+    printf(success ? "Completed successfully\n" : "Failed\n");
+    return success;
+}
+
+/* list must hold values[runs[0]..runs[1]), values[runs[2]..runs[3]), ... */
+bool test_expect_runs(struct dlist *list, uint64_t *values,
+    const size_t *runs, size_t num_runs, const char *label)
+{
+    struct dlist_iter *iter = dlist_iter(list);
+    size_t i, r, len = 0;
+
+    for (r = 0; r < num_runs; ++r) {
+        for (i = runs[2 * r]; i < runs[2 * r + 1]; ++i, ++len) {
+            if (!iter || dlist_iter_get_data(iter) != &values[i] ||
+                    dlist_get_data(list, &values[i]) != &values[i]) {
+                printf("%s: value %zu missing or out of order\n", label, i);
+                return false;
+            }
+            iter = dlist_iter_next(list, iter);
+        }
+    }
+    return iter == NULL && dlist_len(list) == len;
+}
+
+struct dlist_iter *test_iter_at(struct dlist *list, size_t pos)
+{
+    struct dlist_iter *iter = dlist_iter(list);
+
+    while (pos--) {
+        iter = dlist_iter_next(list, iter);
+    }
+    return iter;
+}
+
+/*
+ * Move 0..TEST_MODEL_NUM_VALUES-1 onto an empty list in one splice,
+ * split it at a quarter and move the third quarter back.
+ */
+bool test_splice(unsigned flags, bool pooled, bool indexed, const char *label)
+{
+    static uint64_t values[TEST_MODEL_NUM_VALUES];
+    const size_t n = TEST_MODEL_NUM_VALUES;
+    const size_t all[] = { 0, n };
+    const size_t head[] = { 0, n / 4 };
+    const size_t tail[] = { n / 4, n };
+    const size_t merged[] = { 0, n / 4, n / 2, 3 * n / 4 };
+    const size_t rest[] = { n / 4, n / 2, 3 * n / 4, n };
+    struct dlist list, src, out;
+    size_t i;
+    bool success = true;
+
+    printf("\n**************************************************\n");
+    printf("Test: splice, %s\n", label);
+
+    dlist_init_flags(&list, test_compare_uint64, flags);
+    dlist_init_flags(&src, test_compare_uint64, flags);
+    dlist_init_flags(&out, test_compare_uint64, flags);
+    if (pooled) dlist_pool_enable(&src, 8);
+    if (indexed) {
+        dlist_index_enable(&list, dlist_hash_uint64, 0);
+        dlist_index_enable(&src, dlist_hash_uint64, 0);
+        dlist_index_enable(&out, dlist_hash_uint64, 0);
+    }
+
+    for (i = 0; i < n / 2; ++i) {
+        values[i] = i;
+        dlist_append(&src, &values[i]);
+    }
+    success &= dlist_splice(&list, &src) == 0;
+    success &= dlist_len(&src) == 0 && dlist_iter(&src) == NULL;
+    for (; i < n; ++i) {
+        values[i] = i;
+        dlist_append(&src, &values[i]);
+    }
+    success &= dlist_splice(&list, &src) == 0;
+    success &= dlist_splice(&list, &src) == 0;
+    success &= dlist_get_data(&src, &values[0]) == NULL;
+    success &= test_expect_runs(&list, values, all, 1, "splice");
+
+    if (flags & DLIST_F_UNROLLED) {
+        success &= dlist_split_at(&list, dlist_iter(&list), &out) == -EINVAL;
+    } else {
+        success &= dlist_split_at(&list, test_iter_at(&list, n / 4),
+                &out) == 0;
+        success &= test_expect_runs(&list, values, head, 1, "split head");
+        success &= test_expect_runs(&out, values, tail, 1, "split tail");
+
+        success &= dlist_splice_range(&list, &out,
+                test_iter_at(&out, n / 4), test_iter_at(&out, n / 2)) == 0;
+        success &= test_expect_runs(&list, values, merged, 2, "range dst");
+        success &= test_expect_runs(&out, values, rest, 2, "range src");
+        success &= dlist_get_data(&out, &values[0]) == NULL;
+        success &= dlist_get_data(&list, &values[n - 1]) == NULL;
+    }
+
+    dlist_destroy(&out);
+    dlist_destroy(&src);
+    dlist_destroy(&list);
+
+    printf(success ? "Completed successfully\n" : "Failed\n");
+    return success;
+}
+
+bool test_splice_invalid(void)
+{
+    static uint64_t value;
+    struct dlist a, b;
+    bool success = true;
+
+    printf("\n**************************************************\n");
+    printf("Test: splice rejects incompatible lists\n");
+
+    dlist_init(&a, test_compare_uint64);
+    dlist_init_flags(&b, test_compare_uint64, DLIST_F_SORTED);
+    dlist_append(&b, &value);
+    success &= dlist_splice(&a, &b) == -EINVAL;
+    dlist_destroy(&b);
+
+    dlist_init(&b, test_compare_uint64);
+    dlist_pool_enable(&a, 8);
+    dlist_pool_enable(&b, 8);
+    dlist_append(&b, &value);
+    success &= dlist_splice(&a, &b) == -EINVAL;
+    success &= dlist_split_at(&b, dlist_iter(&b), &b) == -EBUSY;
+    success &= dlist_len(&a) == 0 && dlist_len(&b) == 1;
+    dlist_destroy(&b);
+    dlist_destroy(&a);
+
+    printf(success ? "Completed successfully\n" : "Failed\n");
+    return success;
+}
+
+/* Keys ascend, with equal keys kept in address (insertion) order */
+bool test_expect_sorted(struct dlist *list, size_t len)
+{
+    struct dlist_iter *iter;
+    const uint64_t *prev = NULL, *cur;
+
+    if (dlist_len(list) != len) return false;
+    for (iter = dlist_iter(list); iter; iter = dlist_iter_next(list, iter)) {
+        cur = (const uint64_t *) dlist_iter_get_data(iter);
+        if (prev && (*prev > *cur || (*prev == *cur && prev > cur))) {
+            return false;
+        }
+        prev = cur;
+        --len;
+    }
+    return len == 0;
+}
+
+/*
+ * Sort random keys with many duplicates, sorted, reversed and nearly
+ * sorted input, then remove every entry to exercise the relinked prev
+ * pointers.
+ */
+bool test_sort(void)
+{
+    static uint64_t values[TEST_MODEL_NUM_VALUES + 1];
+    const size_t n = TEST_MODEL_NUM_VALUES;
+    const char *labels[] = { "random", "sorted", "reversed", "nearly" };
+    struct dlist list;
+    size_t i, pass;
+    bool success = true;
+
+    printf("\n**************************************************\n");
+    printf("Test: sort\n");
+
+    dlist_init(&list, test_compare_uint64);
+    dlist_index_enable(&list, dlist_hash_uint64, 0);
+    success &= dlist_sort(&list) == 0;
+
+    srand(17);
+    for (pass = 0; pass < 4; ++pass) {
+        for (i = 0; i < n; ++i) {
+            switch (pass) {
+            case 0: values[i] = rand() % 64; break;
+            case 1: values[i] = i / 3; break;
+            case 2: values[i] = n - i; break;
+            case 3: values[i] = i % 37 ? i : rand() % n; break;
+            }
+            dlist_append(&list, &values[i]);
+        }
+        if (dlist_sort(&list) < 0 || !test_expect_sorted(&list, n)) {
+            printf("%s input not sorted\n", labels[pass]);
+            success = false;
+        }
+
+        values[n] = UINT64_MAX;
+        dlist_append(&list, &values[n]);
+        success &= dlist_get_data(&list, &values[n]) == &values[n];
+        for (i = 0; i <= n; ++i) {
+            dlist_remove(&list, &values[(i * 7919) % (n + 1)]);
+        }
+        success &= dlist_len(&list) == 0 && dlist_iter(&list) == NULL;
+    }
+    dlist_destroy(&list);
+
+    dlist_init_flags(&list, test_compare_uint64, DLIST_F_UNROLLED);
+    success &= dlist_sort(&list) == -EINVAL;
+    dlist_destroy(&list);
+
+    printf(success ? "Completed successfully\n" : "Failed\n");
+    return success;
+}
+
+/*
+ * Parallel sort of TEST_SORT_PARALLEL_NODES keys with duplicates, on
+ * thread counts that do and do not divide the list evenly.
+ */
+bool test_sort_parallel(void)
+{
+    static const unsigned nthreads[] = { 1, 2, 3, 7, 16 };
+    uint64_t *values;
+    struct dlist list;
+    size_t i, t;
+    bool success = true;
+
+    printf("\n**************************************************\n");
+    printf("Test: parallel sort\n");
+
+    values = (uint64_t *) calloc(TEST_SORT_PARALLEL_NODES, sizeof(*values));
+    if (!values) {
+        printf("malloc failed\n");
+        exit(1);
+    }
+    dlist_init(&list, test_compare_uint64);
+    dlist_index_enable(&list, dlist_hash_uint64, 0);
+    srand(29);
+    for (t = 0; t < ARRAY_LEN(nthreads); ++t) {
+        for (i = 0; i < TEST_SORT_PARALLEL_NODES; ++i) {
+            values[i] = rand() % 1000;
+            dlist_append(&list, &values[i]);
+        }
+        if (dlist_sort_parallel(&list, nthreads[t]) < 0 ||
+                !test_expect_sorted(&list, TEST_SORT_PARALLEL_NODES)) {
+            printf("not sorted with %u threads\n", nthreads[t]);
+            success = false;
+        }
+        for (i = 0; i < TEST_SORT_PARALLEL_NODES; i += 2) {
+            dlist_remove(&list, &values[i]);
+        }
+        success &= dlist_len(&list) == TEST_SORT_PARALLEL_NODES / 2;
+        dlist_clear(&list);
+    }
+    dlist_destroy(&list);
+    free(values);
+
+    printf(success ? "Completed successfully\n" : "Failed\n");
+    return success;
+}
+
+int test_visit(const void *data, void *arg)
+{
+    ++*(uint64_t *) data;
+    return 0;
+}
+
+int test_stop_at(const void *data, void *arg)
+{
+    const uint64_t *stop = (const uint64_t *) arg;
+
+    return data == stop ? (int) *stop : 0;
+}
+
+/*
+ * Every entry visited exactly once on several thread counts, and
+ * negative and positive stops reported like dlist_foreach() does.
+ */
+bool test_foreach_parallel(unsigned flags, const char *label)
+{
+    static const unsigned nthreads[] = { 1, 2, 3, 8 };
+    uint64_t *values, stop;
+    struct dlist list;
+    size_t i, t;
+    bool success = true;
+
+    printf("\n**************************************************\n");
+    printf("Test: parallel foreach, %s\n", label);
+
+    values = (uint64_t *) calloc(TEST_SORT_PARALLEL_NODES, sizeof(*values));
+    if (!values) {
+        printf("malloc failed\n");
+        exit(1);
+    }
+    dlist_init_flags(&list, test_compare_uint64, flags);
+    for (i = 0; i < TEST_SORT_PARALLEL_NODES; ++i) {
+        dlist_append(&list, &values[i]);
+    }
+    for (t = 0; t < ARRAY_LEN(nthreads); ++t) {
+        success &= dlist_foreach_parallel(&list, test_visit, NULL,
+                nthreads[t]) == 0;
+        for (i = 0; i < TEST_SORT_PARALLEL_NODES; ++i) {
+            success &= values[i] == t + 1;
+        }
+    }
+
+    stop = -7;
+    dlist_append(&list, &stop);
+    success &= dlist_foreach_parallel(&list, test_stop_at, &stop, 4) == -7;
+    stop = 7;
+    success &= dlist_foreach_parallel(&list, test_stop_at, &stop, 4) == 0;
+    dlist_destroy(&list);
+    free(values);
+
+    printf(success ? "Completed successfully\n" : "Failed\n");
+    return success;
+}
+
+struct test_producer
+{
+    struct dlist_mpsc *queue;
+    uint64_t *values;                   /* pushed in order */
+    size_t num_values;
+};
+
+void *test_producer_main(void *arg)
+{
+    struct test_producer *p = (struct test_producer *) arg;
+    size_t i;
+
+    for (i = 0; i < p->num_values; ++i) {
+        while (dlist_mpsc_push_tail(p->queue, &p->values[i]) < 0) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/*
+ * FIFO order and node recycling on one thread, then TEST_MPSC_PRODUCERS
+ * producers: every item arrives once, in order per producer.
+ */
+bool test_mpsc(void)
+{
+    static uint64_t values[TEST_MPSC_PRODUCERS][TEST_MPSC_ITEMS];
+    struct test_producer producers[TEST_MPSC_PRODUCERS];
+    pthread_t threads[TEST_MPSC_PRODUCERS];
+    size_t next[TEST_MPSC_PRODUCERS] = { 0 };
+    struct dlist_pool_stats stats;
+    struct dlist_mpsc queue;
+    size_t i, p, received;
+    uint64_t *data;
+    bool success = true;
+
+    printf("\n**************************************************\n");
+    printf("Test: MPSC queue\n");
+
+    if (dlist_mpsc_init(&queue, 64) < 0) return false;
+    success &= dlist_mpsc_pop_head(&queue) == NULL;
+    for (p = 0; p < 3; ++p) {
+        for (i = 0; i < 1000; ++i) {
+            dlist_mpsc_push_tail(&queue, &values[0][i]);
+        }
+        for (i = 0; i < 1000; ++i) {
+            success &= dlist_mpsc_pop_head(&queue) == &values[0][i];
+        }
+        success &= dlist_mpsc_pop_head(&queue) == NULL;
+    }
+    /* Later rounds ran on recycled nodes only */
+    success &= dlist_mpsc_get_stats(&queue, &stats) == 0;
+    success &= stats.num_chunks == (1001 + 63) / 64;
+
+    for (p = 0; p < TEST_MPSC_PRODUCERS; ++p) {
+        for (i = 0; i < TEST_MPSC_ITEMS; ++i) {
+            values[p][i] = p * TEST_MPSC_ITEMS + i;
+        }
+        producers[p].queue = &queue;
+        producers[p].values = values[p];
+        producers[p].num_values = TEST_MPSC_ITEMS;
+        pthread_create(&threads[p], NULL, test_producer_main, &producers[p]);
+    }
+    for (received = 0; received < TEST_MPSC_PRODUCERS * TEST_MPSC_ITEMS; ) {
+        data = (uint64_t *) dlist_mpsc_pop_head(&queue);
+        if (!data) {
+            sched_yield();
+            continue;
+        }
+        p = *data / TEST_MPSC_ITEMS;
+        success &= *data % TEST_MPSC_ITEMS == next[p]++;
+        ++received;
+    }
+    for (p = 0; p < TEST_MPSC_PRODUCERS; ++p) {
+        pthread_join(threads[p], NULL);
+    }
+    success &= dlist_mpsc_pop_head(&queue) == NULL;
+    dlist_mpsc_destroy(&queue);
+
+    printf(success ? "Completed successfully\n" : "Failed\n");
+    return success;
+}
+
+struct test_bqueue_thread
+{
+    struct dlist_bqueue *queue;
+    uint64_t *values;                   /* producers: pushed in order */
+    unsigned *seen;                     /* consumers: pops per value */
+};
+
+void *test_bqueue_producer_main(void *arg)
+{
+    struct test_bqueue_thread *t = (struct test_bqueue_thread *) arg;
+    size_t i;
+
+    for (i = 0; i < TEST_BQUEUE_ITEMS; ++i) {
+        dlist_bqueue_push(t->queue, &t->values[i]);
+    }
+    return NULL;
+}
+
+void *test_bqueue_consumer_main(void *arg)
+{
+    struct test_bqueue_thread *t = (struct test_bqueue_thread *) arg;
+    void *data[TEST_BQUEUE_BATCH];
+    size_t i, n;
+
+    while ((n = dlist_bqueue_pop_batch(t->queue, data, TEST_BQUEUE_BATCH,
+                    DLIST_BQUEUE_FOREVER))) {
+        for (i = 0; i < n; ++i) {
+            __atomic_add_fetch(&t->seen[*(uint64_t *) data[i]], 1,
+                    __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * FIFO order, timeouts, batches and close on one thread, then producers
+ * and batch-popping consumers until close: every item arrives once.
+ */
+bool test_bqueue(void)
+{
+    static uint64_t values[TEST_BQUEUE_PRODUCERS * TEST_BQUEUE_ITEMS];
+    static unsigned seen[TEST_BQUEUE_PRODUCERS * TEST_BQUEUE_ITEMS];
+    struct test_bqueue_thread producers[TEST_BQUEUE_PRODUCERS];
+    struct test_bqueue_thread consumers[TEST_BQUEUE_CONSUMERS];
+    pthread_t ptids[TEST_BQUEUE_PRODUCERS], ctids[TEST_BQUEUE_CONSUMERS];
+    struct dlist_bqueue queue;
+    void *data[100];
+    uint64_t time_us;
+    size_t i;
+    bool success = true;
+
+    printf("\n**************************************************\n");
+    printf("Test: blocking queue\n");
+
+    for (i = 0; i < ARRAY_LEN(values); ++i) {
+        values[i] = i;
+    }
+    if (dlist_bqueue_init(&queue, 16) < 0) return false;
+    success &= dlist_bqueue_pop_timed(&queue, 0) == NULL;
+    time_us = test_time_us();
+    success &= dlist_bqueue_pop_timed(&queue, 20000000) == NULL;
+    success &= test_time_us() - time_us >= 20000;
+
+    for (i = 0; i < 100; ++i) {
+        success &= dlist_bqueue_push(&queue, &values[i]) == 0;
+    }
+    success &= dlist_bqueue_len(&queue) == 100;
+    for (i = 0; i < 10; ++i) {
+        success &= dlist_bqueue_pop(&queue) == &values[i];
+    }
+    success &= dlist_bqueue_pop_batch(&queue, data, 50, 0) == 50;
+    for (i = 0; i < 50; ++i) {
+        success &= data[i] == &values[10 + i];
+    }
+    success &= dlist_bqueue_pop_batch(&queue, data, 100,
+            DLIST_BQUEUE_FOREVER) == 40;
+    success &= data[39] == &values[99];
+
+    dlist_bqueue_push(&queue, &values[0]);
+    dlist_bqueue_close(&queue);
+    success &= dlist_bqueue_push(&queue, &values[1]) == -EPIPE;
+    success &= dlist_bqueue_pop(&queue) == &values[0];
+    success &= dlist_bqueue_pop(&queue) == NULL;
+    dlist_bqueue_destroy(&queue);
+
+    if (dlist_bqueue_init(&queue, 0) < 0) return false;
+    for (i = 0; i < TEST_BQUEUE_CONSUMERS; ++i) {
+        consumers[i].queue = &queue;
+        consumers[i].seen = seen;
+        pthread_create(&ctids[i], NULL, test_bqueue_consumer_main,
+                &consumers[i]);
+    }
+    for (i = 0; i < TEST_BQUEUE_PRODUCERS; ++i) {
+        producers[i].queue = &queue;
+        producers[i].values = &values[i * TEST_BQUEUE_ITEMS];
+        pthread_create(&ptids[i], NULL, test_bqueue_producer_main,
+                &producers[i]);
+    }
+    for (i = 0; i < TEST_BQUEUE_PRODUCERS; ++i) {
+        pthread_join(ptids[i], NULL);
+    }
+    dlist_bqueue_close(&queue);
+    for (i = 0; i < TEST_BQUEUE_CONSUMERS; ++i) {
+        pthread_join(ctids[i], NULL);
+    }
+    for (i = 0; i < ARRAY_LEN(seen); ++i) {
+        success &= seen[i] == 1;
+    }
+    success &= dlist_bqueue_len(&queue) == 0;
+    dlist_bqueue_destroy(&queue);
+
+    printf(success ? "Completed successfully\n" : "Failed\n");
+    return success;
+}
+
+int test_expect_ascending(const void *data, void *arg)
+{
+    const uint64_t **prev = (const uint64_t **) arg;
+    const uint64_t *cur = (const uint64_t *) data;
+
+    if (*prev && **prev >= *cur) return -1;
+    *prev = cur;
+    return 0;
+}
+
+struct test_lfset_thread
+{
+    struct dlist_lfset *set;
+    uint64_t *keys;
+    int net[TEST_LFSET_KEYS];           /* inserts minus removes */
+    unsigned seed;
+    bool success;
+};
+
+void *test_lfset_main(void *arg)
+{
+    struct test_lfset_thread *t = (struct test_lfset_thread *) arg;
+    size_t i, k;
+    void *data;
+
+    for (i = 0; i < TEST_LFSET_OPS; ++i) {
+        k = rand_r(&t->seed) % TEST_LFSET_KEYS;
+        switch (rand_r(&t->seed) % 3) {
+        case 0:
+            if (dlist_lfset_insert(t->set, &t->keys[k]) == 0) ++t->net[k];
+            break;
+        case 1:
+            data = dlist_lfset_remove(t->set, &t->keys[k]);
+            if (data) {
+                t->success &= data == &t->keys[k];
+                --t->net[k];
+            }
+            break;
+        default:
+            data = dlist_lfset_get_data(t->set, &t->keys[k]);
+            t->success &= !data || data == &t->keys[k];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Single-threaded semantics, then TEST_LFSET_THREADS threads inserting,
+ * removing and looking up TEST_LFSET_KEYS keys: each key must end up
+ * present exactly when its inserts outnumber its removes.
+ */
+bool test_lfset(void)
+{
+    static uint64_t keys[TEST_LFSET_KEYS];
+    static struct test_lfset_thread threads[TEST_LFSET_THREADS];
+    pthread_t tids[TEST_LFSET_THREADS];
+    struct dlist_lfset set;
+    const uint64_t *prev = NULL;
+    size_t i, k, len = 0;
+    int net;
+    bool success = true;
+
+    printf("\n**************************************************\n");
+    printf("Test: lock-free ordered set\n");
+
+    for (k = 0; k < TEST_LFSET_KEYS; ++k) {
+        keys[k] = (k * 7919) % TEST_LFSET_KEYS;
+    }
+    dlist_lfset_init(&set, test_compare_uint64);
+    for (k = 0; k < TEST_LFSET_KEYS; ++k) {
+        success &= dlist_lfset_insert(&set, &keys[k]) == 0;
+    }
+    success &= dlist_lfset_insert(&set, &keys[3]) == -EEXIST;
+    success &= dlist_lfset_len(&set) == TEST_LFSET_KEYS;
+    success &= dlist_lfset_foreach(&set, test_expect_ascending, &prev) == 0;
+    for (k = 0; k < TEST_LFSET_KEYS; k += 2) {
+        success &= dlist_lfset_remove(&set, &keys[k]) == &keys[k];
+    }
+    success &= dlist_lfset_remove(&set, &keys[0]) == NULL;
+    for (k = 0; k < TEST_LFSET_KEYS; ++k) {
+        success &= dlist_lfset_get_data(&set, &keys[k]) ==
+            (k & 1 ? &keys[k] : NULL);
+    }
+    for (k = 1; k < TEST_LFSET_KEYS; k += 2) {
+        dlist_lfset_remove(&set, &keys[k]);
+    }
+    success &= dlist_lfset_len(&set) == 0;
+
+    for (i = 0; i < TEST_LFSET_THREADS; ++i) {
+        memset(threads[i].net, 0, sizeof(threads[i].net));
+        threads[i].set = &set;
+        threads[i].keys = keys;
+        threads[i].seed = 41 + i;
+        threads[i].success = true;
+        pthread_create(&tids[i], NULL, test_lfset_main, &threads[i]);
+    }
+    for (i = 0; i < TEST_LFSET_THREADS; ++i) {
+        pthread_join(tids[i], NULL);
+        success &= threads[i].success;
+    }
+    for (k = 0; k < TEST_LFSET_KEYS; ++k) {
+        for (net = 0, i = 0; i < TEST_LFSET_THREADS; ++i) {
+            net += threads[i].net[k];
+        }
+        success &= net == 0 || net == 1;
+        success &= (dlist_lfset_get_data(&set, &keys[k]) != NULL) == net;
+        len += net;
+    }
+    prev = NULL;
+    success &= dlist_lfset_foreach(&set, test_expect_ascending, &prev) == 0;
+    success &= dlist_lfset_len(&set) == len;
+    dlist_lfset_destroy(&set);
+
+    printf(success ? "Completed successfully\n" : "Failed\n");
+    return success;
+}
+
+#define TEST_RCU_POISON     0xdeadbeefdeadbeefULL
+
+/* key_free for heap keys: poison, so a reader seeing it fails */
+void test_rcu_key_free(void *data)
+{
+    *(uint64_t *) data = TEST_RCU_POISON;
+    free(data);
+    ++test_num_key_frees;
+}
+
+struct test_rcu_reader
+{
+    struct dlist *list;
+    int *done;
+    bool success;
+};
+
+int test_rcu_check(const void *data, void *arg)
+{
+    return *(const uint64_t *) data < TEST_RCU_KEYS ? 0 : -1;
+}
+
+void *test_rcu_reader_main(void *arg)
+{
+    struct test_rcu_reader *r = (struct test_rcu_reader *) arg;
+    struct dlist_iter *iter;
+    uint64_t key, *data;
+
+    for (key = 0; !__atomic_load_n(r->done, __ATOMIC_RELAXED);
+            key = (key + 1) % TEST_RCU_KEYS) {
+        dlist_epoch_enter();
+        data = (uint64_t *) dlist_get_data(r->list, &key);
+        r->success &= !data || *data == key;
+        for (iter = dlist_iter(r->list); iter;
+                iter = dlist_iter_next(r->list, iter)) {
+            data = (uint64_t *) dlist_iter_get_data(iter);
+            r->success &= *data < TEST_RCU_KEYS;
+        }
+        r->success &= dlist_foreach(r->list, test_rcu_check, NULL) == 0;
+        dlist_epoch_exit();
+    }
+    return NULL;
+}
+
+/*
+ * Removed data outlives an open reader section and is freed after it,
+ * then readers race a writer that adds and removes heap keys.
+ */
+bool test_rcu(void)
+{
+    static struct test_rcu_reader readers[TEST_RCU_READERS];
+    pthread_t tids[TEST_RCU_READERS];
+    int done = 0;
+    struct dlist list;
+    uint64_t *data;
+    size_t i;
+    bool success = true;
+
+    printf("\n**************************************************\n");
+    printf("Test: RCU list, 1 writer, %d readers\n", TEST_RCU_READERS);
+
+    success &= dlist_init_flags(&list, test_compare_uint64,
+            DLIST_F_RCU | DLIST_F_SORTED) == -EINVAL;
+    dlist_init_flags(&list, test_compare_uint64, DLIST_F_RCU);
+    success &= dlist_index_enable(&list, dlist_hash_uint64, 0) == -EINVAL;
+    success &= dlist_sort(&list) == -EINVAL;
+    success &= dlist_foreach_parallel(&list, test_foreach_callback, NULL,
+            4) == -EINVAL;
+    dlist_set_key_alloc_funcs(&list, NULL, test_rcu_key_free);
+    dlist_pool_enable(&list, 0);
+    for (i = 0; i < TEST_RCU_KEYS; ++i) {
+        data = (uint64_t *) malloc(sizeof(*data));
+        *data = i;
+        dlist_append(&list, data);
+    }
+
+    test_num_key_frees = 0;
+    dlist_epoch_enter();
+    data = (uint64_t *) dlist_iter_get_data(dlist_iter(&list));
+    dlist_remove(&list, data);
+    dlist_rcu_reclaim(&list);
+    dlist_rcu_reclaim(&list);
+    success &= test_num_key_frees == 0 && *data == 0;
+    dlist_epoch_exit();
+    dlist_rcu_barrier(&list);
+    success &= test_num_key_frees == 1;
+
+    for (i = 0; i < TEST_RCU_READERS; ++i) {
+        readers[i].list = &list;
+        readers[i].done = &done;
+        readers[i].success = true;
+        pthread_create(&tids[i], NULL, test_rcu_reader_main, &readers[i]);
+    }
+    srand(47);
+    for (i = 0; i < TEST_RCU_WRITES; ++i) {
+        uint64_t key = rand() % TEST_RCU_KEYS;
+
+        if (dlist_get_data(&list, &key)) {
+            dlist_remove(&list, &key);
+            continue;
+        }
+        data = (uint64_t *) malloc(sizeof(*data));
+        *data = key;
+        if (rand() & 1) {
+            dlist_append(&list, data);
+        } else {
+            dlist_add(&list, data);
+        }
+        if (i % 1000 == 0) dlist_clear(&list);
+    }
+    __atomic_store_n(&done, 1, __ATOMIC_RELAXED);
+    for (i = 0; i < TEST_RCU_READERS; ++i) {
+        pthread_join(tids[i], NULL);
+        success &= readers[i].success;
+    }
+    dlist_destroy(&list);
+
+    printf(success ? "Completed successfully\n" : "Failed\n");
+    return success;
+}
+
+struct test_sharded_thread
+{
+    struct dlist_sharded *set;
+    uint64_t *keys;                     /* TEST_SHARDED_KEYS of its own */
+    bool present[TEST_SHARDED_KEYS];
+    unsigned seed;
+    bool success;
+};
+
+void *test_sharded_main(void *arg)
+{
+    struct test_sharded_thread *t = (struct test_sharded_thread *) arg;
+    size_t i, k;
+    void *data;
+
+    for (i = 0; i < TEST_SHARDED_OPS; ++i) {
+        k = rand_r(&t->seed) % TEST_SHARDED_KEYS;
+        data = dlist_sharded_get_data(t->set, &t->keys[k]);
+        t->success &= data == (t->present[k] ? &t->keys[k] : NULL);
+        if (t->present[k]) {
+            t->success &= dlist_sharded_remove(t->set, &t->keys[k]) ==
+                &t->keys[k];
+        } else {
+            t->success &= dlist_sharded_add(t->set, &t->keys[k]) ==
+                &t->keys[k];
+        }
+        t->present[k] = !t->present[k];
+    }
+    return NULL;
+}
+
+int test_count_data(const void *data, void *arg)
+{
+    ++*(size_t *) arg;
+    return 0;
+}
+
+/* A hash that leaves the top 32 bits clear */
+uint64_t test_hash_low32(const void *key)
+{
+    return (uint32_t) (*(const uint64_t *) key * 0x9e3779b1u);
+}
+
+/* arg[0] is the last key seen, arg[1] counts keys smaller than it */
+int test_count_descents(const void *data, void *arg)
+{
+    uint64_t *state = (uint64_t *) arg;
+
+    state[1] += *(const uint64_t *) data < state[0];
+    state[0] = *(const uint64_t *) data;
+    return 0;
+}
+
+/*
+ * TEST_SHARDED_THREADS threads toggling keys of their own, which share
+ * stripes with the other threads' keys: every lookup must match the
+ * thread's own record, and len and foreach the final total.
+ */
+bool test_sharded(void)
+{
+    static uint64_t keys[TEST_SHARDED_THREADS * TEST_SHARDED_KEYS];
+    static struct test_sharded_thread threads[TEST_SHARDED_THREADS];
+    pthread_t tids[TEST_SHARDED_THREADS];
+    struct dlist_sharded set;
+    uint64_t stop, descents[2];
+    size_t i, k, len = 0, count = 0;
+    bool success = true;
+
+    printf("\n**************************************************\n");
+    printf("Test: sharded list\n");
+
+    success &= dlist_sharded_init(&set, 0, test_compare_uint64,
+            dlist_hash_uint64, DLIST_F_RCU) == -EINVAL;
+    success &= dlist_sharded_init(&set, 5, test_compare_uint64,
+            dlist_hash_uint64, 0) == 0;
+    success &= set.mask == 7;
+    success &= dlist_sharded_index_enable(&set, 0) == 0;
+
+    for (k = 0; k < ARRAY_LEN(keys); ++k) {
+        keys[k] = k;
+    }
+    for (i = 0; i < TEST_SHARDED_THREADS; ++i) {
+        memset(threads[i].present, 0, sizeof(threads[i].present));
+        threads[i].set = &set;
+        threads[i].keys = &keys[i * TEST_SHARDED_KEYS];
+        threads[i].seed = 47 + i;
+        threads[i].success = true;
+        pthread_create(&tids[i], NULL, test_sharded_main, &threads[i]);
+    }
+    for (i = 0; i < TEST_SHARDED_THREADS; ++i) {
+        pthread_join(tids[i], NULL);
+        success &= threads[i].success;
+        for (k = 0; k < TEST_SHARDED_KEYS; ++k) {
+            len += threads[i].present[k];
+            success &= dlist_sharded_get_data(&set, &threads[i].keys[k]) ==
+                (threads[i].present[k] ? &threads[i].keys[k] : NULL);
+        }
+    }
+    success &= dlist_sharded_len(&set) == len;
+    success &= dlist_sharded_foreach(&set, test_count_data, &count) == 0;
+    success &= count == len;
+
+    stop = -7;
+    dlist_sharded_append(&set, &stop);
+    success &= dlist_sharded_foreach(&set, test_stop_at, &stop) == -7;
+    stop = 7;
+    success &= dlist_sharded_foreach(&set, test_stop_at, &stop) == 0;
+    dlist_sharded_destroy(&set);
+
+    /*
+     * 32-bit hashes must not pile every key into one stripe, where
+     * foreach would return them in ascending order
+     */
+    dlist_sharded_init(&set, 8, test_compare_uint64, test_hash_low32, 0);
+    success &= dlist_sharded_set_key_alloc_funcs(&set, NULL, NULL) == 0;
+    for (k = 0; k < 64; ++k) {
+        dlist_sharded_append(&set, &keys[k]);
+    }
+    descents[0] = descents[1] = 0;
+    success &= dlist_sharded_foreach(&set, test_count_descents,
+            descents) == 0;
+    success &= descents[1] >= 4;
+    dlist_sharded_destroy(&set);
+
+    printf(success ? "Completed successfully\n" : "Failed\n");
+    return success;
+}
+
+/*
+ * The generated uint64_t list against the generic one: same order after
+ * adds and appends, lookups, removals and unlinking while iterating.
+ */
+bool test_typed(void)
+{
+    static uint64_t values[TEST_MODEL_NUM_VALUES];
+    struct u64_tlist list;
+    struct u64_tlist_node *node, *tmp;
+    struct dlist expect;
+    struct dlist_iter *iter;
+    uint64_t key, *data;
+    size_t i;
+    bool success = true;
+
+    printf("\n**************************************************\n");
+    printf("Test: specialized list\n");
+
+    u64_tlist_init(&list);
+    dlist_init(&expect, test_compare_uint64);
+    for (i = 0; i < ARRAY_LEN(values); ++i) {
+        values[i] = (i * 7919) % ARRAY_LEN(values);
+        if (i % 3) {
+            success &= u64_tlist_append(&list, &values[i]) == &values[i];
+            dlist_append(&expect, &values[i]);
+        } else {
+            success &= u64_tlist_add(&list, &values[i]) == &values[i];
+            dlist_add(&expect, &values[i]);
+        }
+    }
+    for (key = 0; key < ARRAY_LEN(values); key += 5) {
+        success &= u64_tlist_remove(&list, &key) ==
+            dlist_remove(&expect, &key);
+    }
+    key = ARRAY_LEN(values);
+    success &= u64_tlist_get_data(&list, &key) == NULL;
+    success &= u64_tlist_remove(&list, &key) == NULL;
+
+    DLIST_FOREACH_SAFE(node, &list, tmp) {
+        if (*node->data % 7 == 0) {
+            data = node->data;
+            success &= u64_tlist_unlink(&list, node) == data;
+            continue;
+        }
+        success &= u64_tlist_get_data(&list, node->data) == node->data;
+    }
+    for (key = 0; key < ARRAY_LEN(values); key += 7) {
+        dlist_remove(&expect, &key);
+    }
+
+    success &= u64_tlist_len(&list) == dlist_len(&expect);
+    iter = dlist_iter(&expect);
+    DLIST_FOREACH(node, &list) {
+        success &= iter && dlist_iter_get_data(iter) == node->data;
+        iter = iter ? dlist_iter_next(&expect, iter) : NULL;
+    }
+    success &= iter == NULL;
+    for (node = list.tail, i = 0; node; node = node->prev) {
+        ++i;
+    }
+    success &= i == u64_tlist_len(&list);
+
+    u64_tlist_destroy(&list);
+    success &= u64_tlist_len(&list) == 0 && list.head == NULL;
+    dlist_destroy(&expect);
+
+    printf(success ? "Completed successfully\n" : "Failed\n");
+    return success;
+}
+
+/* The same operations through the header-only copy of the library */
+bool test_header_only(void)
+{
+    bool success;
+
+    printf("\n**************************************************\n");
+    printf("Test: header-only build\n");
+
+    success = test_inline_run();
+
+    printf(success ? "Completed successfully\n" : "Failed\n");
+    return success;
+}
+
+/*
+ * DLIST_F_STRKEYS lookups against keys that only differ at the end or
+ * in length, including keys past the saturated length, and the modes
+ * it refuses to mix with.
+ */
+bool test_strkeys(void)
+{
+    static char keys[4][300], probe[300];
+    struct dlist list, other;
+    size_t i;
+    bool success = true;
+
+    printf("\n**************************************************\n");
+    printf("Test: cached string key signatures\n");
+
+    success &= dlist_init_flags(&list, dlist_compare_string,
+            DLIST_F_STRKEYS | DLIST_F_UNROLLED) == -EINVAL;
+    dlist_init_flags(&list, dlist_compare_string, DLIST_F_STRKEYS);
+    memset(keys, 'k', sizeof(keys));
+    keys[0][31] = '\0';                 /* 31 chars */
+    keys[1][32] = '\0';                 /* one longer */
+    keys[2][299] = '\0';                /* beyond 255 */
+    keys[3][298] = 'x';
+    keys[3][299] = '\0';                /* same length, last char differs */
+    for (i = 0; i < 4; ++i) {
+        success &= dlist_append(&list, keys[i]) == keys[i];
+    }
+    for (i = 0; i < 4; ++i) {
+        strcpy(probe, keys[i]);
+        success &= dlist_get_data(&list, probe) == keys[i];
+    }
+    strcpy(probe, keys[2]);
+    probe[150] = 'x';
+    success &= dlist_get_data(&list, probe) == NULL;
+    probe[30] = '\0';
+    success &= dlist_get_data(&list, probe) == NULL;
+    success &= dlist_get_data(&list, "") == NULL;
+    strcpy(probe, keys[1]);
+    success &= dlist_remove(&list, probe) == keys[1];
+    success &= dlist_get_data(&list, probe) == NULL;
+    success &= dlist_get_data(&list, keys[0]) == keys[0];
+
+    dlist_init(&other, dlist_compare_string);
+    success &= dlist_splice(&other, &list) == -EINVAL;
+    success &= dlist_splice(&list, &other) == -EINVAL;
+    dlist_destroy(&other);
+    dlist_destroy(&list);
+
+    printf(success ? "Completed successfully\n" : "Failed\n");
+    return success;
+}
+
+bool test_iter_replace(void)
+{
+    static char old_key[] = "old key", new_key[] = "new key";
+    uint64_t values[100], replaced = 1000, key;
+    struct dlist_iter *iter;
+    struct dlist list;
+    size_t i;
+    bool success = true;
+
+    printf("\n**************************************************\n");
+    printf("Test: replacing data through an iterator\n");
+
+    /* Enough entries to build the index, then move one to a new key */
+    dlist_init(&list, test_compare_uint64);
+    dlist_index_enable(&list, dlist_hash_uint64, 16);
+    for (i = 0; i < 100; ++i) {
+        values[i] = i;
+        dlist_append(&list, &values[i]);
+    }
+    key = 42;
+    iter = dlist_iter(&list);
+    while (iter && dlist_iter_get_data(iter) != &values[42]) {
+        iter = dlist_iter_next(&list, iter);
+    }
+    success &= iter && dlist_iter_replace(&list, iter, &replaced) == 0;
+    success &= dlist_get_data(&list, &key) == NULL;
+    key = 1000;
+    success &= dlist_get_data(&list, &key) == &replaced;
+    for (i = 0; i < 100; ++i) {
+        key = i == 42 ? 1000 : i;
+        success &= dlist_remove(&list, &key) != NULL;
+    }
+    success &= dlist_len(&list) == 0;
+    dlist_destroy(&list);
+
+    dlist_init_flags(&list, dlist_compare_string, DLIST_F_STRKEYS);
+    dlist_append(&list, old_key);
+    iter = dlist_iter(&list);
+    success &= dlist_iter_replace(&list, iter, new_key) == 0;
+    success &= dlist_get_data(&list, "new key") == new_key;
+    success &= dlist_get_data(&list, "old key") == NULL;
+    dlist_destroy(&list);
+
+    /* A sorted list keeps its order only if the key stays */
+    dlist_init_flags(&list, test_compare_uint64, DLIST_F_SORTED);
+    for (i = 0; i < 10; ++i) {
+        dlist_append(&list, &values[i]);
+    }
+    key = 5;
+    iter = dlist_lower_bound(&list, &key);
+    success &= dlist_iter_replace(&list, iter, &replaced) == -EINVAL;
+    success &= dlist_iter_replace(&list, iter, &key) == 0;
+    success &= dlist_get_data(&list, &key) == &key;
+    dlist_destroy(&list);
+
+    printf(success ? "Completed successfully\n" : "Failed\n");
+    return success;
+}
+
+bool test_key_arena(void)
+{
+    static char big[300];
+    struct dlist_arena_stats stats;
+    struct dlist list, other;
+    char key[16];
+    const char *a, *b;
+    size_t i;
+    bool success = true;
+
+    printf("\n**************************************************\n");
+    printf("Test: string key arena\n");
+
+    /* key_alloc copies are what the list hands back and frees */
+    dlist_init(&list, dlist_compare_string);
+    dlist_set_key_alloc_funcs(&list, dlist_alloc_key_string, free);
+    strcpy(key, "copied");
+    a = (const char *) dlist_append(&list, key);
+    success &= a != NULL && a != key && strcmp(a, "copied") == 0;
+    key[0] = 'X';
+    success &= dlist_get_data(&list, "copied") == a;
+    success &= dlist_key_arena_get_stats(&list, &stats) == -EINVAL;
+    dlist_destroy(&list);
+
+    dlist_init(&list, dlist_compare_string);
+    dlist_append(&list, "busy");
+    success &= dlist_key_arena_enable(&list, 0, 0) == -EBUSY;
+    dlist_destroy(&list);
+    dlist_init_flags(&list, dlist_compare_string, DLIST_F_RCU);
+    success &= dlist_key_arena_enable(&list, 0, 0) == -EINVAL;
+    dlist_destroy(&list);
+
+    /* Small blocks, so keys spill over into several */
+    dlist_init(&list, dlist_compare_string);
+    success &= dlist_key_arena_enable(&list, 64, 0) == 0;
+    success &= dlist_key_arena_enable(&list, 64, 0) == -EEXIST;
+    success &= dlist_set_key_alloc_funcs(&list, dlist_alloc_key_string,
+            free) == -EINVAL;
+    for (i = 0; i < 20; ++i) {
+        snprintf(key, sizeof(key), "key%zu", i % 10);
+        a = (const char *) dlist_append(&list, key);
+        success &= a != NULL && a != key && strcmp(a, key) == 0;
+    }
+    success &= dlist_len(&list) == 20;
+    success &= dlist_key_arena_get_stats(&list, &stats) == 0;
+    success &= stats.num_keys == 20 && stats.num_shared == 0;
+    success &= stats.num_blocks > 1 && stats.bytes_used <= stats.bytes_reserved;
+
+    memset(big, 'b', sizeof(big) - 1);
+    a = (const char *) dlist_add(&list, big);
+    success &= a != NULL && strcmp(a, big) == 0;
+    success &= dlist_get_data(&list, big) == a;
+    success &= dlist_get_data(&list, "key7") != NULL;
+    success &= dlist_remove(&list, "key7") != NULL;
+    success &= dlist_remove(&list, "key7") != NULL;
+    success &= dlist_get_data(&list, "key7") == NULL;
+    success &= dlist_get_data(&list, "key8") != NULL;
+
+    dlist_init(&other, dlist_compare_string);
+    success &= dlist_splice(&other, &list) == -EINVAL;
+    success &= dlist_splice(&list, &other) == -EINVAL;
+    dlist_destroy(&other);
+
+    dlist_clear(&list);
+    success &= dlist_len(&list) == 0;
+    success &= dlist_key_arena_get_stats(&list, &stats) == 0;
+    success &= stats.num_blocks == 0 && stats.bytes_used == 0;
+    success &= dlist_append(&list, "again") != NULL;
+    dlist_destroy(&list);
+
+    /* Interned keys share one copy */
+    dlist_init(&list, dlist_compare_string);
+    success &= dlist_key_arena_enable(&list, 0, DLIST_ARENA_INTERN) == 0;
+    for (i = 0; i < 1000; ++i) {
+        snprintf(key, sizeof(key), "key%zu", i % 100);
+        b = (const char *) dlist_append(&list, key);
+        if (i == 42) a = b;
+        success &= b != NULL && strcmp(b, key) == 0;
+        if (i % 100 == 42) success &= b == a;
+    }
+    success &= dlist_key_arena_get_stats(&list, &stats) == 0;
+    success &= stats.num_keys == 100 && stats.num_shared == 900;
+    success &= dlist_len(&list) == 1000;
+    dlist_destroy(&list);
+
+    printf(success ? "Completed successfully\n" : "Failed\n");
+    return success;
+}
+
+bool test_stats(void)
+{
+    struct dlist_stats stats;
+    struct dlist list;
+    bool success;
+
+    printf("\n**************************************************\n");
+    printf("Test: DLIST_STATS counters\n");
+
+    success = test_stats_run();
+    dlist_init(&list, test_compare_uint64);
+    success &= dlist_stats_get(&list, &stats) == -ENOTSUP;
+    dlist_destroy(&list);
+
+    printf(success ? "Completed successfully\n" : "Failed\n");
+    return success;
+}
+
+bool bench_index_lookups(struct dlist *list, uint64_t *values,
+    size_t num_lookups, uint64_t *time_us)
+{
+    size_t i;
+
+    srand(13);
+    *time_us = test_time_us();
+    for (i = 0; i < num_lookups; ++i) {
+        uint64_t *key = &values[rand() % (TEST_BENCH_NUM_NODES / 10)];
+        if (dlist_get_data(list, key) != key) {
+            printf("lookup failed\n");
+            return false;
+        }
+    }
+    *time_us = test_time_us() - *time_us;
+    return true;
+}
+
+/*
+ * Random hits on TEST_BENCH_NUM_NODES / 10 entries, scanning and indexed.
+ */
+bool bench_index(void)
+{
+    struct dlist list;
+    uint64_t *values, scan_us, index_us, skip_us;
+    size_t i, num_nodes = TEST_BENCH_NUM_NODES / 10;
+
+    printf("\n**************************************************\n");
+    printf("Benchmark: get_data hits over %zu entries\n", num_nodes);
+
+    values = (uint64_t *) calloc(num_nodes, sizeof(*values));
+    if (!values) {
+        printf("malloc failed\n");
+        exit(1);
+    }
+    dlist_init(&list, test_compare_uint64);
+    for (i = 0; i < num_nodes; ++i) {
+        values[i] = i + 1;
+        dlist_append(&list, &values[i]);
+    }
+    if (!bench_index_lookups(&list, values, 1000, &scan_us)) return false;
+
+    dlist_index_enable(&list, dlist_hash_uint64, 0);
+    if (!bench_index_lookups(&list, values, 1000000, &index_us)) {
+        return false;
+    }
+    dlist_destroy(&list);
+
+    dlist_init_flags(&list, test_compare_uint64, DLIST_F_SORTED);
+    for (i = 0; i < num_nodes; ++i) {
+        dlist_add(&list, &values[i]);
+    }
+    if (!bench_index_lookups(&list, values, 1000000, &skip_us)) {
+        return false;
+    }
+    dlist_destroy(&list);
+    free(values);
+
+    printf("    linear scan:        %.1f ns/lookup\n", scan_us * 1e3 / 1000);
+    printf("    hash index:         %.1f ns/lookup\n",
+            index_us * 1e3 / 1000000);
+    printf("    sorted skip list:   %.1f ns/lookup\n",
+            skip_us * 1e3 / 1000000);
+    return true;
+}
+
+size_t bench_num_compares;
+
+int bench_compare_uint64_counted(const void *a, const void *b)
+{
+    ++bench_num_compares;
+    return test_compare_uint64(a, b);
+}
+
+/*
+ * Zipfian (s = 1) lookups over a shuffled list, with each search policy.
+ */
+bool bench_search_policy(void)
+{
+    static const struct {
+        const char *label;
+        enum dlist_search_policy policy;
+    } policies[] = {
+        { "none", DLIST_SEARCH_NONE },
+        { "move-to-front", DLIST_SEARCH_MOVE_TO_FRONT },
+        { "transpose", DLIST_SEARCH_TRANSPOSE },
+        { "count", DLIST_SEARCH_COUNT }
+    };
+    const size_t num_keys = 1000, num_lookups = 200000;
+    uint64_t *values, tmp, time_us;
+    double *cdf, sum = 0, r;
+    size_t i, j, p, lo, hi;
+    struct dlist list;
+
+    printf("\n**************************************************\n");
+    printf("Benchmark: %zu Zipfian lookups over %zu keys\n",
+            num_lookups, num_keys);
+
+    values = (uint64_t *) calloc(num_keys, sizeof(*values));
+    cdf = (double *) calloc(num_keys, sizeof(*cdf));
+    if (!values || !cdf) {
+        printf("malloc failed\n");
+        exit(1);
+    }
+    for (i = 0; i < num_keys; ++i) {
+        sum += 1.0 / (i + 1);
+        cdf[i] = sum;
+        values[i] = i;
+    }
+    /* Hot keys start at random positions */
+    srand(23);
+    for (i = num_keys - 1; i > 0; --i) {
+        j = rand() % (i + 1);
+        tmp = values[i];
+        values[i] = values[j];
+        values[j] = tmp;
+    }
+    for (p = 0; p < ARRAY_LEN(policies); ++p) {
+        dlist_init(&list, bench_compare_uint64_counted);
+        for (i = 0; i < num_keys; ++i) {
+            dlist_append(&list, &values[i]);
+        }
+        dlist_set_search_policy(&list, policies[p].policy);
+
+        srand(29);
+        bench_num_compares = 0;
+        time_us = test_time_us();
+        for (i = 0; i < num_lookups; ++i) {
+            /* Rank is the key value; values[] holds them shuffled */
+            uint64_t key;
+            r = (double) rand() / RAND_MAX * sum;
+            for (lo = 0, hi = num_keys - 1; lo < hi; ) {
+                j = (lo + hi) / 2;
+                if (cdf[j] < r) lo = j + 1; else hi = j;
+            }
+            key = lo;
+            if (!dlist_get_data(&list, &key)) return false;
+        }
+        time_us = test_time_us() - time_us;
+        printf("    %-14s %7.1f ns/lookup, %6.1f compares/lookup\n",
+                policies[p].label, time_us * 1e3 / num_lookups,
+                (double) bench_num_compares / num_lookups);
+        dlist_destroy(&list);
+    }
+    free(cdf);
+    free(values);
+    return true;
+}
+
+/*
+ * Loading TEST_BENCH_NUM_NODES entries one call, and one malloc, at a
+ * time and in batches of 1000: one heap block per batch, or reserved
+ * from a node pool.
+ */
+bool bench_bulk(void)
+{
+    const size_t batch_len = 1000;
+    struct dlist_pool_stats stats;
+    uint64_t single_us, bulk_us, pooled_us;
+    struct dlist list;
+    void **batch;
+    size_t i;
+
+    printf("\n**************************************************\n");
+    printf("Benchmark: load %u entries\n", TEST_BENCH_NUM_NODES);
+
+    batch = test_keys_alloc(TEST_BENCH_NUM_NODES);
+    for (i = 0; i < TEST_BENCH_NUM_NODES; ++i) {
+        batch[i] = (void *)(uintptr_t)(i + 1);
+    }
+
+    dlist_init(&list, test_compare_uint64);
+    single_us = test_time_us();
+    for (i = 0; i < TEST_BENCH_NUM_NODES; ++i) {
+        dlist_append(&list, batch[i]);
+    }
+    single_us = test_time_us() - single_us;
+    dlist_destroy(&list);
+
+    dlist_init(&list, test_compare_uint64);
+    bulk_us = test_time_us();
+    for (i = 0; i < TEST_BENCH_NUM_NODES; i += batch_len) {
+        if (dlist_append_bulk(&list, &batch[i], batch_len) < 0) {
+            printf("dlist_append_bulk() failed\n");
+            return false;
+        }
+    }
+    bulk_us = test_time_us() - bulk_us;
+    if (dlist_len(&list) != TEST_BENCH_NUM_NODES) return false;
+    dlist_destroy(&list);
+
+    dlist_init(&list, test_compare_uint64);
+    dlist_pool_enable(&list, 0);
+    pooled_us = test_time_us();
+    for (i = 0; i < TEST_BENCH_NUM_NODES; i += batch_len) {
+        if (dlist_append_bulk(&list, &batch[i], batch_len) < 0) {
+            printf("dlist_append_bulk() failed\n");
+            return false;
+        }
+    }
+    pooled_us = test_time_us() - pooled_us;
+    dlist_pool_get_stats(&list, &stats);
+    if (dlist_len(&list) != TEST_BENCH_NUM_NODES) return false;
+    dlist_destroy(&list);
+    free(batch);
+
+    printf("    dlist_append:       %llu microseconds, malloc per node\n",
+            (long long unsigned) single_us);
+    printf("    dlist_append_bulk:  %llu microseconds, malloc per batch\n",
+            (long long unsigned) bulk_us);
+    printf("    dlist_append_bulk:  %llu microseconds, pooled, %zu chunks\n",
+            (long long unsigned) pooled_us, stats.num_chunks);
+    return true;
+}
+
+/*
+ * Dropping half of TEST_BENCH_NUM_NODES / 50 entries by key one at a
+ * time and with a single dlist_remove_if() pass.
+ */
+bool bench_remove_if(void)
+{
+    size_t i, num_nodes = TEST_BENCH_NUM_NODES / 50;
+    uint64_t *values, by_key_us, remove_if_us;
+    struct dlist list;
+
+    printf("\n**************************************************\n");
+    printf("Benchmark: remove half of %zu entries\n", num_nodes);
+
+    values = (uint64_t *) calloc(num_nodes, sizeof(*values));
+    if (!values) {
+        printf("malloc failed\n");
+        exit(1);
+    }
+    dlist_init(&list, test_compare_uint64);
+    for (i = 0; i < num_nodes; ++i) {
+        values[i] = i;
+        dlist_append(&list, &values[i]);
+    }
+    by_key_us = test_time_us();
+    for (i = num_nodes - 1; i < num_nodes; i -= 2) {
+        dlist_remove(&list, &values[i]);
+    }
+    by_key_us = test_time_us() - by_key_us;
+    if (dlist_len(&list) != num_nodes / 2) return false;
+    dlist_clear(&list);
+
+    for (i = 0; i < num_nodes; ++i) {
+        dlist_append(&list, &values[i]);
+    }
+    remove_if_us = test_time_us();
+    dlist_remove_if(&list, test_is_odd, NULL);
+    remove_if_us = test_time_us() - remove_if_us;
+    if (dlist_len(&list) != num_nodes / 2) return false;
+    dlist_destroy(&list);
+    free(values);
+
+    printf("    dlist_remove loop:  %llu microseconds\n",
+            (long long unsigned) by_key_us);
+    printf("    dlist_remove_if:    %llu microseconds\n",
+            (long long unsigned) remove_if_us);
+    return true;
+}
+
+/*
+ * Moving TEST_BENCH_NUM_NODES entries to another list by re-appending
+ * them one at a time and with a single dlist_splice().
+ */
+bool bench_splice(void)
+{
+    size_t i;
+    uint64_t *values, reappend_us, splice_us;
+    struct dlist_iter *iter;
+    struct dlist src, dst;
+
+    printf("\n**************************************************\n");
+    printf("Benchmark: move %d entries between lists\n",
+            TEST_BENCH_NUM_NODES);
+
+    values = (uint64_t *) calloc(TEST_BENCH_NUM_NODES, sizeof(*values));
+    if (!values) {
+        printf("malloc failed\n");
+        exit(1);
+    }
+    dlist_init(&src, test_compare_uint64);
+    dlist_init(&dst, test_compare_uint64);
+    for (i = 0; i < TEST_BENCH_NUM_NODES; ++i) {
+        values[i] = i;
+        dlist_append(&src, &values[i]);
+    }
+
+    reappend_us = test_time_us();
+    for (iter = dlist_iter(&src); iter; iter = dlist_iter_next(&src, iter)) {
+        dlist_append(&dst, dlist_iter_get_data(iter));
+    }
+    dlist_clear(&src);
+    reappend_us = test_time_us() - reappend_us;
+    if (dlist_len(&dst) != TEST_BENCH_NUM_NODES) return false;
+
+    splice_us = test_time_us();
+    dlist_splice(&src, &dst);
+    splice_us = test_time_us() - splice_us;
+    if (dlist_len(&src) != TEST_BENCH_NUM_NODES) return false;
+
+    dlist_destroy(&dst);
+    dlist_destroy(&src);
+    free(values);
+
+    printf("    iterate and append: %llu microseconds\n",
+            (long long unsigned) reappend_us);
+    printf("    dlist_splice:       %llu microseconds\n",
+            (long long unsigned) splice_us);
+    return true;
+}
+
+int bench_compare_qsort(const void *a, const void *b)
+{
+    return test_compare_uint64(*(void * const *) a, *(void * const *) b);
+}
+
+/* Time one sort of list, which holds num_nodes entries */
+uint64_t bench_sort_once(struct dlist *list, size_t num_nodes)
+{
+    uint64_t time_us = test_time_us();
+
+    dlist_sort(list);
+    time_us = test_time_us() - time_us;
+    if (!test_expect_sorted(list, num_nodes)) {
+        printf("sort failed\n");
+        exit(1);
+    }
+    return time_us;
+}
+
+/*
+ * dlist_sort() against copying the entries out, qsort() and rebuilding
+ * the list, plus already sorted and reversed input.
+ */
+bool bench_sort(void)
+{
+    static const size_t sizes[] = { 10000, 1000000, 10000000 };
+    uint64_t *values, copy_us, random_us, sorted_us, reversed_us;
+    struct dlist_iter *iter;
+    struct dlist list;
+    void **array;
+    size_t i, s, num_nodes;
+
+    for (s = 0; s < ARRAY_LEN(sizes); ++s) {
+        num_nodes = sizes[s];
+        printf("\n**************************************************\n");
+        printf("Benchmark: sort %zu entries\n", num_nodes);
+
+        values = (uint64_t *) calloc(num_nodes, sizeof(*values));
+        array = (void **) calloc(num_nodes, sizeof(*array));
+        if (!values || !array) {
+            printf("malloc failed\n");
+            exit(1);
+        }
+        dlist_init(&list, test_compare_uint64);
+        dlist_pool_enable(&list, 0);
+        srand(23);
+        for (i = 0; i < num_nodes; ++i) {
+            values[i] = ((uint64_t) rand() << 31) ^ rand();
+            array[i] = &values[i];
+        }
+
+        dlist_append_bulk(&list, array, num_nodes);
+        copy_us = test_time_us();
+        for (i = 0, iter = dlist_iter(&list); iter;
+                iter = dlist_iter_next(&list, iter)) {
+            array[i++] = dlist_iter_get_data(iter);
+        }
+        qsort(array, num_nodes, sizeof(*array), bench_compare_qsort);
+        dlist_clear(&list);
+        dlist_append_bulk(&list, array, num_nodes);
+        copy_us = test_time_us() - copy_us;
+        dlist_clear(&list);
+
+        for (i = 0; i < num_nodes; ++i) {
+            array[i] = &values[i];
+        }
+        dlist_append_bulk(&list, array, num_nodes);
+        random_us = bench_sort_once(&list, num_nodes);
+        sorted_us = bench_sort_once(&list, num_nodes);
+        dlist_clear(&list);
+        for (i = 0; i < num_nodes; ++i) {
+            values[i] = num_nodes - i;
+        }
+        dlist_append_bulk(&list, array, num_nodes);
+        reversed_us = bench_sort_once(&list, num_nodes);
+
+        dlist_destroy(&list);
+        free(array);
+        free(values);
+
+        printf("    copy, qsort, rebuild: %llu microseconds\n",
+                (long long unsigned) copy_us);
+        printf("    dlist_sort random:    %llu microseconds\n",
+                (long long unsigned) random_us);
+        printf("    dlist_sort sorted:    %llu microseconds\n",
+                (long long unsigned) sorted_us);
+        printf("    dlist_sort reversed:  %llu microseconds\n",
+                (long long unsigned) reversed_us);
+    }
+    return true;
+}
+
+/*
+ * dlist_sort_parallel() of TEST_BENCH_SORT_NODES random keys from one
+ * thread up to the number of online CPUs (at least 4).
+ */
+bool bench_sort_parallel(void)
+{
+    uint64_t *values, time_us;
+    struct dlist list;
+    unsigned nthreads, max_threads;
+    size_t i;
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    max_threads = ncpus > 4 ? (unsigned) ncpus : 4;
+    printf("\n**************************************************\n");
+    printf("Benchmark: parallel sort %d entries, %ld CPUs\n",
+            TEST_BENCH_SORT_NODES, ncpus);
+
+    values = (uint64_t *) calloc(TEST_BENCH_SORT_NODES, sizeof(*values));
+    if (!values) {
+        printf("malloc failed\n");
+        exit(1);
+    }
+    dlist_init(&list, test_compare_uint64);
+    dlist_pool_enable(&list, 0);
+    for (nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+        srand(31);
+        for (i = 0; i < TEST_BENCH_SORT_NODES; ++i) {
+            values[i] = ((uint64_t) rand() << 31) ^ rand();
+            dlist_append(&list, &values[i]);
+        }
+        time_us = test_time_us();
+        dlist_sort_parallel(&list, nthreads);
+        time_us = test_time_us() - time_us;
+        if (!test_expect_sorted(&list, TEST_BENCH_SORT_NODES)) {
+            printf("sort failed\n");
+            return false;
+        }
+        dlist_clear(&list);
+        printf("    %2u threads: %llu microseconds\n", nthreads,
+                (long long unsigned) time_us);
+    }
+    dlist_destroy(&list);
+    free(values);
+    return true;
+}
+
+/* Busy work growing with the key, so entries differ in cost */
+int bench_uneven_work(const void *data, void *arg)
+{
+    volatile uint64_t x = *(const uint64_t *) data;
+    uint64_t i, n = (x % 64) * 16;
+
+    for (i = 0; i < n; ++i) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+    return 0;
+}
+
+/*
+ * dlist_foreach() against dlist_foreach_parallel() over entries of
+ * uneven cost, from one thread up to the number of online CPUs.
+ */
+bool bench_foreach_parallel(void)
+{
+    uint64_t *values, time_us;
+    struct dlist list;
+    unsigned nthreads, max_threads;
+    size_t i;
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    max_threads = ncpus > 4 ? (unsigned) ncpus : 4;
+    printf("\n**************************************************\n");
+    printf("Benchmark: parallel foreach %d entries, %ld CPUs\n",
+            TEST_BENCH_FOREACH_NODES, ncpus);
+
+    values = (uint64_t *) calloc(TEST_BENCH_FOREACH_NODES, sizeof(*values));
+    if (!values) {
+        printf("malloc failed\n");
+        exit(1);
+    }
+    dlist_init(&list, test_compare_uint64);
+    srand(37);
+    for (i = 0; i < TEST_BENCH_FOREACH_NODES; ++i) {
+        values[i] = rand();
+        dlist_append(&list, &values[i]);
+    }
+
+    time_us = test_time_us();
+    dlist_foreach(&list, bench_uneven_work, NULL);
+    time_us = test_time_us() - time_us;
+    printf("    dlist_foreach: %llu microseconds\n",
+            (long long unsigned) time_us);
+    for (nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+        time_us = test_time_us();
+        dlist_foreach_parallel(&list, bench_uneven_work, NULL, nthreads);
+        time_us = test_time_us() - time_us;
+        printf("    %2u threads:    %llu microseconds\n", nthreads,
+                (long long unsigned) time_us);
+    }
+    dlist_destroy(&list);
+    free(values);
+    return true;
+}
+
+/* The mutex-wrapped dlist the MPSC queue replaces */
+struct bench_locked_queue
+{
+    pthread_mutex_t lock;
+    struct dlist list;
+};
+
+struct bench_producer
+{
+    struct dlist_mpsc *queue;
+    struct bench_locked_queue *locked;
+    uint64_t *value;
+    size_t num_items;
+};
+
+void *bench_producer_main(void *arg)
+{
+    struct bench_producer *p = (struct bench_producer *) arg;
+    size_t i;
+
+    for (i = 0; i < p->num_items; ++i) {
+        if (p->queue) {
+            while (dlist_mpsc_push_tail(p->queue, p->value) < 0) {
+                sched_yield();
+            }
+        } else {
+            pthread_mutex_lock(&p->locked->lock);
+            dlist_append(&p->locked->list, p->value);
+            pthread_mutex_unlock(&p->locked->lock);
+        }
+    }
+    return NULL;
+}
+
+void *bench_locked_pop(struct bench_locked_queue *locked)
+{
+    struct dlist_iter *iter;
+    void *data = NULL;
+
+    pthread_mutex_lock(&locked->lock);
+    iter = dlist_iter(&locked->list);
+    if (iter) {
+        data = dlist_iter_get_data(iter);
+        dlist_iter_remove(&locked->list, iter);
+    }
+    pthread_mutex_unlock(&locked->lock);
+    return data;
+}
+
+/* Items per second through the queue with num_producers producers */
+double bench_mpsc_run(bool lock_free, unsigned num_producers)
+{
+    struct bench_producer producers[16];
+    pthread_t threads[16];
+    struct dlist_mpsc queue;
+    struct bench_locked_queue locked;
+    uint64_t value = 1, time_us;
+    size_t received, total;
+    unsigned p;
+    void *data;
+
+    if (lock_free) {
+        dlist_mpsc_init(&queue, 0);
+    } else {
+        pthread_mutex_init(&locked.lock, NULL);
+        dlist_init(&locked.list, test_compare_uint64);
+        dlist_pool_enable(&locked.list, 0);
+    }
+    total = TEST_BENCH_MPSC_ITEMS / num_producers * num_producers;
+
+    time_us = test_time_us();
+    for (p = 0; p < num_producers; ++p) {
+        producers[p].queue = lock_free ? &queue : NULL;
+        producers[p].locked = &locked;
+        producers[p].value = &value;
+        producers[p].num_items = total / num_producers;
+        pthread_create(&threads[p], NULL, bench_producer_main, &producers[p]);
+    }
+    for (received = 0; received < total; ) {
+        data = lock_free ? dlist_mpsc_pop_head(&queue) :
+            bench_locked_pop(&locked);
+        if (data) {
+            ++received;
+        } else {
+            sched_yield();
+        }
+    }
+    for (p = 0; p < num_producers; ++p) {
+        pthread_join(threads[p], NULL);
+    }
+    time_us = test_time_us() - time_us;
+
+    if (lock_free) {
+        dlist_mpsc_destroy(&queue);
+    } else {
+        dlist_destroy(&locked.list);
+        pthread_mutex_destroy(&locked.lock);
+    }
+    return time_us ? total * 1e6 / time_us : 0;
+}
+
+/*
+ * Producer scaling of the MPSC queue against a mutex-wrapped dlist,
+ * TEST_BENCH_MPSC_ITEMS items per run.
+ */
+bool bench_mpsc(void)
+{
+    unsigned num_producers;
+
+    printf("\n**************************************************\n");
+    printf("Benchmark: MPSC queue, %d items, %ld CPUs\n",
+            TEST_BENCH_MPSC_ITEMS, sysconf(_SC_NPROCESSORS_ONLN));
+
+    for (num_producers = 1; num_producers <= 16; num_producers *= 2) {
+        printf("    %2u producers: mutex %10.0f ops/s, "
+                "lock-free %10.0f ops/s\n", num_producers,
+                bench_mpsc_run(false, num_producers),
+                bench_mpsc_run(true, num_producers));
+    }
+    return true;
+}
+
+/* What the blocking queue replaces: a condvar signalled per item */
+struct bench_cond_queue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t nonempty;
+    struct dlist list;
+    bool closed;
+};
+
+void bench_cond_push(struct bench_cond_queue *q, void *data)
+{
+    pthread_mutex_lock(&q->lock);
+    dlist_append(&q->list, data);
+    pthread_cond_signal(&q->nonempty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void *bench_cond_pop(struct bench_cond_queue *q)
+{
+    struct dlist_iter *iter;
+    void *data = NULL;
+
+    pthread_mutex_lock(&q->lock);
+    while (!(iter = dlist_iter(&q->list)) && !q->closed) {
+        pthread_cond_wait(&q->nonempty, &q->lock);
+    }
+    if (iter) {
+        data = dlist_iter_get_data(iter);
+        dlist_iter_remove(&q->list, iter);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return data;
+}
+
+void bench_cond_init(struct bench_cond_queue *q)
+{
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->nonempty, NULL);
+    dlist_init(&q->list, test_compare_uint64);
+    dlist_pool_enable(&q->list, 0);
+    q->closed = false;
+}
+
+void bench_cond_close(struct bench_cond_queue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->closed = true;
+    pthread_cond_broadcast(&q->nonempty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void bench_cond_destroy(struct bench_cond_queue *q)
+{
+    dlist_destroy(&q->list);
+    pthread_cond_destroy(&q->nonempty);
+    pthread_mutex_destroy(&q->lock);
+}
+
+struct bench_bqueue_thread
+{
+    struct dlist_bqueue *queue;         /* NULL: condvar queue instead */
+    struct bench_cond_queue *cond;
+    struct dlist_bqueue *reply;         /* ping-pong partner queues */
+    struct bench_cond_queue *cond_reply;
+    uint64_t *value;
+    size_t num_items;
+};
+
+void *bench_bqueue_producer_main(void *arg)
+{
+    struct bench_bqueue_thread *t = (struct bench_bqueue_thread *) arg;
+    size_t i;
+
+    for (i = 0; i < t->num_items; ++i) {
+        if (t->queue) {
+            dlist_bqueue_push(t->queue, t->value);
+        } else {
+            bench_cond_push(t->cond, t->value);
+        }
+    }
+    return NULL;
+}
+
+void *bench_bqueue_consumer_main(void *arg)
+{
+    struct bench_bqueue_thread *t = (struct bench_bqueue_thread *) arg;
+    void *data[64];
+
+    if (t->queue) {
+        while (dlist_bqueue_pop_batch(t->queue, data, ARRAY_LEN(data),
+                    DLIST_BQUEUE_FOREVER)) {
+        }
+    } else {
+        while (bench_cond_pop(t->cond)) {
+        }
+    }
+    return NULL;
+}
+
+/* Items per second from num_producers producers to two consumers */
+double bench_bqueue_run(bool batched, unsigned num_producers,
+    size_t *wakeups)
+{
+    struct bench_bqueue_thread producers[16], consumers[2];
+    pthread_t ptids[16], ctids[2];
+    struct dlist_bqueue queue;
+    struct bench_cond_queue cond;
+    uint64_t value = 1, time_us;
+    size_t total = TEST_BENCH_BQUEUE_ITEMS / num_producers * num_producers;
+    unsigned i;
+
+    dlist_bqueue_init(&queue, 0);
+    bench_cond_init(&cond);
+
+    time_us = test_time_us();
+    for (i = 0; i < ARRAY_LEN(consumers); ++i) {
+        consumers[i].queue = batched ? &queue : NULL;
+        consumers[i].cond = &cond;
+        pthread_create(&ctids[i], NULL, bench_bqueue_consumer_main,
+                &consumers[i]);
+    }
+    for (i = 0; i < num_producers; ++i) {
+        producers[i].queue = batched ? &queue : NULL;
+        producers[i].cond = &cond;
+        producers[i].value = &value;
+        producers[i].num_items = total / num_producers;
+        pthread_create(&ptids[i], NULL, bench_bqueue_producer_main,
+                &producers[i]);
+    }
+    for (i = 0; i < num_producers; ++i) {
+        pthread_join(ptids[i], NULL);
+    }
+    dlist_bqueue_close(&queue);
+    bench_cond_close(&cond);
+    for (i = 0; i < ARRAY_LEN(consumers); ++i) {
+        pthread_join(ctids[i], NULL);
+    }
+    time_us = test_time_us() - time_us;
+
+    *wakeups = batched ? queue.num_wakeups : total;
+    dlist_bqueue_destroy(&queue);
+    bench_cond_destroy(&cond);
+    return time_us ? total * 1e6 / time_us : 0;
+}
+
+void *bench_bqueue_echo_main(void *arg)
+{
+    struct bench_bqueue_thread *t = (struct bench_bqueue_thread *) arg;
+    void *data;
+
+    if (t->queue) {
+        while ((data = dlist_bqueue_pop(t->queue))) {
+            dlist_bqueue_push(t->reply, data);
+        }
+    } else {
+        while ((data = bench_cond_pop(t->cond))) {
+            bench_cond_push(t->cond_reply, data);
+        }
+    }
+    return NULL;
+}
+
+/* Mean round trip in microseconds of an item bounced off another thread */
+double bench_bqueue_ping(bool batched)
+{
+    struct bench_bqueue_thread echo;
+    struct dlist_bqueue ping, pong;
+    struct bench_cond_queue cond_ping, cond_pong;
+    pthread_t tid;
+    uint64_t value = 1, time_us;
+    size_t i;
+
+    dlist_bqueue_init(&ping, 0);
+    dlist_bqueue_init(&pong, 0);
+    bench_cond_init(&cond_ping);
+    bench_cond_init(&cond_pong);
+    echo.queue = batched ? &ping : NULL;
+    echo.reply = &pong;
+    echo.cond = &cond_ping;
+    echo.cond_reply = &cond_pong;
+    pthread_create(&tid, NULL, bench_bqueue_echo_main, &echo);
+
+    time_us = test_time_us();
+    for (i = 0; i < TEST_BENCH_BQUEUE_PINGS; ++i) {
+        if (batched) {
+            dlist_bqueue_push(&ping, &value);
+            dlist_bqueue_pop(&pong);
+        } else {
+            bench_cond_push(&cond_ping, &value);
+            bench_cond_pop(&cond_pong);
+        }
+    }
+    time_us = test_time_us() - time_us;
+
+    dlist_bqueue_close(&ping);
+    bench_cond_close(&cond_ping);
+    pthread_join(tid, NULL);
+    dlist_bqueue_destroy(&ping);
+    dlist_bqueue_destroy(&pong);
+    bench_cond_destroy(&cond_ping);
+    bench_cond_destroy(&cond_pong);
+    return (double) time_us / TEST_BENCH_BQUEUE_PINGS;
+}
+
+/*
+ * Blocking queue against a mutex and condvar signalled on every push:
+ * throughput into two consumers with wakeups issued, and ping-pong
+ * round-trip latency.
+ */
+bool bench_bqueue(void)
+{
+    unsigned num_producers;
+    size_t cond_wakeups, wakeups;
+    double cond_rate, rate;
+
+    printf("\n**************************************************\n");
+    printf("Benchmark: blocking queue, %d items, 2 consumers, %ld CPUs\n",
+            TEST_BENCH_BQUEUE_ITEMS, sysconf(_SC_NPROCESSORS_ONLN));
+
+    for (num_producers = 1; num_producers <= 8; num_producers *= 2) {
+        cond_rate = bench_bqueue_run(false, num_producers, &cond_wakeups);
+        rate = bench_bqueue_run(true, num_producers, &wakeups);
+        printf("    %2u producers: condvar %10.0f items/s %8zu signals, "
+                "bqueue %10.0f items/s %8zu wakeups\n", num_producers,
+                cond_rate, cond_wakeups, rate, wakeups);
+    }
+    printf("    round trip: condvar %.2f us, bqueue %.2f us\n",
+            bench_bqueue_ping(false), bench_bqueue_ping(true));
+    return true;
+}
+
+struct bench_set_thread
+{
+    struct dlist_lfset *set;            /* NULL: locked list instead */
+    struct bench_locked_queue *locked;
+    uint64_t *keys;
+    unsigned seed;
+};
+
+/* 90% lookups, 5% inserts, 5% removes over TEST_LFSET_KEYS keys */
+void *bench_set_main(void *arg)
+{
+    struct bench_set_thread *t = (struct bench_set_thread *) arg;
+    size_t i;
+    unsigned op;
+    uint64_t *key;
+
+    for (i = 0; i < TEST_BENCH_LFSET_OPS; ++i) {
+        key = &t->keys[rand_r(&t->seed) % TEST_LFSET_KEYS];
+        op = rand_r(&t->seed) % 20;
+        if (t->set) {
+            if (op == 0) {
+                dlist_lfset_insert(t->set, key);
+            } else if (op == 1) {
+                dlist_lfset_remove(t->set, key);
+            } else {
+                dlist_lfset_get_data(t->set, key);
+            }
+            continue;
+        }
+        pthread_mutex_lock(&t->locked->lock);
+        if (op == 0) {
+            if (!dlist_get_data(&t->locked->list, key)) {
+                dlist_append(&t->locked->list, key);
+            }
+        } else if (op == 1) {
+            dlist_remove(&t->locked->list, key);
+        } else {
+            dlist_get_data(&t->locked->list, key);
+        }
+        pthread_mutex_unlock(&t->locked->lock);
+    }
+    return NULL;
+}
+
+double bench_set_run(bool lock_free, unsigned nthreads)
+{
+    static uint64_t keys[TEST_LFSET_KEYS];
+    struct bench_set_thread threads[16];
+    pthread_t tids[16];
+    struct dlist_lfset set;
+    struct bench_locked_queue locked;
+    uint64_t time_us;
+    size_t k;
+    unsigned i;
+
+    dlist_lfset_init(&set, test_compare_uint64);
+    pthread_mutex_init(&locked.lock, NULL);
+    dlist_init(&locked.list, test_compare_uint64);
+    for (k = 0; k < TEST_LFSET_KEYS; ++k) {
+        keys[k] = k;
+        if (k & 1) continue;
+        dlist_lfset_insert(&set, &keys[k]);
+        dlist_append(&locked.list, &keys[k]);
+    }
+
+    time_us = test_time_us();
+    for (i = 0; i < nthreads; ++i) {
+        threads[i].set = lock_free ? &set : NULL;
+        threads[i].locked = &locked;
+        threads[i].keys = keys;
+        threads[i].seed = 43 + i;
+        pthread_create(&tids[i], NULL, bench_set_main, &threads[i]);
+    }
+    for (i = 0; i < nthreads; ++i) {
+        pthread_join(tids[i], NULL);
+    }
+    time_us = test_time_us() - time_us;
+
+    dlist_destroy(&locked.list);
+    pthread_mutex_destroy(&locked.lock);
+    dlist_lfset_destroy(&set);
+    return time_us ? (double) nthreads * TEST_BENCH_LFSET_OPS * 1e6 / time_us :
+        0;
+}
+
+/*
+ * Read-mostly key set throughput, lock-free set against a mutex around
+ * dlist_get_data/dlist_append/dlist_remove, from 1 to 16 threads.
+ */
+bool bench_lfset(void)
+{
+    unsigned nthreads;
+
+    printf("\n**************************************************\n");
+    printf("Benchmark: key set, %d keys, %d ops per thread, %ld CPUs\n",
+            TEST_LFSET_KEYS, TEST_BENCH_LFSET_OPS,
+            sysconf(_SC_NPROCESSORS_ONLN));
+
+    for (nthreads = 1; nthreads <= 16; nthreads *= 2) {
+        printf("    %2u threads: mutex %10.0f ops/s, "
+                "lock-free %10.0f ops/s\n", nthreads,
+                bench_set_run(false, nthreads),
+                bench_set_run(true, nthreads));
+    }
+    return true;
+}
+
+struct bench_rcu_reader
+{
+    struct dlist *list;
+    pthread_rwlock_t *rwlock;           /* NULL: RCU reader */
+    uint64_t *keys;
+    unsigned seed;
+    uint64_t time_us;
+    int finished;
+};
+
+void *bench_rcu_reader_main(void *arg)
+{
+    struct bench_rcu_reader *r = (struct bench_rcu_reader *) arg;
+    uint64_t *key;
+    size_t i;
+
+    r->time_us = test_time_us();
+    for (i = 0; i < TEST_BENCH_RCU_LOOKUPS; ++i) {
+        key = &r->keys[rand_r(&r->seed) % TEST_BENCH_RCU_KEYS];
+        if (r->rwlock) {
+            pthread_rwlock_rdlock(r->rwlock);
+            dlist_get_data(r->list, key);
+            pthread_rwlock_unlock(r->rwlock);
+        } else {
+            dlist_epoch_enter();
+            dlist_get_data(r->list, key);
+            dlist_epoch_exit();
+        }
+    }
+    r->time_us = test_time_us() - r->time_us;
+    __atomic_store_n(&r->finished, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/*
+ * Mean lookup time in ns per reader, with a writer that keeps removing
+ * and re-adding keys until the readers are done.
+ */
+double bench_rcu_run(bool rcu, unsigned num_readers, bool writer)
+{
+    static uint64_t keys[TEST_BENCH_RCU_KEYS];
+    struct bench_rcu_reader readers[16];
+    pthread_t tids[16];
+    pthread_rwlock_t rwlock;
+    struct dlist list;
+    uint64_t total_us = 0;
+    unsigned i, done;
+    size_t k;
+
+    pthread_rwlock_init(&rwlock, NULL);
+    dlist_init_flags(&list, test_compare_uint64, rcu ? DLIST_F_RCU : 0);
+    dlist_pool_enable(&list, 0);
+    for (k = 0; k < TEST_BENCH_RCU_KEYS; ++k) {
+        keys[k] = k;
+        dlist_append(&list, &keys[k]);
+    }
+    for (i = 0; i < num_readers; ++i) {
+        readers[i].list = &list;
+        readers[i].rwlock = rcu ? NULL : &rwlock;
+        readers[i].keys = keys;
+        readers[i].seed = 53 + i;
+        readers[i].finished = 0;
+        pthread_create(&tids[i], NULL, bench_rcu_reader_main, &readers[i]);
+    }
+    for (k = 0, done = 0; writer && done < num_readers; ++k) {
+        uint64_t *key = &keys[k % TEST_BENCH_RCU_KEYS];
+
+        if (!rcu) pthread_rwlock_wrlock(&rwlock);
+        dlist_remove(&list, key);
+        dlist_append(&list, key);
+        if (!rcu) pthread_rwlock_unlock(&rwlock);
+        for (done = 0, i = 0; i < num_readers; ++i) {
+            done += __atomic_load_n(&readers[i].finished, __ATOMIC_ACQUIRE);
+        }
+        sched_yield();
+    }
+    for (i = 0; i < num_readers; ++i) {
+        pthread_join(tids[i], NULL);
+        total_us += readers[i].time_us;
+    }
+    dlist_destroy(&list);
+    pthread_rwlock_destroy(&rwlock);
+    return total_us * 1000.0 / ((double) num_readers * TEST_BENCH_RCU_LOOKUPS);
+}
+
+/*
+ * Reader lookup latency on a TEST_BENCH_RCU_KEYS entry list, RCU against
+ * a rwlock, without and with a writer churning the list.
+ */
+bool bench_rcu(void)
+{
+    unsigned num_readers;
+
+    printf("\n**************************************************\n");
+    printf("Benchmark: 1 writer, N readers, %d keys, %ld CPUs\n",
+            TEST_BENCH_RCU_KEYS, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("    ns per lookup     rwlock idle  rwlock busy"
+            "     rcu idle     rcu busy\n");
+
+    for (num_readers = 1; num_readers <= 8; num_readers *= 2) {
+        printf("    %2u readers:   %12.1f %12.1f %12.1f %12.1f\n",
+                num_readers,
+                bench_rcu_run(false, num_readers, false),
+                bench_rcu_run(false, num_readers, true),
+                bench_rcu_run(true, num_readers, false),
+                bench_rcu_run(true, num_readers, true));
+    }
+    return true;
+}
+
+/*
+ * Node allocation churn: fill the list to TEST_BENCH_NUM_NODES and
+ * drain it again, TEST_BENCH_ROUNDS times.
+ */
+uint64_t bench_node_churn(struct dlist *list)
+{
+    size_t i, round;
+    uint64_t time_us;
+    struct dlist_iter *iter;
+
+    time_us = test_time_us();
+    for (round = 0; round < TEST_BENCH_ROUNDS; ++round) {
+        for (i = 1; i <= TEST_BENCH_NUM_NODES; ++i) {
+            if (!dlist_append(list, (void *)(uintptr_t) i)) {
+                printf("dlist_append() failed");
+                exit(1);
+            }
+        }
+        for (iter = dlist_iter(list); iter; ) {
+            iter = dlist_iter_remove(list, iter);
+        }
+    }
+    return test_time_us() - time_us;
+}
+
+struct bench_sharded_thread
+{
+    struct dlist_sharded *set;
+    uint64_t *keys;
+    unsigned seed;
+};
+
+/* 50% lookups, 25% inserts, 25% removes over TEST_BENCH_SHARDED_KEYS */
+void *bench_sharded_main(void *arg)
+{
+    struct bench_sharded_thread *t = (struct bench_sharded_thread *) arg;
+    size_t i;
+    unsigned op;
+    uint64_t *key;
+
+    for (i = 0; i < TEST_BENCH_SHARDED_OPS; ++i) {
+        key = &t->keys[rand_r(&t->seed) % TEST_BENCH_SHARDED_KEYS];
+        op = rand_r(&t->seed) % 4;
+        if (op == 0) {
+            dlist_sharded_add(t->set, key);
+        } else if (op == 1) {
+            dlist_sharded_remove(t->set, key);
+        } else {
+            dlist_sharded_get_data(t->set, key);
+        }
+    }
+    return NULL;
+}
+
+double bench_sharded_run(size_t num_stripes, unsigned nthreads)
+{
+    static uint64_t keys[TEST_BENCH_SHARDED_KEYS];
+    struct bench_sharded_thread threads[16];
+    pthread_t tids[16];
+    struct dlist_sharded set;
+    uint64_t time_us;
+    size_t k;
+    unsigned i;
+
+    dlist_sharded_init(&set, num_stripes, test_compare_uint64,
+            dlist_hash_uint64, 0);
+    dlist_sharded_index_enable(&set, 0);
+    for (k = 0; k < TEST_BENCH_SHARDED_KEYS; ++k) {
+        keys[k] = k;
+        if (k & 1) dlist_sharded_add(&set, &keys[k]);
+    }
+
+    time_us = test_time_us();
+    for (i = 0; i < nthreads; ++i) {
+        threads[i].set = &set;
+        threads[i].keys = keys;
+        threads[i].seed = 53 + i;
+        pthread_create(&tids[i], NULL, bench_sharded_main, &threads[i]);
+    }
+    for (i = 0; i < nthreads; ++i) {
+        pthread_join(tids[i], NULL);
+    }
+    time_us = test_time_us() - time_us;
+
+    dlist_sharded_destroy(&set);
+    return time_us ?
+        (double) nthreads * TEST_BENCH_SHARDED_OPS * 1e6 / time_us : 0;
+}
+
+/*
+ * Write-heavy keyed table throughput, one stripe (a single global lock)
+ * against the default stripe count, from 1 to 16 threads.
+ */
+bool bench_sharded(void)
+{
+    unsigned nthreads;
+
+    printf("\n**************************************************\n");
+    printf("Benchmark: sharded list, %d keys, %d ops per thread, "
+            "%ld CPUs\n", TEST_BENCH_SHARDED_KEYS, TEST_BENCH_SHARDED_OPS,
+            sysconf(_SC_NPROCESSORS_ONLN));
+
+    for (nthreads = 1; nthreads <= 16; nthreads *= 2) {
+        printf("    %2u threads: 1 stripe %10.0f ops/s, "
+                "16 stripes %10.0f ops/s\n", nthreads,
+                bench_sharded_run(1, nthreads),
+                bench_sharded_run(16, nthreads));
+    }
+    return true;
+}
+
+int bench_typed_sum(const void *data, void *arg)
+{
+    *(uint64_t *) arg += *(const uint64_t *) data;
+    return 0;
+}
+
+/*
+ * Generic list with the key_compare pointer and a foreach callback
+ * against the generated list with its comparator and loop inlined:
+ * lookups over TEST_BENCH_TYPED_NODES entries and full traversals.
+ */
+bool bench_typed(void)
+{
+    uint64_t *values, key, sum, time_us, generic_us, typed_us;
+    struct u64_tlist typed;
+    struct u64_tlist_node *node;
+    struct dlist list;
+    size_t i, hits;
+    unsigned seed;
+
+    printf("\n**************************************************\n");
+    printf("Benchmark: specialized list, %d entries\n",
+            TEST_BENCH_TYPED_NODES);
+
+    values = (uint64_t *) malloc(TEST_BENCH_TYPED_NODES * sizeof(*values));
+    if (!values) {
+        printf("malloc failed\n");
+        return false;
+    }
+    dlist_init(&list, test_compare_uint64);
+    u64_tlist_init(&typed);
+    for (i = 0; i < TEST_BENCH_TYPED_NODES; ++i) {
+        values[i] = i;
+        dlist_append(&list, &values[i]);
+        u64_tlist_append(&typed, &values[i]);
+    }
+
+    seed = 59;
+    time_us = test_time_us();
+    for (i = hits = 0; i < TEST_BENCH_TYPED_LOOKUPS; ++i) {
+        key = rand_r(&seed) % TEST_BENCH_TYPED_NODES;
+        hits += dlist_get_data(&list, &key) != NULL;
+    }
+    generic_us = test_time_us() - time_us;
+    seed = 59;
+    time_us = test_time_us();
+    for (i = 0; i < TEST_BENCH_TYPED_LOOKUPS; ++i) {
+        key = rand_r(&seed) % TEST_BENCH_TYPED_NODES;
+        hits -= u64_tlist_get_data(&typed, &key) != NULL;
+    }
+    typed_us = test_time_us() - time_us;
+    printf("    %d lookups: generic %llu us, specialized %llu us\n",
+            TEST_BENCH_TYPED_LOOKUPS, (long long unsigned) generic_us,
+            (long long unsigned) typed_us);
+
+    sum = 0;
+    time_us = test_time_us();
+    for (i = 0; i < TEST_BENCH_TYPED_ROUNDS; ++i) {
+        dlist_foreach(&list, bench_typed_sum, &sum);
+    }
+    generic_us = test_time_us() - time_us;
+    time_us = test_time_us();
+    for (i = 0; i < TEST_BENCH_TYPED_ROUNDS; ++i) {
+        DLIST_FOREACH(node, &typed) {
+            sum -= *node->data;
+        }
+    }
+    typed_us = test_time_us() - time_us;
+    printf("    %d traversals: dlist_foreach %llu us, DLIST_FOREACH %llu us\n",
+            TEST_BENCH_TYPED_ROUNDS, (long long unsigned) generic_us,
+            (long long unsigned) typed_us);
+
+    u64_tlist_destroy(&typed);
+    dlist_destroy(&list);
+    free(values);
+    return hits == 0 && sum == 0;
+}
+
+uint64_t bench_linked_iter_sum(struct dlist *list)
+{
+    struct dlist_iter *iter;
+    uint64_t sum = 0;
+
+    for (iter = dlist_iter(list); iter; iter = dlist_iter_next(list, iter)) {
+        sum += *(uint64_t *) dlist_iter_get_data(iter);
+    }
+    return sum;
+}
+
+/*
+ * Per-entry cost of a dlist_iter/dlist_iter_next/dlist_iter_get_data
+ * loop calling the linked library against the same loop built with
+ * DLIST_HEADER_ONLY, where the calls can be inlined.  The list fits in
+ * cache so call overhead is not hidden behind misses.
+ */
+bool bench_header_only(void)
+{
+    static const struct {
+        const char *label;
+        unsigned flags;
+    } backends[] = {
+        { "linked", 0 },
+        { "unrolled", DLIST_F_UNROLLED }
+    };
+    uint64_t *values, sum, expect, linked_us, inline_us;
+    struct dlist list;
+    size_t i, b, round;
+    double entries = (double) TEST_BENCH_INLINE_ROUNDS * TEST_BENCH_INLINE_NODES;
+
+    printf("\n**************************************************\n");
+    printf("Benchmark: linked vs header-only iteration, %u rounds over "
+            "%u entries\n", TEST_BENCH_INLINE_ROUNDS, TEST_BENCH_INLINE_NODES);
+
+    values = (uint64_t *) malloc(TEST_BENCH_INLINE_NODES * sizeof(*values));
+    if (!values) {
+        printf("malloc failed\n");
+        exit(1);
+    }
+    for (i = 0, expect = 0; i < TEST_BENCH_INLINE_NODES; ++i) {
+        values[i] = i;
+        expect += i;
+    }
+    expect *= TEST_BENCH_INLINE_ROUNDS;
+    for (b = 0; b < ARRAY_LEN(backends); ++b) {
+        dlist_init_flags(&list, test_compare_uint64, backends[b].flags);
+        for (i = 0; i < TEST_BENCH_INLINE_NODES; ++i) {
+            dlist_append(&list, &values[i]);
+        }
+
+        sum = 0;
+        linked_us = test_time_us();
+        for (round = 0; round < TEST_BENCH_INLINE_ROUNDS; ++round) {
+            sum += bench_linked_iter_sum(&list);
+        }
+        linked_us = test_time_us() - linked_us;
+        if (sum != expect) return false;
+
+        sum = 0;
+        inline_us = test_time_us();
+        for (round = 0; round < TEST_BENCH_INLINE_ROUNDS; ++round) {
+            sum += test_inline_iter_sum(&list);
+        }
+        inline_us = test_time_us() - inline_us;
+        if (sum != expect) return false;
+
+        printf("    %-10s linked %.2f ns/entry, header-only %.2f ns/entry\n",
+                backends[b].label, linked_us * 1000.0 / entries,
+                inline_us * 1000.0 / entries);
+        dlist_destroy(&list);
+    }
+    free(values);
+    return true;
+}
+
+/* TEST_KEY_STR_LEN chars: a shared prefix and a random tail */
+void *bench_key_alloc_prefixed_str(size_t prefix_len)
+{
+    char *key = (char *) test_key_alloc_random_str();
+
+    memset(key, 'p', prefix_len);
+    return key;
+}
+
+/* Microseconds for TEST_BENCH_STRKEYS_LOOKUPS lookups of keys */
+uint64_t bench_strkeys_lookups(struct dlist *list, char **keys, bool hits)
+{
+    uint64_t time_us = test_time_us();
+    size_t i;
+
+    for (i = 0; i < TEST_BENCH_STRKEYS_LOOKUPS; ++i) {
+        if ((dlist_get_data(list, keys[i]) != NULL) != hits) {
+            printf("unexpected lookup result\n");
+            exit(1);
+        }
+    }
+    return test_time_us() - time_us;
+}
+
+/*
+ * Hits and misses on TEST_BENCH_STRKEYS_NODES random 32-character keys,
+ * with and without DLIST_F_STRKEYS, for fully random keys and for keys
+ * sharing all but their last 6 characters.
+ */
+bool bench_strkeys(void)
+{
+    static const size_t prefixes[] = { 0, TEST_KEY_STR_LEN - 6 };
+    char **keys, **probes, **missing;
+    struct dlist plain, cached;
+    size_t i, p;
+
+    printf("\n**************************************************\n");
+    printf("Benchmark: string key lookups, %d keys, %d lookups\n",
+            TEST_BENCH_STRKEYS_NODES, TEST_BENCH_STRKEYS_LOOKUPS);
+
+    keys = (char **) test_keys_alloc(TEST_BENCH_STRKEYS_NODES);
+    probes = (char **) test_keys_alloc(TEST_BENCH_STRKEYS_LOOKUPS);
+    missing = (char **) test_keys_alloc(TEST_BENCH_STRKEYS_LOOKUPS);
+    srand(61);
+    for (p = 0; p < ARRAY_LEN(prefixes); ++p) {
+        /* Pooled, so both runs get contiguous nodes */
+        dlist_init(&plain, dlist_compare_string);
+        dlist_pool_enable(&plain, 0);
+        dlist_init_flags(&cached, dlist_compare_string, DLIST_F_STRKEYS);
+        dlist_pool_enable(&cached, 0);
+        for (i = 0; i < TEST_BENCH_STRKEYS_NODES; ++i) {
+            keys[i] = (char *) bench_key_alloc_prefixed_str(prefixes[p]);
+            dlist_append(&plain, keys[i]);
+            dlist_append(&cached, keys[i]);
+        }
+        /* Copies, so hits compare the strings and not just pointers */
+        for (i = 0; i < TEST_BENCH_STRKEYS_LOOKUPS; ++i) {
+            probes[i] = strdup(keys[rand() % TEST_BENCH_STRKEYS_NODES]);
+            missing[i] = (char *) bench_key_alloc_prefixed_str(prefixes[p]);
+        }
+
+        printf("    %2zu char prefix: hits   plain %7llu us, "
+                "cached %7llu us\n", prefixes[p],
+                (long long unsigned) bench_strkeys_lookups(&plain, probes,
+                    true),
+                (long long unsigned) bench_strkeys_lookups(&cached, probes,
+                    true));
+        printf("    %2zu char prefix: misses plain %7llu us, "
+                "cached %7llu us\n", prefixes[p],
+                (long long unsigned) bench_strkeys_lookups(&plain, missing,
+                    false),
+                (long long unsigned) bench_strkeys_lookups(&cached, missing,
+                    false));
+
+        dlist_destroy(&plain);
+        dlist_destroy(&cached);
+        for (i = 0; i < TEST_BENCH_STRKEYS_NODES; ++i) {
+            free(keys[i]);
+        }
+        for (i = 0; i < TEST_BENCH_STRKEYS_LOOKUPS; ++i) {
+            free(probes[i]);
+            free(missing[i]);
+        }
+    }
+    free(keys);
+    free(probes);
+    free(missing);
+    return true;
+}
+
+/* Insert TEST_BENCH_ARENA_KEYS repeating keys, then throw the list away */
+uint64_t bench_key_arena_run(struct dlist *list, char **keys)
+{
+    uint64_t start = test_time_us();
+    size_t i;
+
+    for (i = 0; i < TEST_BENCH_ARENA_KEYS; ++i) {
+        dlist_append(list, keys[i % TEST_BENCH_ARENA_DISTINCT]);
+    }
+    dlist_destroy(list);
+    return test_time_us() - start;
+}
+
+bool bench_key_arena(void)
+{
+    struct dlist list;
+    char **keys;
+    uint64_t us;
+    size_t i;
+
+    printf("\n**************************************************\n");
+    printf("Benchmark: key copies, %d inserts of %d distinct keys\n",
+            TEST_BENCH_ARENA_KEYS, TEST_BENCH_ARENA_DISTINCT);
+
+    keys = (char **) test_keys_alloc(TEST_BENCH_ARENA_DISTINCT);
+    for (i = 0; i < TEST_BENCH_ARENA_DISTINCT; ++i) {
+        keys[i] = (char *) test_key_alloc_random_str();
+    }
+
+    dlist_init(&list, dlist_compare_string);
+    dlist_pool_enable(&list, 0);
+    dlist_set_key_alloc_funcs(&list, dlist_alloc_key_string, free);
+    us = bench_key_arena_run(&list, keys);
+    printf("    strdup/free:    %7llu us\n", (long long unsigned) us);
+
+    dlist_init(&list, dlist_compare_string);
+    dlist_pool_enable(&list, 0);
+    dlist_key_arena_enable(&list, 0, 0);
+    us = bench_key_arena_run(&list, keys);
+    printf("    arena:          %7llu us\n", (long long unsigned) us);
+
+    dlist_init(&list, dlist_compare_string);
+    dlist_pool_enable(&list, 0);
+    dlist_key_arena_enable(&list, 0, DLIST_ARENA_INTERN);
+    us = bench_key_arena_run(&list, keys);
+    printf("    interned arena: %7llu us\n", (long long unsigned) us);
+
+    for (i = 0; i < TEST_BENCH_ARENA_DISTINCT; ++i) {
+        free(keys[i]);
+    }
+    free(keys);
+    return true;
+}
+
+bool bench_node_pool(void)
+{
+    struct dlist list;
+    uint64_t heap_us, pool_us;
+
+    printf("\n**************************************************\n");
+    printf("Benchmark: node allocation, %u rounds of %u nodes\n",
+            TEST_BENCH_ROUNDS, TEST_BENCH_NUM_NODES);
+
+    dlist_init(&list, test_compare_uint64);
+    heap_us = bench_node_churn(&list);
+    dlist_destroy(&list);
+
+    dlist_init(&list, test_compare_uint64);
+    if (dlist_pool_enable(&list, 0) < 0) {
+        printf("dlist_pool_enable() failed\n");
+        return false;
+    }
+    pool_us = bench_node_churn(&list);
+    test_print_stats(&list, "node pool");
+    dlist_destroy(&list);
+
+    printf("    heap path:          %llu microseconds\n",
+            (long long unsigned) heap_us);
+    printf("    node pool:          %llu microseconds\n",
+            (long long unsigned) pool_us);
+    return true;
+}
+
+/*
+ * Full-length miss scans over the same objects, once through data
+ * pointers and once through embedded links.
+ */
+bool bench_intrusive(void)
+{
+    struct test_obj *objs;
+    struct dlist list;
+    struct dlist_ilist ilist;
+    uint64_t missing = 0, generic_us, intrusive_us;
+    size_t i, round;
+
+    printf("\n**************************************************\n");
+    printf("Benchmark: miss scan, %u rounds over %u entries\n",
+            TEST_BENCH_ROUNDS, TEST_BENCH_NUM_NODES);
+
+    objs = (struct test_obj *) calloc(TEST_BENCH_NUM_NODES, sizeof(*objs));
+    if (!objs) {
+        printf("malloc failed\n");
+        exit(1);
+    }
+    dlist_init(&list, test_compare_uint64);
+    dlist_ilist_init(&ilist);
+    for (i = 0; i < TEST_BENCH_NUM_NODES; ++i) {
+        objs[i].key = i + 1;
+        if (!dlist_append(&list, &objs[i])) {
+            printf("dlist_append() failed");
+            exit(1);
+        }
+        test_all_dlist_link_append(&ilist, &objs[i]);
+    }
+
+    generic_us = test_time_us();
+    for (round = 0; round < TEST_BENCH_ROUNDS; ++round) {
+        if (dlist_get_data(&list, &missing)) return false;
+    }
+    generic_us = test_time_us() - generic_us;
+
+    intrusive_us = test_time_us();
+    for (round = 0; round < TEST_BENCH_ROUNDS; ++round) {
+        if (test_all_dlist_find(&ilist, &missing, test_match_obj)) {
+            return false;
+        }
+    }
+    intrusive_us = test_time_us() - intrusive_us;
+
+    dlist_destroy(&list);
+    free(objs);
+
+    printf("    data pointers:      %llu microseconds\n",
+            (long long unsigned) generic_us);
+    printf("    intrusive links:    %llu microseconds\n",
+            (long long unsigned) intrusive_us);
+    return true;
+}
+
+int bench_count_callback(const void *key, void *arg)
+{
+    ++*(size_t *) arg;
+    return 0;
+}
+
+/*
+ * Traversal of TEST_BENCH_NUM_NODES entries with the one-pointer-per-node
+ * and the unrolled backend.
+ */
+bool bench_unrolled(void)
+{
+    static const struct {
+        const char *label;
+        unsigned flags;
+    } backends[] = {
+        { "linked", 0 },
+        { "unrolled", DLIST_F_UNROLLED }
+    };
+    uint64_t missing = 0, *values, iter_us, foreach_us, find_us;
+    struct dlist_iter *iter;
+    struct dlist list;
+    size_t i, b, round, count;
+
+    printf("\n**************************************************\n");
+    printf("Benchmark: traversal, %u rounds over %u entries\n",
+            TEST_BENCH_ROUNDS, TEST_BENCH_NUM_NODES);
+
+    values = (uint64_t *) calloc(TEST_BENCH_NUM_NODES, sizeof(*values));
+    if (!values) {
+        printf("malloc failed\n");
+        exit(1);
+    }
+    for (i = 0; i < TEST_BENCH_NUM_NODES; ++i) {
+        values[i] = i + 1;
+    }
+    for (b = 0; b < ARRAY_LEN(backends); ++b) {
+        dlist_init_flags(&list, test_compare_uint64, backends[b].flags);
+        for (i = 0; i < TEST_BENCH_NUM_NODES; ++i) {
+            if (!dlist_append(&list, &values[i])) {
+                printf("dlist_append() failed");
+                exit(1);
+            }
+        }
+        /* Churn half the entries so linked nodes end up scattered */
+        srand(11);
+        for (iter = dlist_iter(&list), count = 0; iter; ) {
+            if (rand() & 1) {
+                iter = dlist_iter_remove(&list, iter);
+                ++count;
+            } else {
+                iter = dlist_iter_next(&list, iter);
+            }
+        }
+        for (i = 0; i < count; ++i) {
+            dlist_append(&list, &values[i]);
+        }
+
+        count = 0;
+        iter_us = test_time_us();
+        for (round = 0; round < TEST_BENCH_ROUNDS; ++round) {
+            for (iter = dlist_iter(&list); iter;
+                    iter = dlist_iter_next(&list, iter)) {
+                count += dlist_iter_get_data(iter) != NULL;
+            }
+        }
+        iter_us = test_time_us() - iter_us;
+
+        foreach_us = test_time_us();
+        for (round = 0; round < TEST_BENCH_ROUNDS; ++round) {
+            dlist_foreach(&list, bench_count_callback, &count);
+        }
+        foreach_us = test_time_us() - foreach_us;
+
+        find_us = test_time_us();
+        for (round = 0; round < TEST_BENCH_ROUNDS; ++round) {
+            if (dlist_get_data(&list, &missing)) return false;
+        }
+        find_us = test_time_us() - find_us;
+
+        if (count != 2 * TEST_BENCH_ROUNDS * (size_t) TEST_BENCH_NUM_NODES) {
+            printf("traversal visited %zu entries\n", count);
+            return false;
+        }
+        printf("    %-10s iter %llu us, foreach %llu us, miss scan %llu us\n",
+                backends[b].label, (long long unsigned) iter_us,
+                (long long unsigned) foreach_us, (long long unsigned) find_us);
+        dlist_destroy(&list);
+    }
+    free(values);
+    return true;
+}
+
+/*
+ * Main function
+ */
+int main(int argc, char **argv)
+{
+    bool success = true;
+
+    /* Initialize */
+    printf("Initializing lists...");
+    if (dlist_init(&str_list, dlist_compare_string) < 0) {
+        success = false;
+    }
+    /*
+    dlist_set_key_alloc_funcs(&str_list, dlist_alloc_key_string, free);
+     */
+    if (dlist_init(&int_list, test_compare_uint64) < 0) {
+        success = false;
+    }
+    if (dlist_init(&str_pool_list, dlist_compare_string) < 0 ||
+            dlist_pool_enable(&str_pool_list, 4) < 0) {
+        success = false;
+    }
+    if (dlist_init(&int_pool_list, test_compare_uint64) < 0 ||
+            dlist_pool_enable(&int_pool_list, 4) < 0) {
+        success = false;
+    }
+    if (dlist_init_flags(&str_unrolled_list, dlist_compare_string,
+                DLIST_F_UNROLLED) < 0) {
+        success = false;
+    }
+    if (dlist_init_flags(&int_unrolled_list, test_compare_uint64,
+                DLIST_F_UNROLLED) < 0) {
+        success = false;
+    }
+    if (dlist_init_flags(&str_sorted_list, dlist_compare_string,
+                DLIST_F_SORTED) < 0) {
+        success = false;
+    }
+    if (dlist_init_flags(&int_sorted_list, test_compare_uint64,
+                DLIST_F_SORTED) < 0) {
+        success = false;
+    }
+    if (dlist_init_flags(&str_strkeys_list, dlist_compare_string,
+                DLIST_F_STRKEYS) < 0) {
+        success = false;
+    }
+    if (dlist_init(&str_indexed_list, dlist_compare_string) < 0 ||
+            dlist_index_enable(&str_indexed_list, dlist_hash_string, 0) < 0) {
+        success = false;
+    }
+    if (dlist_init(&int_indexed_list, test_compare_uint64) < 0 ||
+            dlist_index_enable(&int_indexed_list, dlist_hash_uint64, 64) < 0) {
+        success = false;
+    }
+    printf("done\n");
+
+    if (!success) {
+        printf("dlist init failed");
+        return 1;
+    }
+
+    printf("Generating test %u test keys...", TEST_NUM_KEYS);
+    test_keys_generate();
+    printf("done\n");
+
+    printf("Running tests\n\n");
+    success &= test_run_all(&str_list, keys_str_random, tests,
+            ARRAY_LEN(tests), "dlist w/randomized string keys");
+    success &= test_run_all(&int_list, keys_int_random, tests,
+            ARRAY_LEN(tests), "dlist w/randomized integer keys");
+    success &= test_run_all(&str_pool_list, keys_str_random, tests,
+            ARRAY_LEN(tests), "pooled dlist w/randomized string keys");
+    success &= test_run_all(&int_pool_list, keys_int_random, tests,
+            ARRAY_LEN(tests), "pooled dlist w/randomized integer keys");
+    success &= test_run_all(&str_unrolled_list, keys_str_random, tests,
+            ARRAY_LEN(tests), "unrolled dlist w/randomized string keys");
+    success &= test_run_all(&int_unrolled_list, keys_int_random, tests,
+            ARRAY_LEN(tests), "unrolled dlist w/randomized integer keys");
+    success &= test_run_all(&str_indexed_list, keys_str_random, tests,
+            ARRAY_LEN(tests), "indexed dlist w/randomized string keys");
+    success &= test_run_all(&int_indexed_list, keys_int_random, tests,
+            ARRAY_LEN(tests), "indexed dlist w/randomized integer keys");
+    success &= test_run_all(&str_sorted_list, keys_str_random, tests,
+            ARRAY_LEN(tests), "sorted dlist w/randomized string keys");
+    success &= test_run_all(&int_sorted_list, keys_int_random, tests,
+            ARRAY_LEN(tests), "sorted dlist w/randomized integer keys");
+    success &= test_run_all(&str_strkeys_list, keys_str_random, tests,
+            ARRAY_LEN(tests), "string key dlist w/randomized string keys");
+
+    success &= test_intrusive();
+    success &= test_list_model(&int_list, false, "linked");
+    success &= test_list_model(&int_pool_list, false, "pooled");
+    success &= test_list_model(&int_unrolled_list, false, "unrolled");
+    success &= test_list_model(&int_indexed_list, true, "indexed");
+    success &= test_sorted_model(&int_sorted_list);
+    success &= test_search_policy();
+    success &= test_bulk(0, false, false, false, "heap nodes, empty");
+    success &= test_bulk(0, false, false, true, "heap nodes");
+    success &= test_bulk(0, true, false, false, "pooled, empty");
+    success &= test_bulk(0, true, false, true, "pooled");
+    success &= test_bulk(0, false, true, false, "indexed");
+    success &= test_bulk(DLIST_F_UNROLLED, false, false, false, "unrolled");
+    success &= test_bulk(DLIST_F_SORTED, false, true, true, "sorted");
+    success &= test_bulk_batches();
+    success &= test_remove_if(0, false, false, false, "linked");
+    success &= test_remove_if(0, true, true, false, "pooled, indexed");
+    success &= test_remove_if(DLIST_F_SORTED, false, false, false, "sorted");
+    success &= test_remove_if(DLIST_F_UNROLLED, false, false, false,
+            "unrolled");
+    success &= test_remove_if(0, false, true, true, "linked");
+    success &= test_remove_if(0, true, false, true, "pooled");
+    success &= test_splice(0, false, false, "linked");
+    success &= test_splice(0, true, true, "pooled, indexed");
+    success &= test_splice(DLIST_F_UNROLLED, false, false, "unrolled");
+    success &= test_splice_invalid();
+    success &= test_sort();
+    success &= test_sort_parallel();
+    success &= test_foreach_parallel(0, "linked");
+    success &= test_foreach_parallel(DLIST_F_UNROLLED, "unrolled");
+    success &= test_mpsc();
+    success &= test_bqueue();
+    success &= test_lfset();
+    success &= test_rcu();
+    success &= test_sharded();
+    success &= test_typed();
+    success &= test_header_only();
+    success &= test_strkeys();
+    success &= test_iter_replace();
+    success &= test_key_arena();
+    success &= test_stats();
+
+    printf("\nRunning benchmarks\n");
+    success &= bench_node_pool();
+    success &= bench_bulk();
+    success &= bench_intrusive();
+    success &= bench_unrolled();
+    success &= bench_index();
+    success &= bench_search_policy();
+    success &= bench_remove_if();
+    success &= bench_splice();
+    success &= bench_sort();
+    success &= bench_sort_parallel();
+    success &= bench_foreach_parallel();
+    success &= bench_mpsc();
+    success &= bench_bqueue();
+    success &= bench_lfset();
+    success &= bench_rcu();
+    success &= bench_sharded();
+    success &= bench_typed();
+    success &= bench_header_only();
+    success &= bench_strkeys();
+    success &= bench_key_arena();
 
     printf("\nTests finished\n");
 
     dlist_destroy(&str_list);
     dlist_destroy(&int_list);
+    dlist_destroy(&str_pool_list);
+    dlist_destroy(&int_pool_list);
+    dlist_destroy(&str_unrolled_list);
+    dlist_destroy(&int_unrolled_list);
+    dlist_destroy(&str_indexed_list);
+    dlist_destroy(&int_indexed_list);
+    dlist_destroy(&str_sorted_list);
+    dlist_destroy(&int_sorted_list);
+    dlist_destroy(&str_strkeys_list);
+    dlist_workers_shutdown();
 
     if (!success) {
         printf("Tests FAILED\n");